@@ -0,0 +1,50 @@
+#version 330 core
+
+// Applies the screen space AO to the main pass' color
+// - blended with GL_FUNC_REVERSE_SUBTRACT, so the output is the light that
+//   the occlusion takes away from the ambient term
+// - the AO buffer is upsampled and denoised in one go: a 3x3 blur over its
+//   texels, weighted down where a texel saw another surface
+out vec4 fragColor;
+
+uniform sampler2D hitDepth;
+uniform sampler2D gBuffer;
+uniform sampler2D ambient;
+// Output of ssao.frag
+uniform sampler2D aoBuffer;
+
+// Pixels per AO texel along each axis (matches AO_SCALE on the CPU)
+const int AO_SCALE = 2;
+// Sharpness of the normal weight
+const float AO_NORMAL_POWER = 8.0;
+// Relative depth difference at which a texel stops contributing
+const float AO_DEPTH_TOLERANCE = 0.05;
+
+void main() {
+    ivec2 px = ivec2(gl_FragCoord.xy);
+    float d = texelFetch(hitDepth, px, 0).r;
+    if (d < 0.0) discard;
+    vec3 n = texelFetch(gBuffer, px, 0).xyz;
+
+    vec2 pos = gl_FragCoord.xy / float(AO_SCALE) - 0.5;
+    ivec2 base = ivec2(floor(pos + 0.5));
+    ivec2 last = textureSize(aoBuffer, 0) - 1;
+    ivec2 fullLast = textureSize(hitDepth, 0) - 1;
+    float sum = 0.0, wSum = 0.0;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            ivec2 c = clamp(base + ivec2(x, y), ivec2(0), last);
+            vec2 ao = texelFetch(aoBuffer, c, 0).rg;
+            if (ao.g < 0.0) continue;
+            vec3 cn = texelFetch(gBuffer, min(c * AO_SCALE, fullLast), 0).xyz;
+            vec2 dist = vec2(c) - pos;
+            float w = exp(-dot(dist, dist));
+            w *= pow(max(dot(cn, n), 0.0), AO_NORMAL_POWER);
+            w *= max(0.0, 1.0 - abs(ao.g - d) / (AO_DEPTH_TOLERANCE * d));
+            sum += w * ao.r;
+            wSum += w;
+        }
+    }
+    float ao = wSum > 0.0 ? sum / wSum : 1.0;
+    fragColor = vec4(texelFetch(ambient, px, 0).rgb * (1.0 - ao), 0.0);
+}
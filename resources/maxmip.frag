@@ -0,0 +1,24 @@
+#version 330 core
+
+// Builds one level of the terrain max height pyramid from the level below
+// - the source is the only level visible through heights, so the level being
+//   written is never sampled
+out float maxHeight;
+
+uniform sampler2D heights;
+// Level 1 reads the samples themselves: its texel m bounds the cells between
+// samples 2m and 2m + 2, which takes three of them per axis
+uniform bool firstLevel;
+
+void main() {
+    ivec2 src = ivec2(gl_FragCoord.xy) * 2;
+    ivec2 last = textureSize(heights, 0) - 1;
+    int n = firstLevel ? 3 : 2;
+    float m = -1e30;
+    for (int y = 0; y < n; y++) {
+        for (int x = 0; x < n; x++) {
+            m = max(m, texelFetch(heights, min(src + ivec2(x, y), last), 0).r);
+        }
+    }
+    maxHeight = m;
+}
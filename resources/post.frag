@@ -1,14 +1,50 @@
 #version 330 core
-// FXAA
-// source: http://blog.simonrodriguez.fr/articles/2016/07/implementing_fxaa.html
+// All the post effects in one pass over the main pass's output
+// 1. Bloom composite and HDR tone mapping, or gamma correction
+// 2. FXAA on the result, which is computed on the fly for every tap
+// FXAA source: http://blog.simonrodriguez.fr/articles/2016/07/implementing_fxaa.html
 out vec4 FragColor;
 
 in vec2 TexCoords;
 
-uniform sampler2D screenTexture;
+// HDR color of the main pass (LDR when neither hdr, bloom nor gamma is set)
+uniform sampler2D colorBuffer;
+uniform sampler2D bloomBlur;
+
+uniform bool hdr;
+uniform bool bloom;
+uniform bool gamma;
+uniform bool fxaa;
+uniform float exposure;
 uniform vec2 inverseScreenSize;
 uniform float multiplier = 1.0;
 
+// 1. Displayed color of an HDR color and its bloom
+vec3 toneMap(vec3 color, vec3 bloomColor) {
+    if (hdr || bloom) {
+        if (bloom) color += bloomColor;
+        color = vec3(1.0) - exp(-color * exposure);
+    } else if (gamma) {
+        color = pow(color, vec3(1.0 / 2.2));
+    }
+    // - FXAA used to read it back from an 8 bit target
+    return clamp(color, 0.0, 1.0);
+}
+
+// Displayed color at uv, bilinearly filtered before the tone mapping
+vec3 resolve(vec2 uv) {
+    vec3 bloomColor = bloom ? texture(bloomBlur, uv).rgb : vec3(0.0);
+    return toneMap(texture(colorBuffer, uv).rgb, bloomColor);
+}
+
+// Displayed color of the pixel offset from this one, clamped to the screen
+vec3 resolveTexel(ivec2 offset) {
+    ivec2 px = clamp(ivec2(gl_FragCoord.xy) + offset, ivec2(0), textureSize(colorBuffer, 0) - 1);
+    vec3 bloomColor = bloom ? texelFetch(bloomBlur, px, 0).rgb : vec3(0.0);
+    return toneMap(texelFetch(colorBuffer, px, 0).rgb, bloomColor);
+}
+
+// 2.
 float EDGE_THRESHOLD_MIN = 0.0312;
 float EDGE_THRESHOLD_MAX = 0.125;
 float SUBPIXEL_QUALITY = 0.875;
@@ -21,14 +57,18 @@ float rgb2luma(vec3 rgb) {
 }
 
 void main() {
-    vec3 colorCenter = texture(screenTexture, TexCoords).rgb;
+    vec3 colorCenter = resolveTexel(ivec2(0));
+    if (!fxaa) {
+        FragColor = vec4(colorCenter, 1.0);
+        return;
+    }
 
     float lumaCenter = rgb2luma(colorCenter);
 
-    float lumaDown = rgb2luma(textureOffset(screenTexture,TexCoords,ivec2(0,-1)).rgb);
-    float lumaUp = rgb2luma(textureOffset(screenTexture,TexCoords,ivec2(0,1)).rgb);
-    float lumaLeft = rgb2luma(textureOffset(screenTexture,TexCoords,ivec2(-1,0)).rgb);
-    float lumaRight = rgb2luma(textureOffset(screenTexture,TexCoords,ivec2(1,0)).rgb);
+    float lumaDown = rgb2luma(resolveTexel(ivec2(0,-1)));
+    float lumaUp = rgb2luma(resolveTexel(ivec2(0,1)));
+    float lumaLeft = rgb2luma(resolveTexel(ivec2(-1,0)));
+    float lumaRight = rgb2luma(resolveTexel(ivec2(1,0)));
 
     float lumaMin = min(lumaCenter,min(min(lumaDown,lumaUp),min(lumaLeft,lumaRight)));
     float lumaMax = max(lumaCenter,max(max(lumaDown,lumaUp),max(lumaLeft,lumaRight)));
@@ -40,10 +80,10 @@ void main() {
         return;
     }
 
-    float lumaDownLeft = rgb2luma(textureOffset(screenTexture,TexCoords,ivec2(-1,-1)).rgb);
-    float lumaUpRight = rgb2luma(textureOffset(screenTexture,TexCoords,ivec2(1,1)).rgb);
-    float lumaUpLeft = rgb2luma(textureOffset(screenTexture,TexCoords,ivec2(-1,1)).rgb);
-    float lumaDownRight = rgb2luma(textureOffset(screenTexture,TexCoords,ivec2(1,-1)).rgb);
+    float lumaDownLeft = rgb2luma(resolveTexel(ivec2(-1,-1)));
+    float lumaUpRight = rgb2luma(resolveTexel(ivec2(1,1)));
+    float lumaUpLeft = rgb2luma(resolveTexel(ivec2(-1,1)));
+    float lumaDownRight = rgb2luma(resolveTexel(ivec2(1,-1)));
 
     // Combine the four edges lumas (using intermediary variables for future computations with the same values).
     float lumaDownUp = lumaDown + lumaUp;
@@ -92,8 +132,8 @@ void main() {
     vec2 uv1 = currentUV - offset;
     vec2 uv2 = currentUV + offset;
 
-    float lumaEnd1 = rgb2luma(texture(screenTexture, uv1).rgb);
-    float lumaEnd2 = rgb2luma(texture(screenTexture, uv2).rgb);
+    float lumaEnd1 = rgb2luma(resolve(uv1));
+    float lumaEnd2 = rgb2luma(resolve(uv2));
     lumaEnd1 -= lumaLocalAverage;
     lumaEnd2 -= lumaLocalAverage;
 
@@ -108,12 +148,12 @@ void main() {
     if (!reachedBoth) {
         for (int i = 2; i < ITERATIONS; i++) {
             if (!reached1) {
-                lumaEnd1 = rgb2luma(texture(screenTexture, uv1).rgb);
+                lumaEnd1 = rgb2luma(resolve(uv1));
                 lumaEnd1 = lumaEnd1 - lumaLocalAverage;
             }
 
             if (!reached2) {
-                lumaEnd2 = rgb2luma(texture(screenTexture, uv2).rgb);
+                lumaEnd2 = rgb2luma(resolve(uv2));
                 lumaEnd2 = lumaEnd2 - lumaLocalAverage;
             }
 
@@ -161,6 +201,6 @@ void main() {
         finalUv.x += finalOffset * stepLength * multiplier;
     }
 
-    vec3 finalColor = texture(screenTexture, finalUv).rgb;
+    vec3 finalColor = resolve(finalUv);
     FragColor = vec4(finalColor, 1.0);
 }
@@ -1,4 +1,4 @@
-#version 330 core
+#version 410 core
 // ==== Preprocessor Directives ====
 
 // == DAY and NIGHT ==
@@ -14,13 +14,27 @@
 // #define SEA
 #define PERLIN_BUMP
 
+// The compute pass (raymarch.comp) includes this file with COMPUTE_PASS
+// defined and declares the inputs and outputs itself
+#ifndef COMPUTE_PASS
 // =============== Out =============
 layout (location = 0) out vec4 fragColor;
 layout (location = 1) out vec4 BrightColor;
+// Distance from the eye to the primary hit (-1 if nothing was hit)
+layout (location = 2) out float hitDepth;
+// Normal and distance of the primary hit (w < 0 if nothing was hit), written
+// by the half resolution secondary ray pass
+layout (location = 3) out vec4 gBuffer;
+// Ambient term of the primary hit, darkened afterwards by screen space AO
+layout (location = 4) out vec4 ambientColor;
+// Area light visibility of the primary hit (rgb) and its distance (a)
+layout (location = 5) out vec4 areaVisibility;
 // =============== In ==============
 in vec4 nearClip;
 in vec4 farClip;
 in vec2 twoDFragCoord;
+#define fragCoord gl_FragCoord
+#endif
 // ============ CONST ==============
 const float INSIDE = -1.f;
 const float OUTSIDE = 1.f;
@@ -28,21 +42,67 @@ const float OUTSIDE = 1.f;
 const int MAX_STEPS = 256;
 const int MAX_STEPS_FRACTALS = 20;
 const int FRACTALS_BAILOUT = 2;
+// Extra iterations on top of the ones the pixel footprint asks for
+const int FRACTAL_LOD_BIAS = 1;
+// Distance from its bounding sphere/box beyond which a fractal is not iterated
+const float FRACTAL_BOUND_MARGIN = 0.1;
+// Extra fbm octaves on top of the ones the pixel footprint asks for
+const float OCTAVE_BIAS = 1.0;
+// Points per row of the reference orbit (matches DeepZoom::ORBIT_WIDTH)
+const int DEEP_ZOOM_ORBIT_WIDTH = 1024;
+// Escape radius squared (matches DeepZoom::BAILOUT)
+const float DEEP_ZOOM_BAILOUT = 65536.0;
+// Distance from the set, in pixels, at which the exterior is fully lit
+const float DEEP_ZOOM_DE_PIXELS = 4.0;
+// Coarsest fractal cache level is every 2^(FRACTAL_CACHE_LEVELS - 1)th pixel
+// (matches FRACTAL_CACHE_LEVELS on the CPU)
+const int FRACTAL_CACHE_LEVELS = 4;
 // - threshold for intersection
 const float SURFACE_DIST = 0.001;
+// Hit threshold in pixels (1 = stop once within one pixel footprint)
+const float PIXEL_CONE_SCALE = 1.0;
+// Size of the depth prepass tiles in pixels (matches PREPASS_SCALE on the CPU)
+const int PREPASS_SCALE = 4;
+// Fraction of the reprojected hit distance that is kept as a safety margin
+const float TEMPORAL_MARGIN = 0.1;
+// Size of the object culling tiles in pixels (matches TILE_SIZE on the CPU)
+const int TILE_SIZE = 16;
+const uint ALL_OBJECTS = 0xffffffffu;
+// Soft shadow rays stop once the light is (almost) fully blocked
+const float SHADOW_MIN_VISIBILITY = 0.01;
+// Lattice cells before the noise volume repeats (NoiseVolume::PERIOD)
+const float NOISE_PERIOD = 32.0;
 const float PLANCK = 0.01;
 // - small offset for the origin of shadow rays
 const float SHADOWRAY_OFFSET = 0.007;
 // - small eps for computing uv mapping
 const float TEXTURE_EPS = 0.005;
-// - area light samples
-const int AREA_LIGHT_SAMPLES = 1;
+// - area light shadows (see areaLightVisibility)
+// Area lights whose visibility is kept in the history, in scene order
+const int AREA_HISTORY_LIGHTS = 3;
+// Weight of the new frame when accumulating the visibility
+const float AREA_BLEND = 0.1;
+// Relative depth difference at which the history is rejected
+const float AREA_DEPTH_TOLERANCE = 0.05;
+// Per frame offset of the blue noise sample points (R2 sequence)
+const vec2 AREA_SAMPLE_STEP = vec2(0.7548776662, 0.5698402910);
 // - PI
 const float PI = 3.14159265;
 const float TAU = 6.28318;
 const vec3 ANGLE = vec3(0);
-// - reflection depth
-const int NUM_REFLECTION = 1;
+// - secondary rays (see pushSecondaryRays)
+const int RAY_STACK_SIZE = 8;
+const int MAX_SECONDARY_RAYS = 16;
+const float MIN_THROUGHPUT = 0.01;
+// - half resolution secondary rays (see secondaryFromBuffer)
+// Pixels per secondary buffer texel along each axis (matches SECONDARY_SCALE on the CPU)
+const int SECONDARY_SCALE = 2;
+// Sharpness of the normal weight
+const float SECONDARY_NORMAL_POWER = 16.0;
+// Relative depth difference at which a texel stops contributing
+const float SECONDARY_DEPTH_TOLERANCE = 0.05;
+// Total weight below which the pixel traces its own secondary rays
+const float SECONDARY_MIN_WEIGHT = 0.05;
 // - Area Lights
 const float LUT_SIZE  = 64.0; // ltc_texture size
 const float LUT_SCALE = (LUT_SIZE - 1.0)/LUT_SIZE;
@@ -69,6 +129,15 @@ const int CUSTOM = 13;
 const int CUSTOM_TEX_OFF = 15;
 
 // LIGHT TYPES
+// Render passes
+const int PASS_SHADE = 0;
+const int PASS_DEPTH = 1;
+const int PASS_TERRAIN = 2;
+const int PASS_CLOUD = 3;
+const int PASS_SKY = 4;
+const int PASS_SECONDARY = 5;
+const int PASS_FRACTAL = 6;
+
 const int POINT = 0;
 const int DIRECTIONAL = 1;
 const int SPOT = 2;
@@ -79,6 +148,14 @@ const vec3 BRIGHT_FILTER = vec3(0.2126, 0.7152, 0.0722);
 
 // TERRAIN
 const float TERRAIN_HIGH = 700.f;
+// Height and horizontal scale of the fbm in sdTerrain
+const float TERRAIN_AMPLITUDE = 600.0;
+const float TERRAIN_EXTENT = 2000.0;
+// Largest slope of the cliff mapping in sdTerrain (1 + 90 * 1.5 / 42), by
+// which it can stretch a height difference
+const float TERRAIN_CLIFF_SLOPE = 4.215;
+// Largest gradient of noiseT and of the noise volume, sqrt(2) * 2 * 30 / 16
+const float NOISE_LIPSCHITZ = 5.304;
 
 
 // CLOUD
@@ -89,6 +166,14 @@ const vec3 CLOUD_AMBIENT = vec3(0.03, 0.018, 0.018);
 const float CLOUD_LOW = 600.f;
 const float CLOUD_MID = 900.f;
 const float CLOUD_HIGH = 1200.f;
+// Pixels per cloud buffer texel along each axis (matches CLOUD_SCALE on the CPU)
+const int CLOUD_SCALE = 2;
+// Weight of the new frame when accumulating the cloud buffer
+const float CLOUD_BLEND = 0.2;
+
+// SKY
+// Texels along each side of a sky cubemap face (matches SKY_CUBEMAP_SIZE on the CPU)
+const float SKY_SIZE = 512.0;
 
 // SEA
 const int ITER_GEOMETRY = 3;
@@ -128,9 +213,6 @@ const mat3 ma = mat3( 0.60, 0.00,  0.80,
 const float BUMP_SCALE = 10.0;
 const float BUMP_INTENSITY = 2.0;
 
-int FRAME;
-float SPEED;
-const int SPEED_SCALE = 3;
 // ============ Structs ============
 struct RayMarchObject
 {
@@ -165,6 +247,12 @@ struct RayMarchObject
     bool isEmissive;
     vec3 color;
     int lightIdx;
+
+    // Over-relaxation factor when the ray is closest to this object
+    // - 1 for fractals whose distance estimate is not a true bound
+    float relaxation;
+    // World space bounding sphere (w < 0 if unbounded)
+    vec4 bounds;
 };
 
 struct SceneMin
@@ -222,6 +310,10 @@ struct LightSource
     vec3 lightFunc;
     float lightAngle;
     float lightPenumbra;
+    // Objects that may block this light (bit i = object i)
+    uint casterMask;
+    // Distance beyond which the light is negligible (-1 if unbounded)
+    float range;
 
     // Area Light
     vec3 points[4];
@@ -240,10 +332,48 @@ struct RenderInfo
     bool isAL;
 };
 
+struct SecondaryRay
+{
+    // Reflected or refracted ray waiting to be traced
+    vec3 ro;
+    vec3 rd;
+    // Accumulated material weight of the path
+    vec3 fil;
+    // Number of bounces from the camera
+    int depth;
+};
+
+int FRAME;
+float SPEED;
+// Statistics (written out instead of the color when showStats is set)
+// - iterations of the primary ray
+int PRIMARY_STEPS = 0;
+// - iterations of every march in this fragment (primary, shadow, secondary)
+int TOTAL_STEPS = 0;
+// - iterations of the most recent raymarch() call
+int LAST_MARCH_STEPS = 0;
+// Secondary rays still to be traced (GLSL has no recursion)
+SecondaryRay RAY_STACK[RAY_STACK_SIZE];
+int RAY_STACK_TOP = 0;
+// Ambient term of the most recent getPhong() call, scaled like its result
+vec3 AMBIENT_TERM = vec3(0.f);
+// Whether getPhong() is shading the primary hit of this pixel
+bool PRIMARY_SHADING = false;
+// Written out as areaVisibility
+vec4 AREA_VISIBILITY = vec4(1.f, 1.f, 1.f, -1.f);
+const int SPEED_SCALE = 3;
+
 // =========== Uniforms ============
 // Screen/Camera
 uniform vec4 eyePosition;
+uniform mat4 invProjViewMatrix;
+// - camera of the previous frame (temporal reprojection)
+uniform mat4 prevProjViewMatrix;
+uniform mat4 prevInvProjViewMatrix;
+uniform vec4 prevEyePosition;
 uniform vec2 screenDimensions;
+// World space size of a pixel at unit distance from the eye
+uniform float pixelFootprint;
 uniform float initialFar;
 uniform bool isTwoD;
 
@@ -269,6 +399,26 @@ uniform sampler2D LTC1;
 uniform sampler2D LTC2;
 uniform sampler2D noise;
 uniform sampler2D bluenoise;
+uniform sampler2D prepassDepth;
+uniform sampler2D hitHistory;
+uniform usampler2D tileObjects;
+uniform sampler3D noiseVolume;
+uniform sampler2D terrainHeights;
+// Cloud buffer: last frame's while the cloud pass runs, this frame's after
+uniform sampler2D clouds;
+uniform sampler2D cloudDepth;
+// Baked getSky and getMoonColor
+uniform samplerCube daySky;
+uniform samplerCube nightSky;
+// Half resolution secondary rays and the primary hits they were traced from
+uniform sampler2D secondaryColor;
+uniform sampler2D secondaryGBuffer;
+// Previous frame's areaVisibility
+uniform sampler2D areaHistory;
+// Reference orbit of the deep zoom (see DeepZoomOrbit)
+uniform sampler2D deepZoomOrbit;
+// Brightness of the 2D fractal per pixel, g > 0 where it was computed
+uniform sampler2D fractalCache;
 
 // Timer
 uniform float iTime;
@@ -281,9 +431,67 @@ uniform bool enableAmbientOcculusion;
 uniform bool enableSkyBox;
 uniform float power;
 uniform vec2 juliaSeed;
+// Deep zoom of the 2D Mandelbrot set (see sdDeepMandelBrot)
+uniform bool enableDeepZoom;
+uniform int deepZoomOrbitLength;
+uniform int deepZoomIterations;
+uniform int deepZoomSkip;
+// - series approximation of delta at deepZoomSkip
+uniform vec2 deepZoomCoeffs[3];
+// - half height of the view the orbit was computed for
+uniform float deepZoomScale;
+// - half height of the current view over deepZoomScale
+uniform float deepZoomViewRatio;
+// - current view center relative to the orbit's, over deepZoomScale
+uniform vec2 deepZoomOffset;
+// - the deep zoom is drawn from fractalCache (see fractalCachePass)
+uniform bool enableFractalCache;
+uniform bool fractalCacheValid;
+// - pixel of the previous cache that the current pixel (0, 0) was
+uniform vec2 fractalShift;
+// - the refinement grid has its points where px + fractalOrigin is a multiple
+//   of 2^level, so that it stays on the same spot of the set during a pan
+uniform vec2 fractalOrigin;
 uniform int numOctaves;
 uniform float terrainHeight = 0.f;
 uniform float terrainScale;
+// Performance
+uniform bool enableAdaptiveEpsilon;
+uniform bool enableRelaxedTracing;
+uniform bool enableDepthPrepass;
+uniform bool enableTemporalReprojection;
+uniform bool historyValid;
+uniform bool enableTileCulling;
+uniform bool enableShadowCulling;
+uniform bool enableNoiseVolume;
+uniform bool enableFractalLOD;
+uniform bool enableAdaptiveOctaves;
+uniform bool enableTerrainBake;
+uniform vec2 terrainBakeOrigin;
+uniform float terrainBakeSpacing;
+uniform int terrainBakeLevels;
+uniform bool enableCloudBuffer;
+uniform bool cloudHistoryValid;
+uniform int frameIndex;
+uniform bool enableSkyCubemap;
+uniform int maxBounces;
+uniform bool enableHalfResSecondary;
+// Ambient occlusion is computed in screen space after the main pass
+uniform bool enableScreenSpaceAO;
+// Shadow rays per area light and pixel
+uniform int areaLightSamples;
+// Area light visibility is accumulated over frames
+uniform bool enableAreaShadowReuse;
+uniform bool areaHistoryValid;
+// Sky cubemap face and layer (0: day, 1: night) being baked
+uniform int skyFace;
+uniform int skyLayer;
+// Sun and sky (see Realtime::configureSkyUniforms)
+uniform vec3 sunDirection;
+uniform vec3 sunColor;
+uniform vec3 skyColor;
+uniform int renderPass;
+uniform bool showStats;
 
 // ================== Utility =======================
 float tri(float x) {
@@ -567,6 +775,13 @@ vec4 noised( in vec3 x ) {
 }
 
 
+// Value noise and its derivatives from the precomputed volume
+// - same layout as noised(vec3), baked by NoiseVolume on the CPU
+// - tiles every NOISE_PERIOD units, hardware trilinear filtering in between
+vec4 noisedVolume(in vec3 x) {
+    return texture(noiseVolume, x / NOISE_PERIOD);
+}
+
 // Used in fbmd_9
 // Derivative based noise
 // ref: https://iquilezles.org/articles/morenoise/
@@ -597,6 +812,24 @@ float noiseV(vec3 x ) {
   return mix( rg.x, rg.y, f.z )*2.0-1.0;
 }
 
+// Number of fbm octaves whose detail is still wider than the footprint
+// - octave i has noise cells 1 / lacunarity^i wide in the input space
+// - the result is fractional, the last octave is faded in by the fraction so
+// that octaves do not pop in and out as the camera moves
+// @param footprint Pixel footprint in the noise's input space (0 for full detail)
+// @param lacunarity Frequency multiplier between octaves
+// @param maxOctaves Octaves at full detail
+float octaveCount(float footprint, float lacunarity, int maxOctaves) {
+    if (!enableAdaptiveOctaves || footprint <= 0.0) return float(maxOctaves);
+    float n = log2(0.5 / footprint) / log2(lacunarity) + OCTAVE_BIAS;
+    return clamp(n, 1.0, float(maxOctaves));
+}
+
+// Weight of octave i out of octaveCount's fractional count
+float octaveWeight(float octaves, int i) {
+    return clamp(octaves - float(i), 0.0, 1.0);
+}
+
 // 2d fractal noise used in sand dune
 float fbm(vec2 p) {
     float f = 0.0;
@@ -627,15 +860,18 @@ float fbm_4( in vec3 x ) {
 }
 
 // Used in sdTerrain to get noise
-float fbm_9( in vec2 x ) {
+// @param footprint Pixel footprint in the space of x (see octaveCount)
+float fbm_9( in vec2 x, float footprint ) {
     float f = 1.9;
     float s = 0.55;
     float a = 0.0;
     float b = 0.5;
-    for( int i=0; i<9; i++ )
+    float octaves = octaveCount(footprint, f, numOctaves);
+    for( int i=0; i<int(ceil(octaves)); i++ )
     {
-        float n = noiseT(x);
-        a += b*n;
+        // 2D noise is a slice of the volume
+        float n = enableNoiseVolume ? noisedVolume(vec3(x, 0.f)).x : noiseT(x);
+        a += octaveWeight(octaves, i)*b*n;
         b *= s;
         x = f*m2*x;
     }
@@ -644,7 +880,8 @@ float fbm_9( in vec2 x ) {
 }
 
 // Used in cloudFbm
-vec4 fbmd_8( in vec3 x ) {
+// @param footprint Pixel footprint in the space of x (see octaveCount)
+vec4 fbmd_8( in vec3 x, float footprint ) {
     float f = 2.0;
     float s = 0.65;
     float a = 0.0;
@@ -653,12 +890,14 @@ vec4 fbmd_8( in vec3 x ) {
     mat3  m = mat3(1.0,0.0,0.0,
                    0.0,1.0,0.0,
                    0.0,0.0,1.0);
-    for( int i=0; i<8; i++ )
+    float octaves = octaveCount(footprint, f, 8);
+    for( int i=0; i<int(ceil(octaves)); i++ )
     {
-        vec4 n = noised(x);
-        a += b*n.x;
+        vec4 n = enableNoiseVolume ? noisedVolume(x) : noised(x);
+        float w = octaveWeight(octaves, i);
+        a += w*b*n.x;
         if( i<4 )
-        d += b*m*n.yzw;
+        d += w*b*m*n.yzw;
         b *= s;
         x = f*m3*x;
         m = f*m3i*m;
@@ -667,18 +906,21 @@ vec4 fbmd_8( in vec3 x ) {
 }
 
 // Used in terrainMapD
-vec3 fbmd_9( in vec2 x ) {
+// @param footprint Pixel footprint in the space of x (see octaveCount)
+vec3 fbmd_9( in vec2 x, float footprint ) {
     float f = 1.9;
     float s = 0.55;
     float a = 0.0;
     float b = 0.5;
     vec2  d = vec2(0.0);
     mat2  m = mat2(1.0,0.0,0.0,1.0);
-    for( int i=0; i<9; i++ )
+    float octaves = octaveCount(footprint, f, numOctaves);
+    for( int i=0; i<int(ceil(octaves)); i++ )
     {
         vec3 n = noised(x);
-        a += b*n.x;          // accumulate values
-        d += b*m*n.yz;       // accumulate derivatives
+        float w = octaveWeight(octaves, i);
+        a += w*b*n.x;          // accumulate values
+        d += w*b*m*n.yz;       // accumulate derivatives
         b *= s;
         x = f*m2*x;
         m = f*m2i*m;
@@ -734,10 +976,11 @@ vec2 boxIntersect(vec3 ro, vec3 rd, vec3 rad)  {
 // Define SDF for different shapes here
 // - Based on https://iquilezles.org/articles/distfunctions/
 
-vec2 sdTerrain(vec2 p) {
-    float e = fbm_9( p/2000.0 + vec2(1.0,-2.0) );
+// @param footprint Pixel footprint in world space (0 for full detail)
+vec2 sdTerrain(vec2 p, float footprint) {
+    float e = fbm_9( p/TERRAIN_EXTENT + vec2(1.0,-2.0), footprint/TERRAIN_EXTENT );
     float a = 1.0-smoothstep( 0.12, 0.13, abs(e+0.12) ); // flag high-slope areas (-0.25, 0.0)
-    e = 600.0*e + 600.0;
+    e = TERRAIN_AMPLITUDE*e + TERRAIN_AMPLITUDE;
 
     // cliff
     e += 90.0*smoothstep( 552.0, 594.0, e );
@@ -768,11 +1011,21 @@ float sdMandelBrot(in vec2 p) {
     return sqrt(clamp((150.0/zoom)*d, 0.0, 1.0));
 }
 
+// Iterations after which a fractal's detail is smaller than the footprint
+// @param footprint Pixel footprint in object space (0 for full detail)
+// @param shrink Factor by which the detail shrinks with each iteration
+int lodIterations(float footprint, float shrink, int minIter, int maxIter) {
+    if (footprint <= 0.0) return maxIter;
+    int n = int(ceil(log(1.0 / footprint) / log(shrink))) + FRACTAL_LOD_BIAS;
+    return clamp(n, minIter, maxIter);
+}
+
 // Mandelbulb Set Signed Distance Field
 // Great ref: https://www.youtube.com/watch?v=6IWXkV82oyY&t=1502s
 // @param p Point in object space
 // @param power (typically 8)
-float sdMandelBulb(vec3 pos, out vec4 resColor) {
+// @param footprint Pixel footprint in object space (see lodIterations)
+float sdMandelBulb(vec3 pos, out vec4 resColor, float footprint) {
     vec3 w = pos;
     float m = dot(w,w);
     vec4 trap = vec4(abs(w),m);
@@ -781,8 +1034,14 @@ float sdMandelBulb(vec3 pos, out vec4 resColor) {
     // If julia seed is used
     if (length(juliaSeed) != 0) {
         c = vec3(juliaSeed, 0);
+    } else {
+        // Far from the bounding sphere, its distance is close enough
+        // - for |c|^(power - 1) > 2 the orbit grows from the first step on
+        float bound = length(pos) - pow(2.0, 1.0 / max(power - 1.0, 0.5));
+        if (bound > FRACTAL_BOUND_MARGIN) { resColor = vec4(m, trap.yzw); return bound; }
     }
-    for (int i=0; i < MAX_STEPS_FRACTALS; i++) {
+    int iterations = lodIterations(footprint, power, 4, MAX_STEPS_FRACTALS);
+    for (int i=0; i < iterations; i++) {
         // derivative
         dz = power * pow(m, (power-1.f)/2.f) * dz + 1.0;
         // z = z^8+c
@@ -804,9 +1063,9 @@ float sdMandelBulb(vec3 pos, out vec4 resColor) {
 
 // Sierpinski Signed Distance Field
 // @param p Point in object space
-// @param power (typically 8)
-float sdSierpinski(vec3 p) {
-    const int Iterations = 14;
+// @param footprint Pixel footprint in object space (see lodIterations)
+float sdSierpinski(vec3 p, float footprint) {
+    const int MaxIterations = 14;
     const float Scale = 1.85;
     const float Offset = 2.0;
     vec3 a1 = vec3(1,1,1);
@@ -816,6 +1075,12 @@ float sdSierpinski(vec3 p) {
     vec3 c;
     float dist, d;
 
+    // Far from the sphere around the tetrahedron, its distance is close enough
+    // - the folds and scaling keep the corners at (+-2, +-2, +-2)
+    float bound = length(p) - 2.0 * sqrt(3.0);
+    if (bound > FRACTAL_BOUND_MARGIN) return bound;
+
+    int Iterations = lodIterations(footprint, Scale, 4, MaxIterations);
     for (int n = 0; n < Iterations; n++) {
         if(p.x+p.y<0.) p.xy = -p.yx; // fold 1
         if(p.x+p.z<0.) p.xz = -p.zx; // fold 2
@@ -1045,15 +1310,18 @@ float sdLine(vec3 p, vec3 a, vec3 b, float r) {
 // Menger Sponge Signed Distance Field
 // Great ref: https://www.youtube.com/watch?v=6IWXkV82oyY&t=1502s
 // @param p Point in object space
-// @param power (typically 8)
-float sdMengerSponge(vec3 p, out vec4 res) {
+// @param footprint Pixel footprint in object space (see lodIterations)
+float sdMengerSponge(vec3 p, out vec4 res, float footprint) {
     float d = sdBox(p,vec3(1));
     res = vec4( d, 1.0, 0.0, 0.0 );
+    // The holes only push the distance up, so far from the box it is exact enough
+    if (d > FRACTAL_BOUND_MARGIN) return d;
+    int levels = lodIterations(footprint, 3.0, 1, 4);
     float ani = smoothstep( -0.2, 0.2, -cos(0.5*iTime) );
     float off = 1.5*sin( 0.01*iTime );
     float s = 1.0;
 
-    for(int m=0; m<4; m++) {
+    for(int m=0; m<levels; m++) {
         p = mix( p, ma*(p+off), ani );
         vec3 a = mod( p*s, 2.0 )-1.0;
         s *= 3.0;
@@ -1259,7 +1527,8 @@ float sdCUSTOM(vec3 p, out int customId, out vec4 trap) {
 // Invoke the appropriate SDF function and return the distance
 // @param p Point in object space
 // @param type Type of the object
-float sdMatch(vec3 p, int type, int id, out int customId, out vec4 trapCol)
+// @param footprint Pixel footprint in object space, sets the fractals' detail
+float sdMatch(vec3 p, int type, int id, out int customId, out vec4 trapCol, float footprint)
 {
     if (type == CUBE) {
         return sdBox(p, vec3(0.5));
@@ -1282,11 +1551,11 @@ float sdMatch(vec3 p, int type, int id, out int customId, out vec4 trapCol)
     } else if (type == MANDELBROT) {
         return sdMandelBrot(vec2(p));
     } else if (type == MANDELBULB) {
-        return sdMandelBulb(p, trapCol);
+        return sdMandelBulb(p, trapCol, footprint);
     } else if (type == MENGERSPONGE) {
-        return sdMengerSponge(p, trapCol);
+        return sdMengerSponge(p, trapCol, footprint);
     } else if (type == SIERPINSKI) {
-        return sdSierpinski(p);
+        return sdSierpinski(p, footprint);
     } else if (type == CUSTOM) {
         return sdCUSTOM(p, customId, trapCol);
     }
@@ -1398,12 +1667,37 @@ vec2 uvMapSphere(vec3 p, float repeatU, float repeatV) {
 }
 
 // ================ Raymarch Algorithm ==================
+// Radius of the pixel cone after travelling t along the ray
+// @param t Distance travelled
+float coneRadius(float t) {
+    return PIXEL_CONE_SCALE * pixelFootprint * t;
+}
+
+// Hit threshold after travelling t along the ray
+// - with adaptive epsilon the threshold follows the pixel cone,
+// so far-away pixels stop at pixel precision instead of SURFACE_DIST
+// @param t Distance travelled
+float hitEpsilon(float t) {
+    if (!enableAdaptiveEpsilon) return SURFACE_DIST;
+    return max(SURFACE_DIST, coneRadius(t));
+}
+
+// Pixel footprint at p in the object space of obj
+// - measured from the eye, which is never wider than the footprint along a
+// bounced ray, so secondary rays keep at least the primary detail
+// @returns 0 (full detail) unless fractal LOD is on and obj is a fractal
+float lodFootprint(vec3 p, RayMarchObject obj) {
+    if (!enableFractalLOD || obj.type < MANDELBULB || obj.type > SIERPINSKI) return 0.f;
+    return coneRadius(length(p - eyePosition.xyz)) / obj.scaleFactor;
+}
+
 // Union of all the SDFs in the scene
 // @param p Current raymarching point for which we wish to
 // find the distance
+// @param objMask Bit i is set if object i should be considered
 // @returns SceneMin struct with closest distance and closest
 // object
-SceneMin sdScene(vec3 p) {
+SceneMin sdScene(vec3 p, uint objMask) {
     float minD = 1000000.f;
     int minObj = -1; int minCId;
     int customId;
@@ -1411,12 +1705,14 @@ SceneMin sdScene(vec3 p) {
     vec3 po;
     vec4 trapCol;
     for (int i = 0; i < numObjects; i++) {
+        // Skip culled objects
+        if ((objMask & (1u << uint(i))) == 0u) continue;
         // Get current obj
         RayMarchObject obj = objects[i];
         // Conv to Object space
         po = vec3(obj.invModelMatrix * vec4(p, 1.f));
         // Get the distance to the object
-        currD = sdMatch(po, obj.type, i, customId, trapCol) * obj.scaleFactor;
+        currD = sdMatch(po, obj.type, i, customId, trapCol, lodFootprint(p, obj)) * obj.scaleFactor;
         if (currD < minD) {
             // Update if we found a closer object
             minD = currD; minObj = i; minCId = customId;
@@ -1429,6 +1725,22 @@ SceneMin sdScene(vec3 p) {
     return res;
 }
 
+SceneMin sdScene(vec3 p) {
+    return sdScene(p, ALL_OBJECTS);
+}
+
+// Objects that may be hit by a primary ray of this fragment's tile
+// - binned on the CPU from each object's bounding sphere
+uint tileObjectMask() {
+    if (!enableTileCulling) return ALL_OBJECTS;
+#ifdef COMPUTE_PASS
+    // - culled by the whole workgroup (see cullTile)
+    return computeTileMask;
+#else
+    return texelFetch(tileObjects, ivec2(fragCoord.xy) / TILE_SIZE, 0).r;
+#endif
+}
+
 // Given intersection point, get the normal
 // - https://iquilezles.org/articles/normalsSDF
 // @param p Intersection point
@@ -1443,33 +1755,89 @@ vec3 getNormal(in vec3 p) {
                 );
 }
 
+// Distance to a single object in the scene
+// @param p Point in world space
+// @param objIdx Id of the object
+// @returns distance to that object only
+float sdObject(vec3 p, int objIdx) {
+    int customId;
+    vec4 trapCol;
+    RayMarchObject obj = objects[objIdx];
+    vec3 po = vec3(obj.invModelMatrix * vec4(p, 1.f));
+    return sdMatch(po, obj.type, objIdx, customId, trapCol, lodFootprint(p, obj)) * obj.scaleFactor;
+}
+
+// Given intersection point and the object it lies on, get the normal
+// - Only the intersected object's SDF is differentiated instead of
+// the whole scene (4 sdMatch calls instead of 4 * numObjects)
+// - CUSTOM objects are smooth unions of many parts, so they keep
+// using the full scene gradient
+// @param p Intersection point
+// @param objIdx Id of the intersected object
+// @returns normalized intersection point normal
+vec3 getNormal(in vec3 p, int objIdx) {
+    if (objIdx == -1 || objects[objIdx].type == CUSTOM) return getNormal(p);
+    vec3 e = vec3(1.0,-1.0, 0)*0.5773*0.0005;
+    return normalize(
+                e.xyy*sdObject(p + e.xyy, objIdx) +
+                e.yyx*sdObject(p + e.yyx, objIdx) +
+                e.yxy*sdObject(p + e.yxy, objIdx) +
+                e.xxx*sdObject(p + e.xxx, objIdx)
+                );
+}
+
 // Performs raymarching
+// - with relaxed tracing enabled, steps are stretched by the closest
+// object's relaxation factor (Keinert et al. 2014, enhanced sphere tracing)
 // @param ro Ray origin
 // @param rd Ray direction
+// @param start Distance along the ray known to be empty
 // @param end Far plane
 // @param side Determines if we are inside or outside the object
 // - used in refraction
+// @param objMask Objects that the ray may hit
 // @returns structs that contains the result of raymarching
-RayMarchRes raymarch(vec3 ro, vec3 rd, float end, float side) {
+RayMarchRes raymarch(vec3 ro, vec3 rd, float start, float end, float side, uint objMask) {
   // Start from eye pos
-  float rayDepth = 0.0;
+  float rayDepth = start;
   SceneMin closest;
   closest.minD = 1000000;
+  bool hit = false;
+  // Relaxation state
+  // - relaxation used for the last step, and whether we may still relax
+  float omega = 1.f; bool relaxed = enableRelaxedTracing;
+  // - where the last step started, its unrelaxed length and the actual one
+  float prevDepth = start, prevStep = 0.f, stepLength = 0.f;
+  LAST_MARCH_STEPS = 0;
   // Start the march
   for(int i = 0; i < MAX_STEPS; i++) {
+    LAST_MARCH_STEPS++;
     // Get the point
     vec3 p = ro + rd * rayDepth;
     // Find the closest object in the scene
-    closest = sdScene(p);
-    if (abs(closest.minD) < SURFACE_DIST || rayDepth > end) {
+    closest = sdScene(p, objMask);
+    if (omega > 1.f && abs(closest.minD) + abs(prevStep) < stepLength) {
+        // Overshoot: the unbounding spheres of the last two points do not
+        // overlap, so a surface may lie in between. Go back to where plain
+        // sphere tracing would have stepped and stop relaxing this ray.
+        rayDepth = prevDepth + prevStep;
+        omega = 1.f; relaxed = false;
+        continue;
+    }
+    hit = abs(closest.minD) < hitEpsilon(rayDepth);
+    if (hit || rayDepth > end) {
         // If hit or exceed the far plane, break
         break;
     }
     // March the ray
-    rayDepth += closest.minD * side;
+    omega = relaxed && closest.minObjIdx != -1 ? objects[closest.minObjIdx].relaxation : 1.f;
+    prevDepth = rayDepth; prevStep = closest.minD * side;
+    stepLength = prevStep * omega;
+    rayDepth += stepLength;
   }
+  TOTAL_STEPS += LAST_MARCH_STEPS;
   RayMarchRes res;
-  if (abs(closest.minD) < SURFACE_DIST) {
+  if (hit) {
       // HIT
       res.intersectObj = closest.minObjIdx;
       // Bruh don't ask me why we need this.
@@ -1483,6 +1851,94 @@ RayMarchRes raymarch(vec3 ro, vec3 rd, float end, float side) {
   return res;
 }
 
+RayMarchRes raymarch(vec3 ro, vec3 rd, float end, float side) {
+  return raymarch(ro, rd, 0.f, end, side, ALL_OBJECTS);
+}
+
+// ============ Depth Prepass ============
+// Ray direction through the center of this fragment's prepass tile
+// - the prepass runs at 1 / PREPASS_SCALE resolution, so fragment (x, y)
+// covers full resolution pixels [x, x + 1) * PREPASS_SCALE
+vec3 tileRayDir() {
+    vec2 px = (floor(fragCoord.xy) + 0.5) * float(PREPASS_SCALE);
+    vec2 ndc = px / screenDimensions * 2.f - 1.f;
+    vec4 n = invProjViewMatrix * vec4(ndc, -1.f, 1.f);
+    vec4 f = invProjViewMatrix * vec4(ndc, 1.f, 1.f);
+    return normalize(f.xyz / f.w - n.xyz / n.w);
+}
+
+// Cone marches the tile and returns a distance from the eye that every
+// ray through the tile can skip
+// - the cone (slope = radius per unit distance) contains the whole tile
+// - a cone point at t' is within (t' - t) + slope * t' of the sample at t,
+// so the cone stays empty up to t' = (d + t) / (1 + slope)
+// @param rd Direction of the tile's center ray
+// @param end Far plane
+float coneMarch(vec3 rd, float end) {
+    vec3 eye = eyePosition.xyz;
+    float slope = 0.75 * float(PREPASS_SCALE) * pixelFootprint;
+    float t = 0.f;
+    for (int i = 0; i < MAX_STEPS; i++) {
+        float d = sdScene(eye + rd * t).minD;
+        float r = slope * t;
+        // Stop once the cone (almost) touches a surface
+        if (d - r < max(SURFACE_DIST, r) || t > end) break;
+        t += (d - r) / (1.f + slope);
+    }
+    return min(t, end);
+}
+
+// Distance along the primary ray that the prepass proved empty
+// @param ro Primary ray origin (on the near plane)
+float primaryStart(vec3 ro) {
+    if (!enableDepthPrepass) return 0.f;
+    float t = texelFetch(prepassDepth, ivec2(fragCoord.xy) / PREPASS_SCALE, 0).r;
+    return max(0.f, t - length(ro - eyePosition.xyz));
+}
+
+// ============ Temporal Reprojection ============
+// Point that the previous frame's ray through uv hit
+// @param uv Screen position in the previous frame
+// @param t Distance of the hit from the previous eye
+vec3 prevHitPoint(vec2 uv, float t) {
+    vec2 ndc = uv * 2.f - 1.f;
+    vec4 n = prevInvProjViewMatrix * vec4(ndc, -1.f, 1.f);
+    vec4 f = prevInvProjViewMatrix * vec4(ndc, 1.f, 1.f);
+    return prevEyePosition.xyz + normalize(f.xyz / f.w - n.xyz / n.w) * t;
+}
+
+// Predicts the primary hit from the previous frame's hit distances
+// - the first guess is last frame's hit at the same pixel, the second one
+// is last frame's hit at the pixel where the first guess was visible
+// - the prediction is only used if [minT, start] is provably empty, i.e.
+// the ball around the segment's midpoint reaches both of its ends
+// @param ro Primary ray origin (on the near plane)
+// @param rd Primary ray direction
+// @param minT Distance along the ray already known to be empty
+// @returns distance along the ray to start from
+float temporalStart(vec3 ro, vec3 rd, float minT) {
+    if (!enableTemporalReprojection || !historyValid) return minT;
+    vec2 uv = fragCoord.xy / screenDimensions;
+    float t = 0.f;
+    for (int i = 0; i < 2; i++) {
+        if (any(lessThan(uv, vec2(0.f))) || any(greaterThanEqual(uv, vec2(1.f)))) return minT;
+        float h = texelFetch(hitHistory, ivec2(uv * screenDimensions), 0).r;
+        // Previous ray did not hit anything
+        if (h < 0.f) return minT;
+        t = dot(prevHitPoint(uv, h) - ro, rd);
+        // Where the predicted hit was on screen in the previous frame
+        vec4 clip = prevProjViewMatrix * vec4(ro + rd * t, 1.f);
+        if (clip.w <= 0.f) return minT;
+        uv = clip.xy / clip.w * 0.5 + 0.5;
+    }
+    float start = t * (1.f - TEMPORAL_MARGIN);
+    if (start <= minT) return minT;
+    // Validation
+    float r = 0.5 * (start - minT);
+    if (sdScene(ro + rd * (minT + r)).minD < r) return minT;
+    return start;
+}
+
 // ====== MIST ======
 float fogDensity(vec3 p) {
     const vec3 fdir = normalize(vec3(10,0,-7));
@@ -1524,42 +1980,24 @@ vec3 fog( in vec3 col, float t )
 
 // =============== SUN & SKY & MOON =================
 
-// [0, 1]
-//float timeOfDay = mod(iTime, 24.) / 24.0;
-float timeOfDay = 0.1;
-float sunriseStart = 0.2;
-float sunsetStart = 0.8;
+// The time of day lives on the CPU, which also computes the sun and sky colors
 
 // Get current sun direction
 vec3 getSunDir() {
-    float elevationAngle = mix(0, 3.14, timeOfDay);
-    return normalize(vec3(cos(elevationAngle), sin(elevationAngle), -0.577));
+    return sunDirection;
 }
 
 // Get current sky color
 vec3 getSkyColor() {
-    vec3 dayColor = vec3(0.8, 0.9, 1.1);
-    vec3 sunriseColor = vec3(1.0, 0.5, 0.2);
-    vec3 sunsetColor = vec3(1.0, 0.8, 0.5);
-
-    vec3 blendedColor = mix(sunriseColor, dayColor, smoothstep(0.0, sunriseStart, timeOfDay));
-    blendedColor = mix(blendedColor, sunsetColor, smoothstep(sunsetStart, 1.0, timeOfDay));
-
-    return blendedColor;
+    return skyColor;
 }
 
 // Get current sun color
 vec3 getSunColor() {
-    vec3 sunriseColor = vec3(1.0, 0.5, 0.2);
-    vec3 daytimeColor = vec3(1.f, 1.f, 0.8f);
-    vec3 sunsetColor = vec3(1.0, 0.8, 0.5);
-
-    vec3 sunColor = mix(sunriseColor, daytimeColor, smoothstep(0.0, sunriseStart, timeOfDay));
-    sunColor = mix(sunColor, sunsetColor, smoothstep(sunsetStart, 1.f, timeOfDay));
     return sunColor;
 }
 
-vec3 getMoonColor(vec3 rd) {
+vec3 computeMoonColor(vec3 rd) {
     vec3 col = vec3(0.f);
     float ms = noiseV(rd*20.0);
     vec3 mCol = vec3(0.5, 0.5, 0.3) - 0.1*ms*ms*ms;
@@ -1572,8 +2010,7 @@ vec3 getMoonColor(vec3 rd) {
     return col;
 }
 
-// Get the background color
-vec3 getSky(vec3 rd) {
+vec3 computeSky(vec3 rd) {
     vec3 col  = getSkyColor()*(0.6+0.4*rd.y);
     col += getSunColor() *
             pow(clamp(
@@ -1583,6 +2020,33 @@ vec3 getSky(vec3 rd) {
     return col;
 }
 
+// Get the night sky color
+vec3 getMoonColor(vec3 rd) {
+    if (enableSkyCubemap) return texture(nightSky, rd).rgb;
+    return computeMoonColor(rd);
+}
+
+// Get the background color
+vec3 getSky(vec3 rd) {
+    if (enableSkyCubemap) return texture(daySky, rd).rgb;
+    return computeSky(rd);
+}
+
+// Sky color of the current texel of the sky cubemap face being baked
+// - directions follow the GL cube map face layout, with t growing along rows
+vec3 bakeSky() {
+    vec2 st = fragCoord.xy / SKY_SIZE * 2.0 - 1.0;
+    vec3 dir;
+    if (skyFace == 0) dir = vec3(1.0, -st.y, -st.x);
+    else if (skyFace == 1) dir = vec3(-1.0, -st.y, st.x);
+    else if (skyFace == 2) dir = vec3(st.x, 1.0, st.y);
+    else if (skyFace == 3) dir = vec3(st.x, -1.0, -st.y);
+    else if (skyFace == 4) dir = vec3(st.x, -st.y, 1.0);
+    else dir = vec3(-st.x, -st.y, -1.0);
+    dir = normalize(dir);
+    return skyLayer == 0 ? computeSky(dir) : computeMoonColor(dir);
+}
+
 // ============= Perlin Noise Functions =============
 vec3 fade(vec3 t) {
     return t * t * t * (t * (t * 6 - 15) + 10);
@@ -1677,13 +2141,18 @@ float pnoise(vec3 p) {
 
 // ============= Bump Mapping with Noise =============
 vec3 bumpNormal(vec3 normal, vec3 pos, float scale, float intensity) {
-    float noiseValue = pnoise(pos * scale);
-
-    vec3 gradient = vec3(
-        pnoise(pos * scale + vec3(0.1, 0.0, 0.0)) - noiseValue,
-        pnoise(pos * scale + vec3(0.0, 0.1, 0.0)) - noiseValue,
-        pnoise(pos * scale + vec3(0.0, 0.0, 0.1)) - noiseValue
-    );
+    vec3 gradient;
+    if (enableNoiseVolume) {
+        // Differences over 0.1 from the stored derivatives (1 fetch instead of 4 pnoise)
+        gradient = 0.1 * noisedVolume(pos * scale).yzw;
+    } else {
+        float noiseValue = pnoise(pos * scale);
+        gradient = vec3(
+            pnoise(pos * scale + vec3(0.1, 0.0, 0.0)) - noiseValue,
+            pnoise(pos * scale + vec3(0.0, 0.1, 0.0)) - noiseValue,
+            pnoise(pos * scale + vec3(0.0, 0.0, 0.1)) - noiseValue
+        );
+    }
 
     vec3 bumpedNormal = normalize(normal + gradient * intensity);
 
@@ -1692,6 +2161,14 @@ vec3 bumpNormal(vec3 normal, vec3 pos, float scale, float intensity) {
 
 // ================== Phong Total Illumination =================
 
+// Origin of a shadow ray leaving the surface at p
+// - shadow rays inherit the eye cone, so they have to start outside of the
+// hit threshold of their first step, or far surfaces shadow themselves
+// @param coneT Distance the eye ray travelled to p
+vec3 shadowOrigin(vec3 p, vec3 N, float coneT) {
+    return p + N * max(SURFACE_DIST * 5.f, 2.f * hitEpsilon(coneT));
+}
+
 // Computes the shadow scale for soft shadow
 // - https://iquilezles.org/articles/rmshadows/
 // @param ro Ray origin
@@ -1699,20 +2176,32 @@ vec3 bumpNormal(vec3 normal, vec3 pos, float scale, float intensity) {
 // @param mint Starting t
 // @param maxt End t
 // @param k How "hard" we want the shadow to be
+// @param coneT Distance the camera ray travelled to reach ro
+// - the shadow ray inherits the pixel cone of the point it shades
+// @param casterMask Objects that may block the light
+// @param minRes Penumbra factor below which the light counts as blocked
+// (< 0 to march until hit or maxt)
 // @retunrs Result of raymarching
-RayMarchRes softshadow(vec3 ro, vec3 rd, float mint, float maxt, float k ) {
+// - d is the penumbra factor when nothing was hit
+RayMarchRes softshadow(vec3 ro, vec3 rd, float mint, float maxt, float k, float coneT,
+                       uint casterMask, float minRes) {
     float res = 1.0;
     float rayDepth = mint;
+    bool hit = false;
     RayMarchRes r;
     SceneMin closest;
     for(int i=0; i < MAX_STEPS; i++) {
-        closest = sdScene(ro + rd*rayDepth);
-        if(abs(closest.minD) < SURFACE_DIST || rayDepth > maxt) break;
+        TOTAL_STEPS++;
+        closest = sdScene(ro + rd*rayDepth, casterMask);
+        hit = abs(closest.minD) < hitEpsilon(coneT + rayDepth);
+        if(hit || rayDepth > maxt) break;
         res = min(res, k * closest.minD/(rayDepth));
+        // Penumbra saturated, the rest of the ray cannot brighten it
+        if (res < minRes) { hit = true; break; }
         // March the ray
         rayDepth += abs(closest.minD);
     }
-    if (abs(closest.minD) < SURFACE_DIST) {
+    if (hit) {
         // HIT
         r.intersectObj = closest.minObjIdx;
         r.d = res;
@@ -1720,6 +2209,7 @@ RayMarchRes softshadow(vec3 ro, vec3 rd, float mint, float maxt, float k ) {
     } else {
         // NO HIT
         r.intersectObj = -1;
+        r.d = res;
     }
     return r;
 }
@@ -1833,6 +2323,48 @@ void setCustomMat(int customId, out vec3 a, out vec3 d, out vec3 s,
     //    }
 }
 
+// Fraction of an area light that is visible from p
+// - shadow rays go towards points picked by the blue noise texture, which
+//   move every frame along the R2 sequence
+float areaLightVisibility(int lightIdx, vec3 p, vec3 N, float coneT) {
+    LightSource li = lights[lightIdx];
+    vec2 bn = texelFetch(bluenoise, ivec2(fragCoord.xy) & 1023, 0).rg;
+    float vis = 0.f;
+    for (int idx = 0; idx < areaLightSamples; idx++) {
+        vec2 uv = fract(bn + AREA_SAMPLE_STEP * float((frameIndex % 1024) * areaLightSamples + idx));
+        vec3 randomP = samplePointOnRectangleAreaLight(li.points[0], li.points[1], li.points[2], li.points[3], uv);
+        vec3 L = normalize(randomP - p);
+        if (dot(N, L) <= 0.005f) continue;
+        // Check for shadow
+        RayMarchRes res = softshadow(shadowOrigin(p, N, coneT), L, 0, length(randomP - p), 8, coneT,
+                                     li.casterMask, -1.f);
+        // Shadow rays that reach the light itself are not blocked
+        if (res.intersectObj != -1 && objects[res.intersectObj].lightIdx != lightIdx) continue;
+        vis += 1.f;
+    }
+    return vis / float(areaLightSamples);
+}
+
+// Blends the visibility of the primary hit with the previous frame's
+// - the history is found by reprojecting p and rejected if it saw a surface
+//   at another depth
+// @param slot Index of the light among the area lights
+float accumulateAreaVisibility(float vis, int slot, vec3 p) {
+    AREA_VISIBILITY.a = length(p - eyePosition.xyz);
+    AREA_VISIBILITY[slot] = vis;
+    if (!enableAreaShadowReuse || !areaHistoryValid) return vis;
+    vec4 clip = prevProjViewMatrix * vec4(p, 1.f);
+    if (clip.w <= 0.f) return vis;
+    vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+    if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0)))) return vis;
+    vec4 hist = texture(areaHistory, uv);
+    float prevD = length(p - prevEyePosition.xyz);
+    if (hist.a < 0.f || abs(hist.a - prevD) > AREA_DEPTH_TOLERANCE * prevD) return vis;
+    vis = mix(hist[slot], vis, AREA_BLEND);
+    AREA_VISIBILITY[slot] = vis;
+    return vis;
+}
+
 // Gets Phong Light
 // @param N normal
 // @param intersectObj Id of the intersected object
@@ -1856,14 +2388,21 @@ vec3 getPhong(vec3 N, int intersectObj, vec3 p, vec3 ro, vec3 rd, float far, boo
     if (custom && intersectObj == 0) {
         cAmbient = getDiffuse(p, N, type, cDiffuse, texLoc, invModel, rU, rV, blend);
     }
-    if (enableAmbientOcculusion) ao = calcAO(p, N);
-    total += cAmbient * ka * ao;
+    if (enableAmbientOcculusion && !enableScreenSpaceAO) ao = calcAO(p, N);
+    AMBIENT_TERM = cAmbient * ka;
+    total += AMBIENT_TERM * ao;
 
     // Loop Lights
+    // - shadow rays stop early only when soft shadows scale the light anyway
+    float minRes = enableShadowCulling && enableSoftShadow ? SHADOW_MIN_VISIBILITY : -1.f;
+    int areaSlot = 0;
     for (int i = 0; i < numLights; i++) {
         float fAtt = 1.f; float aFall = 1.f; LightSource li = lights[i];
         float d = length(p - li.lightPos);
-        vec3 currColor = vec3(0.f); vec3 L; float maxT;
+        // Out of the light's range, its casters were culled against it
+        if (enableShadowCulling && li.range >= 0.f && d > li.range &&
+            (li.type == POINT || li.type == SPOT)) continue;
+        vec3 currColor = vec3(0.f); vec3 L; float maxT; float coneT = length(p - ro);
         if (li.type == POINT) {
             L = normalize(li.lightPos - p);
             fAtt = attenuationFactor(d, li.lightFunc);
@@ -1877,39 +2416,31 @@ vec3 getPhong(vec3 N, int intersectObj, vec3 p, vec3 ro, vec3 rd, float far, boo
             fAtt = attenuationFactor(d, li.lightFunc);
             maxT = length(li.lightPos - p);
             aFall = angularFalloff(L, i);
+            // Outside of the cone
+            if (aFall <= 0.f) continue;
         }
 
         vec3 V = normalize(-rd);
         // Area Light Calculation
         if (li.type == AREA) {
-            vec3 areaColor = vec3(0.f);
-            vec3 p1 = li.points[0], p2 = li.points[1], p3 = li.points[2], p4 = li.points[3];
-            for (int idx = 0; idx < AREA_LIGHT_SAMPLES; idx++) {
-                // Sample a point and cast a shadow ray towards it
-                vec3 randomP = samplePointOnRectangleAreaLight(p1,p2,p3,p4,vec2(rd + idx));
-                L = normalize(randomP - p);
-                float NdotL = dot(N, L);
-                if (NdotL <= 0.005f) continue;
-                maxT = length(randomP - p);
-                // Check for shadow
-                RayMarchRes res = softshadow(p + N * SURFACE_DIST * 5.f, L, 0, maxT, 8);
-                if (res.intersectObj != -1) {
-                    // Shadow Ray intersected an object
-                    // We need to check if the intersected object
-                    // is indeed area light or not
-                    if (objects[res.intersectObj].lightIdx != i) continue;
-                }
-                // calculate light contribution
-                areaColor += getAreaLight(N, V, p, i, cDiffuse, cSpecular, type, texLoc, invModel, rU, rV, blend);
+            float vis = areaLightVisibility(i, p, N, coneT);
+            if (PRIMARY_SHADING && areaSlot < AREA_HISTORY_LIGHTS) {
+                vis = accumulateAreaVisibility(vis, areaSlot, p);
+            }
+            areaSlot++;
+            // The LTC integral covers the whole light, so it is evaluated
+            // once and scaled by the visible fraction
+            if (vis > 0.f) {
+                currColor += vis * getAreaLight(N, V, p, i, cDiffuse, cSpecular, type, texLoc, invModel, rU, rV, blend);
             }
-            currColor += areaColor / AREA_LIGHT_SAMPLES;
         } else {
+            float NdotL = dot(N, L);
+            if (NdotL <= 0.005f) continue; // pointing away
             // Shadow
-            RayMarchRes res = softshadow(p + N * SURFACE_DIST * 5.f, L, 0, maxT, 8);
+            RayMarchRes res = softshadow(shadowOrigin(p, N, coneT), L, 0, maxT, 8, coneT,
+                                         li.casterMask, minRes);
             if (res.intersectObj != -1) continue; // shadow ray intersect
             // Diffuse
-            float NdotL = dot(N, L);
-            if (NdotL <= 0.005f) continue; // pointing away
             NdotL = clamp(NdotL, 0.f, 1.f);
             currColor +=  getDiffuse(p, N, type, cDiffuse, texLoc, invModel, rU, rV, blend)
                     * NdotL
@@ -1947,22 +2478,24 @@ void setBrightness(vec3 color) {
 
 // ============== CLOUDS ================
 
-vec4 cloudsFbm( in vec3 pos ) {
-    return fbmd_8(pos*0.0015+vec3(2.0,1.1,1.0)+0.07*vec3(iTime,0.5*iTime,-0.15*iTime));
+// @param footprint Pixel footprint in world space (0 for full detail)
+vec4 cloudsFbm( in vec3 pos, float footprint ) {
+    return fbmd_8(pos*0.0015+vec3(2.0,1.1,1.0)+0.07*vec3(iTime,0.5*iTime,-0.15*iTime),
+                  footprint*0.0015);
 }
 
-float cloudsShadowFlat( in vec3 ro, in vec3 rd ) {
+float cloudsShadowFlat( in vec3 ro, in vec3 rd, float footprint ) {
     float t = (CLOUD_MID-ro.y)/rd.y;
     if( t<0.0 ) return 1.0;
     vec3 pos = ro + rd*t;
-    return cloudsFbm(pos).x;
+    return cloudsFbm(pos, footprint).x;
 }
 
-vec4 cloudsMap( in vec3 pos, out float nnd ) {
+vec4 cloudsMap( in vec3 pos, out float nnd, float footprint ) {
     float d = abs(pos.y-CLOUD_MID)-4.f;
     vec3 gra = vec3(0.0,sign(pos.y-CLOUD_MID),0.0);
 
-    vec4 n = cloudsFbm(pos);
+    vec4 n = cloudsFbm(pos, footprint);
     d += 400.0*n.x * (0.7+0.3*gra.y);
 
     if( d>0.0 ) return vec4(-d,0.0,0.0,0.0);
@@ -1974,7 +2507,7 @@ vec4 cloudsMap( in vec3 pos, out float nnd ) {
 }
 
 bool cloudMarch(int steps, in vec3 ro, in vec3 rd, in float minT, in float maxT,
-                inout vec4 sum) {
+                inout vec4 sum, out float firstT) {
     bool hasHit = false;
     float stepSize = CLOUD_STEP_SIZE;
     float opaqueVisibility = 1.f;
@@ -1985,13 +2518,15 @@ bool cloudMarch(int steps, in vec3 ro, in vec3 rd, in float minT, in float maxT,
     for (int i = 0; i < steps; i++) {
         vec3 pos = ro + rd * t;
         float nnd;
-        vec4 denGra = cloudsMap(pos, nnd);
+        // - the cloud buffer's texels cover CLOUD_SCALE pixels along each axis
+        float footprint = coneRadius(t) * (renderPass == PASS_CLOUD ? float(CLOUD_SCALE) : 1.0);
+        vec4 denGra = cloudsMap(pos, nnd, footprint);
         float den = denGra.x;
         float dt = max(CLOUD_STEP_SIZE, 0.011 * t);
         if (den > 0.001) {
             hasHit = true;
             float kk;
-            cloudsMap( pos+getSunDir()*70.0, kk );
+            cloudsMap( pos+getSunDir()*70.0, kk, footprint );
             float sha = 1.0-smoothstep(-200.0,200.0,kk); sha *= 1.5;
 
             vec3 nor = normalize(denGra.yzw);
@@ -2022,6 +2557,7 @@ bool cloudMarch(int steps, in vec3 ro, in vec3 rd, in float minT, in float maxT,
     }
     sum.xyz += max(0.0, 1.0 - 0.0125 * thickness) * sunColor
             * 0.3 * pow(clamp(dot(getSunDir(), rd), 0.0, 1.0), 32.0);
+    firstT = lastT;
     return hasHit;
 }
 
@@ -2029,34 +2565,176 @@ bool cloudMarch(int steps, in vec3 ro, in vec3 rd, in float minT, in float maxT,
 // To prevent banding from happening, offset the ray start position using
 // blue noise texture (aka blue noise dithering)
 vec4 raymarchVolumetric(vec3 ro, vec3 rd, inout bool hit,
-                        in float minT, in float maxT) {
+                        in float minT, in float maxT, out float firstT) {
     vec4 sum = vec4(0.0);
     // get noise
-    float blueNoise = texture(bluenoise, gl_FragCoord.xy / 1024.0).r;
-    float off = float(FRAME%64) + 0.61803398875f;
+    float blueNoise = texture(bluenoise, fragCoord.xy / 1024.0).r;
+    // - the cloud buffer moves the offsets every frame and averages them
+    float off = renderPass == PASS_CLOUD ? float(frameIndex%64) * 0.61803398875f
+                                         : float(FRAME%64) + 0.61803398875f;
     // different starting points
     minT += CLOUD_STEP_SIZE * fract(off + blueNoise);
     // march towards clouds
-    hit = cloudMarch(128, ro, rd, minT, maxT, sum);
+    hit = cloudMarch(128, ro, rd, minT, maxT, sum, firstT);
     return clamp( sum, 0.0, 1.0 );
 }
 
-// Function that renders volumetric cloud
-vec3 cloudRender( in vec3 ro, in vec3 rd, in vec3 bgCol, out bool hit, in float maxT ) {
-    vec3 col = bgCol; float minT = 0;
+// Clouds along a ray, as premultiplied color and opacity
+// @param firstT Set to the distance of the first cloud sample
+vec4 cloudLayer( in vec3 ro, in vec3 rd, in float maxT, out bool hit, out float firstT ) {
+    float minT = 0; firstT = -1.0;
     // Raymarch volumetric cloud
     // Bounding Volume
     float tl = ( CLOUD_LOW-ro.y)/rd.y;
     float th = ( CLOUD_HIGH-ro.y)/rd.y;
-    if( tl>0.0 ) { minT = max( minT, tl ); } else { hit = false; return col; }
+    if( tl>0.0 ) { minT = max( minT, tl ); } else { hit = false; return vec4(0.0); }
     if( th>0.0 ) maxT = min( maxT, th );
-    vec4 res = raymarchVolumetric(ro, rd, hit, minT, maxT);
+    return raymarchVolumetric(ro, rd, hit, minT, maxT, firstT);
+}
+
+// Function that renders volumetric cloud
+vec3 cloudRender( in vec3 ro, in vec3 rd, in vec3 bgCol, out bool hit, in float maxT ) {
+    float firstT;
+    vec4 res = cloudLayer(ro, rd, maxT, hit, firstT);
     // Blend with background color
-    col = col*(1.0-res.w) + res.xyz;
-    return col;
+    return bgCol*(1.0-res.w) + res.xyz;
+}
+
+// Clouds of one cloud buffer texel, accumulated over frames
+// - the distance to the clouds goes to hitDepth (-1 if there are none)
+vec4 cloudBuffer( in vec3 ro, in vec3 rd, in float maxT ) {
+    bool hit; float firstT;
+    vec4 res = cloudLayer(ro, rd, maxT, hit, firstT);
+    hitDepth = hit ? firstT : -1.0;
+    if (!cloudHistoryValid) return res;
+    // Where the clouds were in the last frame
+    vec4 clip = prevProjViewMatrix * vec4(ro + rd * (hit ? firstT : maxT), 1.0);
+    if (clip.w <= 0.0) return res;
+    vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+    if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0)))) return res;
+    return mix(texture(clouds, uv), res, CLOUD_BLEND);
+}
+
+// Clouds of this pixel, upsampled from the cloud buffer
+// - bilinear over the four closest texels, where texels whose clouds start
+//   behind the surface at depth count as clear
+vec3 cloudsFromBuffer( in float depth, in vec3 bgCol, out bool hit ) {
+    vec2 pos = fragCoord.xy / float(CLOUD_SCALE) - 0.5;
+    ivec2 base = ivec2(floor(pos));
+    vec2 f = pos - vec2(base);
+    ivec2 last = textureSize(clouds, 0) - 1;
+    vec4 res = vec4(0.0);
+    for (int i = 0; i < 4; i++) {
+        ivec2 o = ivec2(i & 1, i >> 1);
+        ivec2 c = clamp(base + o, ivec2(0), last);
+        float t = texelFetch(cloudDepth, c, 0).r;
+        if (t < 0.0 || t > depth) continue;
+        vec2 w = mix(1.0 - f, f, vec2(o));
+        res += w.x * w.y * texelFetch(clouds, c, 0);
+    }
+    hit = res.a > 0.0;
+    return bgCol*(1.0-res.a) + res.xyz;
 }
 
 // ================== Terrain ====================
+// Terrain height of the current texel of the bake pass
+// - sample (i, j) sits at terrainBakeOrigin + (i, j) * terrainBakeSpacing,
+// which is the center of texel (i, j)
+float bakeTerrainHeight() {
+    return sdTerrain(terrainBakeOrigin + (fragCoord.xy - 0.5) * terrainBakeSpacing, 0.0).x;
+}
+
+// Position of xz in baked samples
+// @returns false if the bake is off or xz lies outside of it
+bool terrainBakeCoord(vec2 xz, out vec2 g) {
+    g = (xz - terrainBakeOrigin) / terrainBakeSpacing;
+    vec2 last = vec2(textureSize(terrainHeights, 0) - 1);
+    return enableTerrainBake && all(greaterThanEqual(g, vec2(0.0))) && all(lessThanEqual(g, last));
+}
+
+// Terrain height at xz, interpolated from the bake when possible
+// @param footprint Pixel footprint in world space, used when not baked
+float terrainHeightAt(vec2 xz, float footprint) {
+    vec2 g;
+    if (!terrainBakeCoord(xz, g)) return sdTerrain(xz, footprint).x;
+    return textureLod(terrainHeights, (g + 0.5) / vec2(textureSize(terrainHeights, 0)), 0.0).r;
+}
+
+// How far sdTerrain can rise above the largest baked sample of a cell
+// - every point of a cell lies within terrainBakeSpacing / sqrt(2) of one of
+// the samples its max covers, over which octave i of fbm_9 (amplitude
+// 0.5 * 0.55^i, frequency 1.9^i) changes by at most min(2, its gradient bound
+// times that distance)
+// - the bake keeps every octave, while the march fades out the ones below
+// the pixel footprint (see octaveCount), which moves them by up to their
+// amplitude
+// @param footprint Largest pixel footprint of the ray over the cell
+float terrainBakeMargin(float footprint) {
+    float octaves = octaveCount(footprint / TERRAIN_EXTENT, 1.9, numOctaves);
+    float g = NOISE_LIPSCHITZ * terrainBakeSpacing * 0.7071 / TERRAIN_EXTENT;
+    float b = 0.5;
+    float rise = 0.0;
+    for (int i = 0; i < numOctaves; i++) {
+        float change = min(2.0, g);
+        if (octaveWeight(octaves, i) < 1.0) change = max(change, 1.0);
+        rise += b * change;
+        b *= 0.55;
+        g *= 1.9;
+    }
+    return rise * TERRAIN_AMPLITUDE * TERRAIN_CLIFF_SLOPE;
+}
+
+// Skips the baked cells that the ray passes above
+// - level k >= 1 of terrainHeights holds the max height of samples
+// [m, m + 1] * 2^k, so the ray can step over a whole cell whenever it stays
+// above that bound; it climbs a level after each skip and descends otherwise
+// @param t Where to start
+// @param cellEnd Set to where the caller should skip again: the end of the
+// finest cell that the ray may hit, the entry into the bake, or tmax once the
+// ray has left it
+// @returns the first t at which the ray may touch the terrain
+float terrainSkip(vec3 ro, vec3 rd, float t, float tmax, out float cellEnd) {
+    cellEnd = tmax;
+    // Ray in sample units
+    vec2 o = (ro.xz - terrainBakeOrigin) / terrainBakeSpacing;
+    vec2 d = rd.xz / terrainBakeSpacing;
+    d = vec2(abs(d.x) < 1e-8 ? 1e-8 : d.x, abs(d.y) < 1e-8 ? 1e-8 : d.y);
+    vec2 invD = 1.0 / d;
+    // Part of the ray over the bake
+    vec2 t0 = -o * invD;
+    vec2 t1 = (vec2(textureSize(terrainHeights, 0) - 1) - o) * invD;
+    float tIn = max(min(t0.x, t1.x), min(t0.y, t1.y));
+    float tOut = min(min(max(t0.x, t1.x), max(t0.y, t1.y)), tmax);
+    if (tIn >= tOut || tOut <= t) return t;
+    if (tIn > t) { cellEnd = tIn; return t; }
+
+    int level = terrainBakeLevels - 1;
+    for (int i = 0; i < 128; i++) {
+        TOTAL_STEPS++;
+        float size = float(1 << level);
+        vec2 cell = floor((o + d * t) / size);
+        // Where the ray leaves the cell
+        vec2 tEdge = ((cell + step(0.0, d)) * size - o) * invD;
+        float tCell = min(min(tEdge.x, tEdge.y), tOut);
+        float top = texelFetch(terrainHeights, ivec2(cell), level).r + terrainBakeMargin(coneRadius(tCell));
+        if (min(ro.y + rd.y * t, ro.y + rd.y * tCell) > top) {
+            // Above the whole cell
+            t = tCell * 1.0001 + 1e-3;
+            if (t >= tOut) return t;
+            level = min(level + 1, terrainBakeLevels - 1);
+        } else if (level == 1) {
+            // May hit, the caller marches the exact terrain through this cell
+            cellEnd = tCell;
+            return t;
+        } else {
+            level--;
+        }
+    }
+    // Out of iterations, march a step and come back
+    cellEnd = t;
+    return t;
+}
+
 float raymarchTerrain( in vec3 ro, in vec3 rd, float tmin, float tmax ) {
     // bounding plane
     float tp = (TERRAIN_HIGH-ro.y)/rd.y;
@@ -2069,11 +2747,21 @@ float raymarchTerrain( in vec3 ro, in vec3 rd, float tmin, float tmax ) {
     float ot = t;
     float odis = 0.0;
     float odis2 = 0.0;
+    // End of the baked cell being marched, skip ahead once past it
+    float cellEnd = enableTerrainBake ? t - 1.0 : tmax;
     for( int i=0; i<400; i++ )
     {
-        th = 0.001*t;
+        if (t > cellEnd) {
+            t = terrainSkip(ro, rd, t, tmax, cellEnd);
+            if( t>tmax ) break;
+            // The previous step is from before the skip
+            ot = t;
+            odis = 0.0;
+        }
+        TOTAL_STEPS++;
+        th = enableAdaptiveEpsilon ? coneRadius(t) : 0.001*t;
         vec3  pos = ro + t*rd;
-        vec2  env = sdTerrain( pos.xz );
+        vec2  env = sdTerrain( pos.xz, coneRadius(t) );
         float hei = env.x;
         // terrain
         dis = pos.y - hei;
@@ -2089,34 +2777,43 @@ float raymarchTerrain( in vec3 ro, in vec3 rd, float tmin, float tmax ) {
     return t;
 }
 
-vec4 terrainMapD( in vec2 p ) {
-    vec3 e = fbmd_9( p/2000.0 + vec2(1.0,-2.0) );
-    e.x  = 600.0*e.x + 600.0;
-    e.yz = 600.0*e.yz;
+vec4 terrainMapD( in vec2 p, float footprint ) {
+    vec3 e = fbmd_9( p/TERRAIN_EXTENT + vec2(1.0,-2.0), footprint/TERRAIN_EXTENT );
+    e.x  = TERRAIN_AMPLITUDE*e.x + TERRAIN_AMPLITUDE;
+    e.yz = TERRAIN_AMPLITUDE*e.yz;
 
     // cliff
     vec2 c = smoothstepd( 550.0, 600.0, e.x );
         e.x  = e.x  + 90.0*c.x;
         e.yz = e.yz + 90.0*c.y*e.yz;     // chain rule
 
-    e.yz /= 2000.0;
+    e.yz /= TERRAIN_EXTENT;
     return vec4( e.x, normalize( vec3(-e.y,1.0,-e.z) ) );
 }
 
-vec3 terrainNormal( in vec2 pos ) {
+// @param footprint Pixel footprint in world space at pos
+vec3 terrainNormal( in vec2 pos, float footprint ) {
+    // Central differences of the bake, one sample apart
+    vec2 g;
+    if (terrainBakeCoord(pos, g)) {
+        vec2 e = vec2(terrainBakeSpacing, 0.0);
+        return normalize(vec3(terrainHeightAt(pos-e.xy, 0.0) - terrainHeightAt(pos+e.xy, 0.0),
+                              2.0*e.x,
+                              terrainHeightAt(pos-e.yx, 0.0) - terrainHeightAt(pos+e.yx, 0.0)));
+    }
     vec2 e = vec2(0.03,0.0);
-    return normalize(vec3(sdTerrain(pos-e.xy).x - sdTerrain(pos+e.xy).x,
+    return normalize(vec3(sdTerrain(pos-e.xy, footprint).x - sdTerrain(pos+e.xy, footprint).x,
                         2.0*e.x,
-                        sdTerrain(pos-e.yx).x - sdTerrain(pos+e.yx).x ) );
+                        sdTerrain(pos-e.yx, footprint).x - sdTerrain(pos+e.yx, footprint).x ) );
 }
 
-float terrainShadow( in vec3 ro, in vec3 rd, in float mint ) {
+// @param footprint Pixel footprint in world space at ro
+float terrainShadow( in vec3 ro, in vec3 rd, in float mint, float footprint ) {
     float res = 1.0;
     float t = mint;
     for( int i=0; i<32; i++ ) {
         vec3  pos = ro + t*rd;
-        vec2  env = sdTerrain( pos.xz );
-        float hei = pos.y - env.x;
+        float hei = pos.y - terrainHeightAt( pos.xz, footprint );
         res = min( res, 32.0*hei/t );
         if( res<0.0001 || pos.y>TERRAIN_HIGH ) break;
         t += clamp( hei, 2.0+t*0.1, 100.0 );
@@ -2132,13 +2829,14 @@ RenderInfo terrainRender(in vec3 ro, in vec3 rd, inout bool hit, in float maxT,
     if (res > 0.0) {
         // If Hit
         hit = true; ri.d = res;
-        vec3 p = ro + rd * res; vec3 pn = terrainNormal(p.xz);
+        vec3 p = ro + rd * res; float footprint = coneRadius(res);
+        vec3 pn = terrainNormal(p.xz, footprint);
         vec3 speC = vec3(1.0); vec3 epos = p + vec3(0.0,4.8,0.0);
         vec3 sunColor = getSunColor();
-        float sha1  = terrainShadow( p+vec3(0,0.02,0), getSunDir(), 0.02 );
-        sha1 *= smoothstep(-0.325,-0.075,cloudsShadowFlat(epos, getSunDir()));
+        float sha1  = terrainShadow( p+vec3(0,0.02,0), getSunDir(), 0.02, footprint );
+        sha1 *= smoothstep(-0.325,-0.075,cloudsShadowFlat(epos, getSunDir(), footprint));
         // bump map
-        vec3 nor = normalize( pn + 0.8*(1.0-abs(pn.y))*0.8*fbmd_8( (p-vec3(0,600,0))*0.15*vec3(1.0,0.2,1.0) ).yzw );
+        vec3 nor = normalize( pn + 0.8*(1.0-abs(pn.y))*0.8*fbmd_8( (p-vec3(0,600,0))*0.15*vec3(1.0,0.2,1.0), footprint*0.15 ).yzw );
         col = vec3(0.18,0.12,0.10)*.85;
         col = 1.0*mix( col, vec3(0.1,0.1,0.0)*0.2, smoothstep(0.7,0.9,nor.y) );
         float dif = clamp( dot( nor, getSunDir()), 0.0, 1.0 );
@@ -2217,7 +2915,8 @@ float seaMap(vec3 p) {
 
 // p is ray position.
 // This function calculate detail map with more iteration count.
-float seaMapD(vec3 p) {
+// @param footprint Pixel footprint in world space (0 for full detail)
+float seaMapD(vec3 p, float footprint) {
     float freq = SEA_FREQ;
     float amp = SEA_HEIGHT;
     float choppy = SEA_CHOPPY;
@@ -2226,10 +2925,12 @@ float seaMapD(vec3 p) {
 
     float d, h = 0.0;
 
-    for (int i = 0; i < ITER_FRAGMENT; i++) {
+    // octave_m doubles uv on top of freq, so the waves shrink 4x per octave
+    float octaves = octaveCount(footprint * SEA_FREQ, 4.0, ITER_FRAGMENT);
+    for (int i = 0; i < int(ceil(octaves)); i++) {
         d = sea_octave((uv + SEA_TIME) * freq, choppy);
         d += sea_octave((uv - SEA_TIME) * freq, choppy);
-        h += d * amp;
+        h += octaveWeight(octaves, i) * d * amp;
         uv *= octave_m;
         freq *= 2.0;
         amp *= 0.2;
@@ -2238,11 +2939,11 @@ float seaMapD(vec3 p) {
     return p.y - h;
 }
 
-vec3 getSeaNormal(vec3 p, float eps) {
+vec3 getSeaNormal(vec3 p, float eps, float footprint) {
     vec3 n;
-    n.y = seaMapD(p);
-    n.x = seaMapD(vec3(p.x + eps, p.y, p.z)) - n.y;
-    n.z = seaMapD(vec3(p.x, p.y, p.z + eps)) - n.y;
+    n.y = seaMapD(p, footprint);
+    n.x = seaMapD(vec3(p.x + eps, p.y, p.z), footprint) - n.y;
+    n.z = seaMapD(vec3(p.x, p.y, p.z + eps), footprint) - n.y;
     n.y = eps;
     return normalize(n);
 }
@@ -2267,7 +2968,7 @@ float seaMapHeight(in vec3 ro, in vec3 rd, out vec3 p, float maxT) {
         p = ro + rd * tmid;
 
         if (tmid > maxT) {
-            return -1;
+            return -1.f;
         }
 
         float hmid = seaMap(p);
@@ -2287,13 +2988,13 @@ RenderInfo seaRender(in vec3 ro, in vec3 rd, inout bool hit, in float maxT, in v
     // Trace
     float t = seaMapHeight(ro, rd, p, maxT);
 
-    if (length(p) == 0 || t == -1) { ri.fragColor = vec4(bgCol, 1); return;}
+    if (length(p) == 0 || t == -1) { ri.fragColor = vec4(bgCol, 1); return ri;}
 
     hit = true; ri.d = t;
 
     // Shade
     vec3 d = p - ro;
-    vec3 n = getSeaNormal(p, dot(d, d) * 0.1 / screenDimensions.x);
+    vec3 n = getSeaNormal(p, dot(d, d) * 0.1 / screenDimensions.x, coneRadius(t));
 
     // Get Sky
      vec3 s = getSky(rd);
@@ -2315,11 +3016,13 @@ RenderInfo seaRender(in vec3 ro, in vec3 rd, inout bool hit, in float maxT, in v
 // @param rd Ray direction
 // @param i IntersectionInfo we are populating
 // @param side Determines if we are inside or outside of an object (for refraction)
-RenderInfo render(in vec3 ro, in vec3 rd, out IntersectionInfo i,
-                  in float side, in float maxT, in vec3 bgCol) {
+// @param minT Distance along the ray known to be empty
+// @param objMask Objects that the ray may hit
+RenderInfo render(in vec3 ro, in vec3 rd, out IntersectionInfo i, in float side,
+                  in float minT, in float maxT, in uint objMask, in vec3 bgCol) {
     RenderInfo ri; i.intersectObj = -1;
     // Raymarching
-    RayMarchRes res = raymarch(ro, rd, maxT, side);
+    RayMarchRes res = raymarch(ro, rd, minT, maxT, side, objMask);
     if (res.intersectObj == -1) {
         // NO HIT
         ri.fragColor = vec4(bgCol, 1.f);
@@ -2329,8 +3032,8 @@ RenderInfo render(in vec3 ro, in vec3 rd, out IntersectionInfo i,
     }
 
     // HIT
-    ri.isEnv = false; ri.d = res.d;
-    vec3 p = ro + rd * res.d; vec3 pn = getNormal(p); vec3 col;
+    ri.isEnv = false; ri.d = res.d; AMBIENT_TERM = vec3(0.f);
+    vec3 p = ro + rd * res.d; vec3 pn = getNormal(p, res.intersectObj); vec3 col;
 #ifdef PERLIN_BUMP
     pn = bumpNormal(pn, p, BUMP_SCALE, BUMP_INTENSITY);
 #endif
@@ -2357,12 +3060,16 @@ RenderInfo render(in vec3 ro, in vec3 rd, out IntersectionInfo i,
         col = mix( col, vec3(0.10,0.20,0.30), clamp(res.trap.y,0.0,1.0) );
         col = mix( col, vec3(0.02,0.10,0.30), clamp(res.trap.z*res.trap.z,0.0,1.0) );
         col = mix( col, vec3(0.30,0.10,0.02), clamp(pow(res.trap.w,6.0),0.0,1.0) );
-        col *= 0.5;
-        col *= getPhong(pn, res.intersectObj, p, ro, rd, maxT, false) * 8;
+        col *= 0.5 * 8.0;
+        vec3 tint = col;
+        col *= getPhong(pn, res.intersectObj, p, ro, rd, maxT, false);
+        AMBIENT_TERM *= tint;
     } else if (obj.type == MENGERSPONGE) {
         // Orbit Trap to color
         col = 0.5 + 0.5*cos(vec3(0,1,2)+2.0*res.trap.z), 1.f;
+        vec3 tint = col;
         col *= getPhong(pn, res.intersectObj, p, ro, rd, maxT, false);
+        AMBIENT_TERM *= tint;
     } else {
         col = getPhong(pn, res.intersectObj, p, ro, rd, maxT, false);
     }
@@ -2374,8 +3081,100 @@ RenderInfo render(in vec3 ro, in vec3 rd, out IntersectionInfo i,
     return ri;
 }
 
+RenderInfo render(in vec3 ro, in vec3 rd, out IntersectionInfo i,
+                  in float side, in float maxT, in vec3 bgCol) {
+    return render(ro, rd, i, side, 0.f, maxT, ALL_OBJECTS, bgCol);
+}
+
+vec2 cmul(vec2 a, vec2 b) {
+    return vec2(a.x*b.x - a.y*b.y, a.x*b.y + a.y*b.x);
+}
+
+// Point n of the deep zoom's reference orbit
+vec2 deepZoomPoint(int n) {
+    return texelFetch(deepZoomOrbit, ivec2(n % DEEP_ZOOM_ORBIT_WIDTH, n / DEEP_ZOOM_ORBIT_WIDTH), 0).rg;
+}
+
+// Mandelbrot set by perturbation around the deep zoom's reference orbit
+// ref: https://mathr.co.uk/blog/2021-05-14_deep_zoom_theory_and_practice.html
+// - the CPU iterates the reference Z_n in arbitrary precision, this only
+// iterates the float difference delta_n = z_n - Z_n:
+// delta_{n+1} = (2 Z_n + delta_n) delta_n + dc
+// - the first deepZoomSkip iterations come from the series approximation
+// - when z_n gets smaller than delta_n, or the reference runs out, delta is
+// rebased onto the start of the orbit (delta = z_n, n = 0)
+// @param ndc Pixel in [-1, 1]
+// @returns brightness from the distance estimate, 0 inside the set
+float sdDeepMandelBrot(vec2 ndc) {
+    // Pixel relative to the reference, in units of deepZoomScale
+    vec2 u = deepZoomOffset + ndc * vec2(screenDimensions.x / screenDimensions.y, 1.0) * deepZoomViewRatio;
+    vec2 dc = u * deepZoomScale;
+    vec2 u2 = cmul(u, u);
+    vec2 dz = cmul(deepZoomCoeffs[0], u) + cmul(deepZoomCoeffs[1], u2) + cmul(deepZoomCoeffs[2], cmul(u2, u));
+    // dz/dc times deepZoomScale, which keeps it within float range
+    vec2 der = deepZoomCoeffs[0] + 2.0 * cmul(deepZoomCoeffs[1], u) + 3.0 * cmul(deepZoomCoeffs[2], u2);
+    int n = deepZoomSkip;
+    for (int i = deepZoomSkip; i < deepZoomIterations; i++) {
+        vec2 z = deepZoomPoint(n) + dz;
+        float z2 = dot(z, z);
+        if (z2 > DEEP_ZOOM_BAILOUT) {
+            // |z| log|z| / |dz/dc|, over the pixel size 2 deepZoomScale deepZoomViewRatio / height
+            float d = sqrt(z2) * 0.5 * log(z2) / length(der);
+            float pixels = d * screenDimensions.y / (2.0 * deepZoomViewRatio);
+            return sqrt(clamp(pixels / DEEP_ZOOM_DE_PIXELS, 0.0, 1.0));
+        }
+        if (z2 < dot(dz, dz) || n == deepZoomOrbitLength - 1) {
+            dz = z; n = 0;
+        }
+        der = 2.0 * cmul(z, der) + vec2(deepZoomScale, 0.0);
+        dz = cmul(2.0 * deepZoomPoint(n) + dz, dz) + dc;
+        n++;
+    }
+    return 0.0;
+}
+
+// Point of the 2^level refinement grid that stands in for px
+// - clamped to the screen, so the pixels along the left and bottom edges
+// stand in for themselves when their grid point is off screen
+ivec2 fractalAnchor(ivec2 px, int level) {
+    ivec2 o = ivec2(fractalOrigin);
+    return max(((px + o) >> level << level) - o, ivec2(0));
+}
+
+// Fills the fractal cache for the current view
+// - pixels are copied from the previous frame where it computed them,
+// so a pan only iterates the strips it exposes
+// - every pixel keeps the level its area is refined to: pixels new to the
+// view start with one pixel per 2^(FRACTAL_CACHE_LEVELS - 1) block, and
+// every following frame a finer level, until every pixel is computed
+// @returns brightness, whether it was computed, and the level
+vec3 fractalCachePass() {
+    ivec2 px = ivec2(fragCoord.xy);
+    ivec2 src = px + ivec2(fractalShift);
+    int level = FRACTAL_CACHE_LEVELS - 1;
+    if (fractalCacheValid && all(greaterThanEqual(src, ivec2(0))) && all(lessThan(src, ivec2(screenDimensions)))) {
+        vec3 cached = texelFetch(fractalCache, src, 0).rgb;
+        level = max(int(cached.b) - 1, 0);
+        if (cached.g > 0.0) return vec3(cached.rg, float(level));
+    }
+    if (fractalAnchor(px, level) != px) return vec3(0.0, -1.0, float(level));
+    vec2 ndc = (vec2(px) + 0.5) / screenDimensions * 2.0 - 1.0;
+    return vec3(sdDeepMandelBrot(ndc), 1.0, float(level));
+}
+
+// Finest computed pixel of the fractal cache that covers this one
+float cachedFractal() {
+    ivec2 px = ivec2(fragCoord.xy);
+    for (int level = 0; level < FRACTAL_CACHE_LEVELS; level++) {
+        vec2 cached = texelFetch(fractalCache, fractalAnchor(px, level), 0).rg;
+        if (cached.g > 0.0) return cached.r;
+    }
+    return 0.0;
+}
+
 vec3 render2D(vec2 pos) {
-    float scol = sdMandelBrot(twoDFragCoord.xy);
+    float scol = enableFractalCache ? cachedFractal()
+               : enableDeepZoom ? sdDeepMandelBrot(pos) : sdMandelBrot(pos);
     return pow( vec3(scol), vec3(0.9,1.1,1.4) );
 }
 
@@ -2426,150 +3225,239 @@ void setScene(inout vec3 ro, inout vec3 rd, inout vec3 bgCol, out float far) {
 #endif
 }
 
-void main() {
-    // === 2D Render ===
-    if (isTwoD) { fragColor = vec4(render2D(twoDFragCoord.xy), 1.f); return; }
-
-    // === set scene ===
-    vec3 ro, rd, bgCol; float far;
-    setScene(ro, rd, bgCol, far);
-
-    vec4 phong, refl = vec4(0.f), refr = vec4(0.f), cres;
-    bool cloudHit = false, terrainHit = false, seaHit = false;
-    IntersectionInfo info, oi;
-    RenderInfo ri, tr, sr;
-
-    // === Main render ===
-    ri = render(ro, rd, info, OUTSIDE, far, bgCol);
-    sr.d = ri.d; tr.d = ri.d;
+// Traces a ray through the scene and then the sea, terrain and clouds
+// - an environment hit replaces the scene's color and marks it as isEnv
+// @param primary Whether this is the camera ray, which reads the cloud buffer
+// @param envHit Set if the sea, terrain or clouds were hit
+RenderInfo traceRay(in vec3 ro, in vec3 rd, out IntersectionInfo info, in float minT, in float far,
+                    in uint objMask, in bool primary, in vec3 bgCol, out bool envHit) {
+    RenderInfo ri = render(ro, rd, info, OUTSIDE, minT, far, objMask, bgCol);
+    bool seaHit = false, terrainHit = false, cloudHit = false;
+    RenderInfo sr, tr; sr.d = ri.d; tr.d = ri.d;
     // === Sea render ===
 #ifdef SEA
     sr = seaRender(ro, rd, seaHit, ri.d, bgCol);
+    if (seaHit) ri.fragColor = sr.fragColor;
 #endif
     // === Terrain render ===
 #ifdef TERRAIN
     tr = terrainRender(ro, rd, terrainHit, sr.d, bgCol);
+    if (terrainHit) ri.fragColor = tr.fragColor;
 #endif
     // === Cloud render ===
 #ifdef CLOUD
-    cres = vec4(cloudRender(ro, rd, bgCol, cloudHit, tr.d), 1.f);
+    vec4 cres;
+    if (primary && enableCloudBuffer) cres = vec4(cloudsFromBuffer(tr.d, bgCol, cloudHit), 1.f);
+    else cres = vec4(cloudRender(ro, rd, bgCol, cloudHit, tr.d), 1.f);
+    if (cloudHit) ri.fragColor = cres;
 #endif
+    envHit = seaHit || terrainHit || cloudHit;
+    if (envHit) ri.isEnv = true;
+    return ri;
+}
 
-    // === Case when main render did not hit a real object ===
-    if (ri.isEnv && !cloudHit && !terrainHit && !seaHit) {
-        // NO HIT
-        if (ri.isAL) {
-           // If hit area lights
-           setBrightness(ri.fragColor.rgb); fragColor = ri.fragColor; return;
-        }
-        fragColor = ri.fragColor; BrightColor = vec4(0.0, 0.0, 0.0, 1.0); return;
-    } else if (cloudHit) {
-        // If main render did not hit and we hit cloud
-        setBrightness(cres.rgb); fragColor = cres; return;
-    } else if (terrainHit) {
-        // If main render did not hit and we hit terrain
-        setBrightness(tr.fragColor.rgb); fragColor = tr.fragColor; return;
-    } else if (seaHit) {
-        // If main render did not hit and we hit sea
-        setBrightness(sr.fragColor.rgb); fragColor = sr.fragColor; return;
-    }
-    // ========================================================
-
-    phong = ri.fragColor;
+// Queues a secondary ray, dropping it if the stack is full
+void pushRay(vec3 ro, vec3 rd, vec3 fil, int depth) {
+    if (RAY_STACK_TOP == RAY_STACK_SIZE) return;
+    RAY_STACK[RAY_STACK_TOP++] = SecondaryRay(ro, rd, fil, depth);
+}
 
-    // =================== Refl && Refr =====================
-    oi.intersectObj = info.intersectObj; oi.n = info.n; oi.p = info.p; oi.rd = info.rd;
-    // === Secondary Rays ===
-    RayMarchObject obj = objects[info.intersectObj];
+// Queues the reflected and refracted rays leaving a surface hit
+// - a ray is only queued while its weight stays above MIN_THROUGHPUT
+// @param hit Surface that was hit
+// @param fil Weight of the path up to the hit
+// @param depth Bounce count of the queued rays
+void pushSecondaryRays(IntersectionInfo hit, int customId, vec3 fil, int depth, float far) {
+    if (depth > maxBounces) return;
+    RayMarchObject obj = objects[hit.intersectObj];
     vec3 cRefl = obj.cReflective, cRefr = obj.cTransparent;
     if (obj.type == CUSTOM) {
         // Change accordingly
-        if (ri.customId == 2) {
+        if (customId == 2) {
             cRefl = vec3(0.8);
         }
     }
-    if (enableReflection && length(cRefl) != 0) {
-        vec3 fil = vec3(1.f);
-        // GLSL does not have recursion apparently :(
-        // Here is my work around
-        // - fil keeps track of the accumulated material reflectivity
-        for (int i = 0; i < NUM_REFLECTION; i++) {
-            // Reflect ray
-            vec3 r = reflect(info.rd, info.n);
-            vec3 shiftedRO = info.p + r * SURFACE_DIST * 3.f;
-            // fil *= objects[info.intersectObj].cReflective;
-            fil *= cRefl;
-            // Render the reflected ray
-            bool terrainHit = false, cloudHit = false, seaHit = false; vec4 cres;
-            RenderInfo res, tr, sr;
-            res = render(shiftedRO, r, info, OUTSIDE, far, bgCol);
-            tr.d = res.d; sr.d = res.d;
-#ifdef SEA
-            sr = seaRender(shiftedRO, r, seaHit, res.d, bgCol);
-            if (seaHit) { res.fragColor = sr.fragColor; sr.isEnv = true; }
-#endif
-#ifdef TERRAIN
-            tr = terrainRender(shiftedRO, r, terrainHit, sr.d, bgCol);
-            if (terrainHit) { res.fragColor = tr.fragColor; res.isEnv = true; }
-#endif
-#ifdef CLOUD
-            cres = vec4(cloudRender(shiftedRO, r, bgCol, cloudHit, tr.d), 1.f);
-            if (cloudHit) { res.fragColor = cres; res.isEnv = true; }
-#endif
-            // Always want to incorporate the first reflected ray's color val
-            vec4 bounce = vec4(ks * fil * vec3(res.fragColor), 1.f);
-            refl += bounce;
-            if (res.isEnv) break;
-        }
-    }
-
-    if (enableRefraction && length(cRefr) != 0) {
-        // No recursion so hardcoded 2 refractions :(
-        // also it does not account for the reflected light contributions
-        // of the refracted rays (again, no recursion) so this is really wrong.
-        // I was able to find some article about backward raytracing that cleverly
-        // gets around this but, like many other things, for the time being this is
-        // good enough.
 
-        float ior = objects[oi.intersectObj].ior;
-        vec3 ct = objects[oi.intersectObj].cTransparent;
+    // Reflection
+    vec3 reflFil = fil * ks * cRefl;
+    if (enableReflection && max(reflFil.x, max(reflFil.y, reflFil.z)) > MIN_THROUGHPUT) {
+        vec3 r = reflect(hit.rd, hit.n);
+        pushRay(hit.p + r * SURFACE_DIST * 3.f, r, reflFil, depth);
+    }
 
+    // Refraction
+    // - marches through the object to where the ray leaves it
+    vec3 refrFil = fil * kt * cRefr;
+    if (enableRefraction && max(refrFil.x, max(refrFil.y, refrFil.z)) > MIN_THROUGHPUT) {
         // Air -> Medium
         // - air ior is 1.
-        vec3 rdIn = refract(oi.rd, oi.n, 1./ior);
-        vec3 pEnter = oi.p - oi.n * SURFACE_DIST * 3.f;
-        float dIn = raymarch(pEnter, rdIn, far, INSIDE).d;
+        vec3 rdIn = refract(hit.rd, hit.n, 1./obj.ior);
+        vec3 pEnter = hit.p - hit.n * SURFACE_DIST * 3.f;
+        RayMarchRes inRes = raymarch(pEnter, rdIn, far, INSIDE);
+        if (inRes.intersectObj == -1) return;
+        // Medium -> Air
+        vec3 pExit = pEnter + rdIn * inRes.d;
+        vec3 nExit = -getNormal(pExit, inRes.intersectObj);
+        vec3 rdOut = refract(rdIn, nExit, obj.ior);
+        // Total internal reflection
+        if (length(rdOut) == 0) return;
+        pushRay(pExit - nExit * SURFACE_DIST * 5.f, rdOut, refrFil, depth);
+    }
+}
 
-        vec3 pExit = pEnter + rdIn * dIn;
-        vec3 nExit = -getNormal(pExit);
+// Traces every secondary ray leaving a primary hit
+// @returns sum of the weighted colors the rays bring back
+vec3 traceSecondaryRays(IntersectionInfo hit, int customId, float far, vec3 bgCol) {
+    IntersectionInfo info;
+    bool envHit;
+    vec3 col = vec3(0.f);
+    RAY_STACK_TOP = 0;
+    pushSecondaryRays(hit, customId, vec3(1.f), 1, far);
+    for (int i = 0; i < MAX_SECONDARY_RAYS && RAY_STACK_TOP > 0; i++) {
+        SecondaryRay ray = RAY_STACK[--RAY_STACK_TOP];
+        RenderInfo res = traceRay(ray.ro, ray.rd, info, 0.f, far, ALL_OBJECTS, false, bgCol, envHit);
+        col += ray.fil * res.fragColor.rgb;
+        // - area lights end the path, info holds no surface for them
+        if (!res.isEnv && !res.isAL) pushSecondaryRays(info, res.customId, ray.fil, ray.depth + 1, far);
+    }
+    return col;
+}
 
-        vec3 rdOut = refract(rdIn, nExit, ior);
-        if (length(rdOut) == 0) {
-            // Total Internal Reflection
-            refr = vec4(0.);
-        } else {
-            vec3 shiftedRO = pExit - nExit * SURFACE_DIST*5.f;
-            bool cloudHit = false, terrainHit = false, seaHit = false;
-            vec4 cres; vec4 resC; RenderInfo res, tr, sr;
-            res = render(shiftedRO, rdOut, info, OUTSIDE, far, bgCol);
-            tr.d = res.d; sr.d = res.d;
-#ifdef SEA
-            sr = seaRender(shiftedRO, rdOut, seaHit, res.d, bgCol);
-            if (seaHit) res.fragColor = sr.fragColor;
-#endif
-#ifdef TERRAIN
-            tr = terrainRender(shiftedRO, rdOut, terrainHit, sr.d, bgCol);
-            if (terrainHit) res.fragColor = tr.fragColor;
-#endif
+// Secondary rays of this pixel, upsampled from the half resolution buffer
+// - bilinear over the four closest texels, weighted down where the texel's
+//   primary hit faces another way or lies at another depth
+// @param n Normal of this pixel's primary hit
+// @param d Distance to this pixel's primary hit
+// @returns false if no texel matches, in which case sec is not set
+bool secondaryFromBuffer(in vec3 n, in float d, out vec3 sec) {
+    vec2 pos = fragCoord.xy / float(SECONDARY_SCALE) - 0.5;
+    ivec2 base = ivec2(floor(pos));
+    vec2 f = pos - vec2(base);
+    ivec2 last = textureSize(secondaryColor, 0) - 1;
+    vec3 sum = vec3(0.0);
+    float wSum = 0.0;
+    for (int i = 0; i < 4; i++) {
+        ivec2 o = ivec2(i & 1, i >> 1);
+        ivec2 c = clamp(base + o, ivec2(0), last);
+        vec4 g = texelFetch(secondaryGBuffer, c, 0);
+        if (g.w < 0.0) continue;
+        vec2 b = mix(1.0 - f, f, vec2(o));
+        float wn = pow(max(dot(g.xyz, n), 0.0), SECONDARY_NORMAL_POWER);
+        float wd = max(0.0, 1.0 - abs(g.w - d) / (SECONDARY_DEPTH_TOLERANCE * d));
+        float w = b.x * b.y * wn * wd;
+        sum += w * texelFetch(secondaryColor, c, 0).rgb;
+        wSum += w;
+    }
+    if (wSum < SECONDARY_MIN_WEIGHT) return false;
+    sec = sum / wSum;
+    return true;
+}
+
+// Shades the current fragment
+void shade() {
+    // === 2D Render ===
+    if (renderPass == PASS_FRACTAL) { fragColor = vec4(fractalCachePass(), 1.f); return; }
+    if (isTwoD) { fragColor = vec4(render2D(twoDFragCoord.xy), 1.f); return; }
+
+    // === Sky bake ===
+    if (renderPass == PASS_SKY) { fragColor = vec4(bakeSky(), 1.f); return; }
+
+    // === Terrain bake ===
+    if (renderPass == PASS_TERRAIN) { fragColor = vec4(bakeTerrainHeight(), 0.f, 0.f, 1.f); return; }
+
+    // === set scene ===
+    vec3 ro, rd, bgCol; float far;
+    setScene(ro, rd, bgCol, far);
+
+    // === Depth prepass ===
+    if (renderPass == PASS_DEPTH) { fragColor = vec4(coneMarch(tileRayDir(), far), 0.f, 0.f, 1.f); return; }
+
+    // === Cloud buffer ===
 #ifdef CLOUD
-            cres = vec4(cloudRender(shiftedRO, rdOut, bgCol, cloudHit, tr.d), 1.f);
-            if (cloudHit) res.fragColor = cres;
+    if (renderPass == PASS_CLOUD) { fragColor = cloudBuffer(ro, rd, far); return; }
 #endif
-            refr += vec4(kt * ct * vec3(res.fragColor), 1.f);
-        }
+
+    IntersectionInfo info;
+    bool envHit;
+
+    // === Half resolution secondary rays ===
+    // - the hint buffers are laid out for full resolution pixels, so the
+    //   primary hit is found with a plain march, and it is not shaded
+    if (renderPass == PASS_SECONDARY) {
+        RayMarchRes pri = raymarch(ro, rd, 0.f, far, OUTSIDE, ALL_OBJECTS);
+        if (pri.intersectObj == -1 || objects[pri.intersectObj].isEmissive) { fragColor = vec4(0.f); return; }
+        info.rd = rd; info.p = ro + rd * pri.d; info.intersectObj = pri.intersectObj;
+        info.n = getNormal(info.p, pri.intersectObj);
+#ifdef PERLIN_BUMP
+        info.n = bumpNormal(info.n, info.p, BUMP_SCALE, BUMP_INTENSITY);
+#endif
+        fragColor = vec4(traceSecondaryRays(info, pri.customId, far, bgCol), 1.f);
+        gBuffer = vec4(info.n, pri.d);
+        return;
     }
 
-    vec4 col = phong + refl + refr;
-    setBrightness(vec3(col));
-    fragColor = col;
+    // === Main render ===
+    float minT = temporalStart(ro, rd, primaryStart(ro));
+    PRIMARY_SHADING = renderPass == PASS_SHADE;
+    RenderInfo ri = traceRay(ro, rd, info, minT, far, tileObjectMask(), true, bgCol, envHit);
+    PRIMARY_SHADING = false;
+    PRIMARY_STEPS = LAST_MARCH_STEPS;
+    hitDepth = ri.isEnv ? -1.f : ri.d + length(ro - eyePosition.xyz);
+    // === Case when main render did not hit a real object ===
+    if (envHit) {
+        // If we hit the sea, terrain or clouds
+        setBrightness(ri.fragColor.rgb); fragColor = ri.fragColor; return;
+    } else if (ri.isEnv) {
+        // NO HIT
+        fragColor = ri.fragColor; BrightColor = vec4(0.0, 0.0, 0.0, 1.0); return;
+    } else if (ri.isAL) {
+        // If hit area lights
+        // - info holds no surface, so no gBuffer and no secondary rays
+        setBrightness(ri.fragColor.rgb); fragColor = ri.fragColor; return;
+    }
+    // ========================================================
+
+    // - read before the secondary rays replace AMBIENT_TERM
+    gBuffer = vec4(info.n, ri.d); ambientColor = vec4(AMBIENT_TERM, 1.f);
+
+    // =================== Refl && Refr =====================
+    // Every hit queues its reflected and refracted rays, weighted by the path
+    // so far, until maxBounces or the ray budget runs out
+    // - read from the half resolution buffer when a neighbouring texel saw
+    //   the same surface
+    vec3 sec;
+    if (!enableHalfResSecondary || !secondaryFromBuffer(info.n, ri.d, sec)) {
+        sec = traceSecondaryRays(info, ri.customId, far, bgCol);
+    }
+    vec3 col = ri.fragColor.rgb + sec;
+
+    setBrightness(col);
+    fragColor = vec4(col, 1.f);
 }
+
+// Clears the outputs and the per fragment globals
+// - the compute pass shades several pixels per invocation
+void beginFragment() {
+    FRAME = 0;
+    PRIMARY_STEPS = 0; TOTAL_STEPS = 0; LAST_MARCH_STEPS = 0;
+    RAY_STACK_TOP = 0;
+    AMBIENT_TERM = vec3(0.f);
+    PRIMARY_SHADING = false;
+    AREA_VISIBILITY = vec4(1.f, 1.f, 1.f, -1.f);
+    fragColor = vec4(0.f, 0.f, 0.f, 1.f);
+    BrightColor = vec4(0.f, 0.f, 0.f, 1.f);
+    hitDepth = -1.f;
+    gBuffer = vec4(0.f, 0.f, 0.f, -1.f);
+    ambientColor = vec4(0.f);
+}
+
+#ifndef COMPUTE_PASS
+void main() {
+    beginFragment();
+    shade();
+    areaVisibility = AREA_VISIBILITY;
+    // === Statistics ===
+    // - consumed by Realtime::profileScene
+    if (showStats && renderPass == PASS_SHADE) fragColor = vec4(float(PRIMARY_STEPS), float(TOTAL_STEPS), 0.f, 1.f);
+}
+#endif
@@ -0,0 +1,104 @@
+#version 330 core
+
+// Screen space ambient occlusion at 1 / AO_SCALE resolution
+// - occlusion is estimated from the main pass' hit distances and normals,
+//   then blended with the previous frame's estimate at the same surface
+// - writes (ao, distance from the eye) so that the next frame can tell
+//   whether its reprojected texel still sees the same surface
+out vec2 aoOut;
+
+// Hit distances of the main pass (-1 if nothing was hit)
+uniform sampler2D hitDepth;
+// Normals of the main pass' hits
+uniform sampler2D gBuffer;
+// Previous frame's output
+uniform sampler2D aoHistory;
+uniform bool aoHistoryValid;
+
+uniform mat4 viewMatrix;
+uniform mat4 projMatrix;
+uniform mat4 invProjViewMatrix;
+uniform vec4 eyePosition;
+uniform mat4 prevProjViewMatrix;
+uniform vec4 prevEyePosition;
+uniform int frameIndex;
+
+// Pixels per AO texel along each axis (matches AO_SCALE on the CPU)
+const int AO_SCALE = 2;
+const int AO_SAMPLES = 12;
+// World space radius of the hemisphere that is searched for occluders
+const float AO_RADIUS = 0.3;
+// Keeps flat surfaces from occluding themselves
+const float AO_BIAS = 0.01;
+// Weight of the new frame when accumulating
+const float AO_BLEND = 0.2;
+// Relative depth difference at which the history is rejected
+const float AO_DEPTH_TOLERANCE = 0.05;
+const float GOLDEN_ANGLE = 2.39996323;
+
+// Direction of the primary ray through uv
+vec3 rayDir(vec2 uv) {
+    vec2 ndc = uv * 2.0 - 1.0;
+    vec4 n = invProjViewMatrix * vec4(ndc, -1.0, 1.0);
+    vec4 f = invProjViewMatrix * vec4(ndc, 1.0, 1.0);
+    return normalize(f.xyz / f.w - n.xyz / n.w);
+}
+
+// Per pixel rotation, varied over frames so the accumulation sees new samples
+// http://www.iryoku.com/downloads/Next-Generation-Post-Processing-in-Call-of-Duty-Advanced-Warfare-v18.pptx
+float interleavedGradientNoise(vec2 px) {
+    px += 5.588238 * float(frameIndex % 64);
+    return fract(52.9829189 * fract(dot(px, vec2(0.06711056, 0.00583715))));
+}
+
+void main() {
+    ivec2 px = ivec2(gl_FragCoord.xy) * AO_SCALE;
+    ivec2 size = textureSize(hitDepth, 0);
+    px = min(px, size - 1);
+    float d = texelFetch(hitDepth, px, 0).r;
+    if (d < 0.0) { aoOut = vec2(1.0, -1.0); return; }
+    vec3 n = texelFetch(gBuffer, px, 0).xyz;
+    vec3 p = eyePosition.xyz + rayDir((vec2(px) + 0.5) / vec2(size)) * d;
+
+    // Tangent frame around the normal
+    vec3 t = normalize(abs(n.y) < 0.99 ? cross(n, vec3(0.0, 1.0, 0.0)) : cross(n, vec3(1.0, 0.0, 0.0)));
+    vec3 b = cross(n, t);
+
+    // Samples spiral outwards over the hemisphere
+    mat4 projView = projMatrix * viewMatrix;
+    float rot = interleavedGradientNoise(gl_FragCoord.xy) * 6.28318;
+    float occ = 0.0;
+    for (int i = 0; i < AO_SAMPLES; i++) {
+        float k = (float(i) + 0.5) / float(AO_SAMPLES);
+        float a = rot + float(i) * GOLDEN_ANGLE;
+        float r = sqrt(k);
+        vec3 h = vec3(r * cos(a), sqrt(1.0 - k), r * sin(a));
+        vec3 s = p + (t * h.x + n * h.y + b * h.z) * AO_RADIUS * mix(0.2, 1.0, k);
+        vec4 clip = projView * vec4(s, 1.0);
+        if (clip.w <= 0.0) continue;
+        vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+        if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0)))) continue;
+        float sceneD = texelFetch(hitDepth, ivec2(uv * vec2(size)), 0).r;
+        if (sceneD < 0.0) continue;
+        float sampleD = length(s - eyePosition.xyz);
+        // Only occluders within the radius count
+        float range = smoothstep(0.0, 1.0, AO_RADIUS / abs(d - sceneD));
+        occ += (sceneD < sampleD - AO_BIAS ? 1.0 : 0.0) * range;
+    }
+    // Same sky term as calcAO
+    float ao = (1.0 - occ / float(AO_SAMPLES)) * (0.5 + 0.5 * n.y);
+
+    // Temporal accumulation
+    vec4 clip = prevProjViewMatrix * vec4(p, 1.0);
+    if (aoHistoryValid && clip.w > 0.0) {
+        vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+        if (all(greaterThanEqual(uv, vec2(0.0))) && all(lessThanEqual(uv, vec2(1.0)))) {
+            vec2 hist = texture(aoHistory, uv).rg;
+            float prevD = length(p - prevEyePosition.xyz);
+            if (hist.g >= 0.0 && abs(hist.g - prevD) < AO_DEPTH_TOLERANCE * prevD) {
+                ao = mix(hist.r, ao, AO_BLEND);
+            }
+        }
+    }
+    aoOut = vec2(ao, d);
+}
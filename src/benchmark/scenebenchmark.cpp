@@ -0,0 +1,141 @@
+#include "utils/scenebinary.h"
+#include "utils/scenefilereader.h"
+#include "utils/sceneparser.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// Scene loading benchmark
+// - generates scenes of up to 100k nodes and times the JSON parse, the
+//   flattening and loading the compiled scene
+// - build with -DSCENE_BENCHMARK=ON and run scene_benchmark
+
+namespace {
+// Shared head of every generated scene
+const char *SCENE_HEADER = R"({
+  "globalData": {
+    "ambientCoeff": 0.5,
+    "diffuseCoeff": 0.5,
+    "specularCoeff": 0.5
+  },
+  "cameraData": {
+    "position": [0, 0, 4.5],
+    "up": [0, 1, 0],
+    "heightAngle": 30.0,
+    "focus": [0, 0, 0]
+  },
+)";
+
+// One sphere in a translated group
+std::string group(int i) {
+  std::ostringstream s;
+  s << R"({"translate": [)" << i % 100 << ", " << i / 100 % 100 << ", "
+    << i / 10000 << R"(], "primitives": [{"type": "sphere"}]})";
+  return s.str();
+}
+
+/**
+ * @brief Scene with n groups directly under the root
+ */
+std::string wideScene(int n) {
+  std::ostringstream s;
+  s << SCENE_HEADER << R"(  "groups": [)";
+  for (int i = 0; i < n; i++) {
+    s << (i ? ",\n" : "\n") << "    " << group(i);
+  }
+  s << "\n  ]\n}\n";
+  return s.str();
+}
+
+/**
+ * @brief Scene with a chain of n template groups, each instancing the one
+ * before it, so that the scene graph is n nodes deep
+ */
+std::string deepScene(int n) {
+  std::ostringstream s;
+  s << SCENE_HEADER << R"(  "templateGroups": [)";
+  for (int i = 0; i < n; i++) {
+    s << (i ? ",\n" : "\n") << R"(    {"name": "t)" << i
+      << R"(", "translate": [0, 0.001, 0], "primitives": [{"type": "sphere"}])";
+    if (i) {
+      s << R"(, "groups": [{"name": "t)" << i - 1 << R"("}])";
+    }
+    s << "}";
+  }
+  s << "\n  ],\n" << R"(  "groups": [{"name": "t)" << n - 1 << R"("}])"
+    << "\n}\n";
+  return s.str();
+}
+
+// Milliseconds that f takes
+double time(const std::function<void()> &f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  std::chrono::duration<double, std::milli> ms =
+      std::chrono::steady_clock::now() - start;
+  return ms.count();
+}
+
+/**
+ * @brief Times loading one generated scene and prints a row
+ */
+bool run(const std::string &name, const std::string &json,
+         const std::filesystem::path &dir) {
+  std::filesystem::path jsonPath = dir / (name + ".json");
+  std::filesystem::path binaryPath = dir / (name + SCENE_BINARY_EXTENSION);
+  std::ofstream(jsonPath) << json;
+
+  RenderData renderData{};
+  bool ok = true;
+  double flattenMs = 0.0;
+  double parseMs = time([&] {
+    ScenefileReader reader(jsonPath.string());
+    ok = reader.readJSON();
+    if (ok) {
+      flattenMs = time([&] {
+        SceneParser::flatten(reader.getRootNode(), renderData);
+      });
+    }
+  });
+  if (!ok || !SceneBinary::write(binaryPath.string(), renderData)) {
+    std::cout << "could not load " << jsonPath << std::endl;
+    return false;
+  }
+  RenderData compiled{};
+  double binaryMs =
+      time([&] { ok = SceneBinary::read(binaryPath.string(), compiled); });
+  if (!ok || compiled.shapes.size() != renderData.shapes.size()) {
+    std::cout << "could not load " << binaryPath << std::endl;
+    return false;
+  }
+  // - the parse includes flattening and freeing the scene graph
+  std::cout << std::left << std::setw(14) << name << std::right << std::setw(8)
+            << renderData.shapes.size() << std::fixed << std::setprecision(2)
+            << std::setw(12) << parseMs - flattenMs << std::setw(12)
+            << flattenMs << std::setw(12) << binaryMs << std::endl;
+  return true;
+}
+} // namespace
+
+int main() {
+  std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / "scene_benchmark";
+  std::filesystem::create_directories(dir);
+
+  std::cout << std::left << std::setw(14) << "scene" << std::right
+            << std::setw(8) << "shapes" << std::setw(12) << "parse ms"
+            << std::setw(12) << "flatten ms" << std::setw(12) << "binary ms"
+            << std::endl;
+  bool ok = true;
+  for (int n : {1000, 10000, 100000}) {
+    ok = ok && run("wide_" + std::to_string(n), wideScene(n), dir);
+    ok = ok && run("deep_" + std::to_string(n), deepScene(n), dir);
+  }
+  std::filesystem::remove_all(dir);
+  return ok ? 0 : 1;
+}
@@ -162,6 +162,12 @@ float Camera::getNearPlane() const { return m_near; }
  */
 float Camera::getFarPlane() const { return m_far; }
 
+/**
+ * @brief Gets the vertical field of view of this camera
+ * @returns float representing the height angle in radians
+ */
+float Camera::getHeightAngle() const { return m_heightAngle; }
+
 /**
  * @brief Moves the camera by the displacement and update the view matrix to
  * reflect the change
@@ -20,6 +20,8 @@ public:
   float getNearPlane() const;
   // Gets far plane
   float getFarPlane() const;
+  // Gets the vertical field of view (radians)
+  float getHeightAngle() const;
   // Gets the View Matrix of the camera
   glm::mat4 getViewMatrix() const;
   // Gets the Projection Matrix of the camera
@@ -0,0 +1,296 @@
+#include "deepzoom.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// Iteration limit of the whole set, plus ITERATIONS_PER_OCTAVE for every
+// halving of the view
+constexpr int MIN_ITERATIONS = 256;
+constexpr int ITERATIONS_PER_OCTAVE = 64;
+// The series is validated for views this many times wider than the one that
+// requested the orbit, so that it survives panning and zooming out a little
+constexpr double SERIES_MARGIN = 2.0;
+// Largest truncation error of the series, relative to its linear term
+constexpr double SERIES_TOLERANCE = 1e-6;
+
+/**
+ * @brief Fractional limbs needed to resolve a view of the given scale
+ * - 64 bits beyond the view's own size for the iteration's rounding
+ */
+int fracLimbsFor(double scale) {
+  double bits = std::max(0.0, -std::log2(scale));
+  return 2 + int(std::ceil(bits / 32.0));
+}
+
+glm::dvec2 cmul(const glm::dvec2 &a, const glm::dvec2 &b) {
+  return glm::dvec2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+} // namespace
+
+// ========================== BIG FIXED ==============================
+
+BigFixed::BigFixed(int fracLimbs) : m_limbs(fracLimbs + 1, 0) {}
+
+/**
+ * @brief Converts a double, exactly as long as the limbs reach its last bit
+ */
+BigFixed BigFixed::fromDouble(double v, int fracLimbs) {
+  BigFixed r(fracLimbs);
+  double a = std::abs(v);
+  double whole = std::floor(a);
+  r.m_limbs[fracLimbs] = uint32_t(whole);
+  double frac = a - whole;
+  for (int i = fracLimbs - 1; i >= 0 && frac > 0.0; i--) {
+    frac = std::ldexp(frac, 32);
+    double limb = std::floor(frac);
+    r.m_limbs[i] = uint32_t(limb);
+    frac -= limb;
+  }
+  return v < 0.0 ? r.negated() : r;
+}
+
+double BigFixed::toDouble() const {
+  BigFixed a = isNegative() ? negated() : *this;
+  int fracLimbs = getFracLimbs();
+  double v = 0.0;
+  for (int i = 0; i <= fracLimbs; i++) {
+    v += std::ldexp(double(a.m_limbs[i]), 32 * (i - fracLimbs));
+  }
+  return isNegative() ? -v : v;
+}
+
+int BigFixed::getFracLimbs() const { return int(m_limbs.size()) - 1; }
+
+BigFixed BigFixed::withFracLimbs(int fracLimbs) const {
+  BigFixed r(fracLimbs);
+  int shift = fracLimbs - getFracLimbs();
+  for (int i = 0; i < int(m_limbs.size()); i++) {
+    if (i + shift >= 0) {
+      r.m_limbs[i + shift] = m_limbs[i];
+    }
+  }
+  return r;
+}
+
+BigFixed BigFixed::operator+(const BigFixed &o) const {
+  BigFixed r(getFracLimbs());
+  uint64_t carry = 0;
+  for (size_t i = 0; i < m_limbs.size(); i++) {
+    uint64_t sum = uint64_t(m_limbs[i]) + o.m_limbs[i] + carry;
+    r.m_limbs[i] = uint32_t(sum);
+    carry = sum >> 32;
+  }
+  return r;
+}
+
+BigFixed BigFixed::operator-(const BigFixed &o) const {
+  return *this + o.negated();
+}
+
+/**
+ * @brief Schoolbook product of the magnitudes, shifted back by the
+ * fractional limbs
+ */
+BigFixed BigFixed::operator*(const BigFixed &o) const {
+  bool negative = isNegative() != o.isNegative();
+  BigFixed a = isNegative() ? negated() : *this;
+  BigFixed b = o.isNegative() ? o.negated() : o;
+  size_t n = m_limbs.size();
+  std::vector<uint32_t> product(2 * n, 0);
+  for (size_t i = 0; i < n; i++) {
+    uint64_t carry = 0;
+    for (size_t j = 0; j < n; j++) {
+      uint64_t t = uint64_t(a.m_limbs[i]) * b.m_limbs[j] + product[i + j] +
+                   carry;
+      product[i + j] = uint32_t(t);
+      carry = t >> 32;
+    }
+    product[i + n] = uint32_t(carry);
+  }
+  BigFixed r(getFracLimbs());
+  std::copy_n(product.begin() + getFracLimbs(), n, r.m_limbs.begin());
+  return negative ? r.negated() : r;
+}
+
+bool BigFixed::isNegative() const { return m_limbs.back() >> 31; }
+
+BigFixed BigFixed::negated() const {
+  BigFixed r(getFracLimbs());
+  uint64_t carry = 1;
+  for (size_t i = 0; i < m_limbs.size(); i++) {
+    uint64_t sum = uint64_t(~m_limbs[i]) + carry;
+    r.m_limbs[i] = uint32_t(sum);
+    carry = sum >> 32;
+  }
+  return r;
+}
+
+// ========================== DEEP ZOOM ==============================
+
+DeepZoom::DeepZoom() { reset(); }
+
+DeepZoom::~DeepZoom() {
+  m_cancel = true;
+  joinWorker();
+}
+
+void DeepZoom::reset() {
+  m_cancel = true;
+  joinWorker();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_resultReady = false;
+  }
+  // The whole set
+  m_view.scale = 1.25;
+  m_view.centerX = BigFixed::fromDouble(-0.75, fracLimbsFor(m_view.scale));
+  m_view.centerY = BigFixed::fromDouble(0.0, fracLimbsFor(m_view.scale));
+}
+
+void DeepZoom::pan(double dx, double dy) {
+  int fracLimbs = m_view.centerX.getFracLimbs();
+  m_view.centerX =
+      m_view.centerX + BigFixed::fromDouble(dx * m_view.scale, fracLimbs);
+  m_view.centerY =
+      m_view.centerY + BigFixed::fromDouble(dy * m_view.scale, fracLimbs);
+}
+
+void DeepZoom::zoom(double x, double y, double factor) {
+  double scale = std::clamp(m_view.scale * factor, MIN_SCALE, MAX_SCALE);
+  // The point under (x, y) stays there
+  double ratio = scale / m_view.scale;
+  pan(x * (1.0 - ratio), y * (1.0 - ratio));
+  m_view.scale = scale;
+  // The center needs more bits the deeper the view
+  int fracLimbs = fracLimbsFor(m_view.scale);
+  if (fracLimbs != m_view.centerX.getFracLimbs()) {
+    m_view.centerX = m_view.centerX.withFracLimbs(fracLimbs);
+    m_view.centerY = m_view.centerY.withFracLimbs(fracLimbs);
+  }
+}
+
+const DeepZoomView &DeepZoom::getView() const { return m_view; }
+
+int DeepZoom::getIterations() const {
+  double octaves = std::max(0.0, std::log2(MAX_SCALE / m_view.scale));
+  return MIN_ITERATIONS + int(octaves * ITERATIONS_PER_OCTAVE);
+}
+
+glm::dvec2 DeepZoom::offsetFrom(const DeepZoomView &view) const {
+  int fracLimbs = std::max(m_view.centerX.getFracLimbs(),
+                           view.centerX.getFracLimbs());
+  BigFixed dx = m_view.centerX.withFracLimbs(fracLimbs) -
+                view.centerX.withFracLimbs(fracLimbs);
+  BigFixed dy = m_view.centerY.withFracLimbs(fracLimbs) -
+                view.centerY.withFracLimbs(fracLimbs);
+  return glm::dvec2(dx.toDouble(), dy.toDouble()) / view.scale;
+}
+
+/**
+ * @brief Whether the view needs a new orbit
+ * - any orbit works thanks to rebasing, but the float deltas lose precision
+ *   once the view is much smaller or further away than the orbit's scale
+ */
+bool DeepZoom::isStale(const DeepZoomOrbit &orbit) const {
+  double ratio = m_view.scale / orbit.view.scale;
+  return ratio < 0.5 || ratio > 2.0 ||
+         glm::length(offsetFrom(orbit.view)) > 1.0;
+}
+
+/**
+ * @brief Starts computing the orbit of the current view on the worker
+ * thread, so that the view stays interactive while the old orbit is drawn
+ */
+void DeepZoom::requestOrbit(double aspect) {
+  if (m_working) {
+    return;
+  }
+  joinWorker();
+  DeepZoomOrbit orbit;
+  orbit.view = m_view;
+  orbit.iterations = getIterations();
+  orbit.radius = SERIES_MARGIN * std::sqrt(aspect * aspect + 1.0);
+  m_cancel = false;
+  m_working = true;
+  m_worker = std::thread(&DeepZoom::computeOrbit, this, std::move(orbit));
+}
+
+bool DeepZoom::takeOrbit(DeepZoomOrbit &orbit) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_resultReady) {
+    return false;
+  }
+  orbit = std::move(m_result);
+  m_resultReady = false;
+  return true;
+}
+
+/**
+ * @brief Iterates Z_{n+1} = Z_n^2 + c at the view's precision
+ * - alongside, the coefficients of delta_n = A dc + B dc^2 + C dc^3 follow
+ *   A' = 2 Z A + 1, B' = 2 Z B + A^2, C' = 2 Z C + 2 A B, stored multiplied
+ *   by scale, scale^2 and scale^3 so that they fit in floats
+ * - the series is used up to the last iteration where, for every |u| up to
+ *   the radius, the cubic term is negligible and delta stays well below Z
+ *   (so that no pixel would have been rebased in between)
+ */
+void DeepZoom::computeOrbit(DeepZoomOrbit orbit) {
+  const DeepZoomView &view = orbit.view;
+  int fracLimbs = view.centerX.getFracLimbs();
+  BigFixed x(fracLimbs), y(fracLimbs);
+  glm::dvec2 a(0.0), b(0.0), c(0.0);
+  bool series = true;
+  double r = orbit.radius;
+  orbit.points.reserve(orbit.iterations);
+  for (int n = 0; n < orbit.iterations; n++) {
+    if (n % 1024 == 0 && m_cancel) {
+      m_working = false;
+      return;
+    }
+    glm::dvec2 z(x.toDouble(), y.toDouble());
+    orbit.points.push_back(glm::vec2(z));
+
+    if (series) {
+      double la = glm::length(a) * r;
+      double lb = glm::length(b) * r * r;
+      double lc = glm::length(c) * r * r * r;
+      if (n > 0 && (lc > SERIES_TOLERANCE * la ||
+                    la + lb + lc > 0.5 * glm::length(z))) {
+        series = false;
+      } else {
+        orbit.skip = n;
+        orbit.coeffs[0] = a;
+        orbit.coeffs[1] = b;
+        orbit.coeffs[2] = c;
+        glm::dvec2 z2 = 2.0 * z;
+        glm::dvec2 na = cmul(z2, a) + glm::dvec2(view.scale, 0.0);
+        glm::dvec2 nb = cmul(z2, b) + cmul(a, a);
+        glm::dvec2 nc = cmul(z2, c) + 2.0 * cmul(a, b);
+        a = na;
+        b = nb;
+        c = nc;
+      }
+    }
+
+    if (glm::dot(z, z) > BAILOUT) {
+      break;
+    }
+    BigFixed xx = x * x;
+    BigFixed yy = y * y;
+    BigFixed xy = x * y;
+    x = xx - yy + view.centerX;
+    y = xy + xy + view.centerY;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_result = std::move(orbit);
+  m_resultReady = true;
+  m_working = false;
+}
+
+void DeepZoom::joinWorker() {
+  if (m_worker.joinable()) {
+    m_worker.join();
+  }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Signed fixed point number with a 32 bit integer part and any number of 32
+// bit fractional limbs, in two's complement. Enough for the orbits of the
+// Mandelbrot set, which never leave |z| < 2^31 before they escape.
+// - both operands of an operation must have the same number of limbs
+class BigFixed {
+public:
+  explicit BigFixed(int fracLimbs = 2);
+
+  // Exact conversion of v, truncated to fracLimbs limbs
+  static BigFixed fromDouble(double v, int fracLimbs);
+  double toDouble() const;
+
+  int getFracLimbs() const;
+  // Same value with more (exact) or fewer (truncated) fractional limbs
+  BigFixed withFracLimbs(int fracLimbs) const;
+
+  BigFixed operator+(const BigFixed &o) const;
+  BigFixed operator-(const BigFixed &o) const;
+  // Truncates the product to the operands' precision
+  BigFixed operator*(const BigFixed &o) const;
+
+private:
+  bool isNegative() const;
+  BigFixed negated() const;
+
+  // Least significant first, the last limb is the integer part
+  std::vector<uint32_t> m_limbs;
+};
+
+// Region of the complex plane shown by a deep zoom
+struct DeepZoomView {
+  BigFixed centerX, centerY;
+  // Half height
+  double scale = 1.0;
+};
+
+// Reference orbit of a deep zoom view, iterated in arbitrary precision, and
+// the series approximation that lets every pixel skip its first iterations
+struct DeepZoomOrbit {
+  // View it was computed for, iterated from its center
+  DeepZoomView view;
+  // Iteration limit of the view
+  int iterations = 0;
+  // Z_0 = 0, Z_1 = c, ... up to and including the first escaping point
+  std::vector<glm::vec2> points;
+  // delta_skip = a u + b u^2 + c u^3 for u = (pixel - center) / scale
+  int skip = 0;
+  glm::dvec2 coeffs[3];
+  // Largest |u| the series was validated for
+  double radius = 0.0;
+};
+
+// View of the 2D Mandelbrot set that can zoom far beyond float precision.
+// The center is kept in arbitrary precision and iterated on a worker thread,
+// the shader only iterates each pixel's float difference to that orbit.
+class DeepZoom {
+public:
+  // Points per row of the orbit texture
+  static constexpr int ORBIT_WIDTH = 1024;
+  // Escape radius squared, large for a smooth distance estimate
+  static constexpr double BAILOUT = 256.0 * 256.0;
+  // Deepest zoom, float deltas of neighbouring pixels must stay normal
+  static constexpr double MIN_SCALE = 1e-34;
+  static constexpr double MAX_SCALE = 2.0;
+
+  DeepZoom();
+  ~DeepZoom();
+
+  // Back to the whole set, drops any orbit being computed
+  void reset();
+  // Moves the center by (dx, dy) view half heights
+  void pan(double dx, double dy);
+  // Scales the view by factor, keeping (x, y) (in view half heights from the
+  // center) in place
+  void zoom(double x, double y, double factor);
+
+  const DeepZoomView &getView() const;
+  // Iteration limit, grows with the zoom depth
+  int getIterations() const;
+  // Center of the current view relative to view's, in units of view's scale
+  glm::dvec2 offsetFrom(const DeepZoomView &view) const;
+  // Whether the view drifted too far from the orbit it is drawn with
+  bool isStale(const DeepZoomOrbit &orbit) const;
+
+  // Starts computing the orbit of the current view, unless one is running
+  // @param aspect Width over height of the viewport
+  void requestOrbit(double aspect);
+  // Moves the newest finished orbit into orbit
+  // @returns false if none finished since the last call
+  bool takeOrbit(DeepZoomOrbit &orbit);
+
+private:
+  // Iterates the reference orbit and its series approximation
+  void computeOrbit(DeepZoomOrbit orbit);
+  // Waits for the worker, if any
+  void joinWorker();
+
+  DeepZoomView m_view;
+
+  std::thread m_worker;
+  std::atomic<bool> m_working = false;
+  std::atomic<bool> m_cancel = false;
+  std::mutex m_mutex;
+  DeepZoomOrbit m_result;
+  bool m_resultReady = false;
+};
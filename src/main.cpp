@@ -1,4 +1,5 @@
 #include "mainwindow.h"
+#include "utils/sceneparser.h"
 
 #include <QApplication>
 #include <QScreen>
@@ -6,6 +7,20 @@
 #include <iostream>
 
 int main(int argc, char *argv[]) {
+  // Compile a scene file instead of opening the window
+  // - usage: --compile-scene <scene.json> <scene.scenebin>
+  // - needs no display, so it runs before a QApplication is created
+  if (argc > 1 && std::string(argv[1]) == "--compile-scene") {
+    QCoreApplication a(argc, argv);
+    if (argc != 4) {
+      std::cout << "usage: " << argv[0]
+                << " --compile-scene <scene.json> <scene.scenebin>"
+                << std::endl;
+      return 1;
+    }
+    return SceneParser::compile(argv[2], argv[3]) ? 0 : 1;
+  }
+
   QApplication a(argc, argv);
 
   QCoreApplication::setApplicationName("Raymarching");
@@ -64,6 +64,13 @@ void MainWindow::initialize() {
   th_label->setText("Terrain Height");
   QLabel *ts_label = new QLabel();
   ts_label->setText("Terrain Scale");
+  QLabel *bounce_label = new QLabel();
+  bounce_label->setText("Max Bounces");
+  QLabel *area_label = new QLabel();
+  area_label->setText("Area Light Samples");
+  QLabel *perf_label = new QLabel();
+  perf_label->setText("Performance Options");
+  perf_label->setFont(font);
 
   softShadow = new QCheckBox();
   softShadow->setText(QStringLiteral("Soft Shadow"));
@@ -81,10 +88,84 @@ void MainWindow::initialize() {
   ambientOcculusion->setText(QStringLiteral("Ambient Occulusion"));
   ambientOcculusion->setChecked(false);
 
+  // - index matches AO_SDF / AO_SCREEN_SPACE
+  aoOption = new QComboBox();
+  aoOption->addItem("SDF AO");
+  aoOption->addItem("Screen-space AO");
+  aoOption->setCurrentIndex(0);
+
   fxaa = new QCheckBox();
   fxaa->setText(QStringLiteral("FXAA"));
   fxaa->setChecked(false);
 
+  adaptiveEpsilon = new QCheckBox();
+  adaptiveEpsilon->setText(QStringLiteral("Adaptive Epsilon"));
+  adaptiveEpsilon->setChecked(true);
+
+  relaxedTracing = new QCheckBox();
+  relaxedTracing->setText(QStringLiteral("Relaxed Tracing"));
+  relaxedTracing->setChecked(false);
+
+  depthPrepass = new QCheckBox();
+  depthPrepass->setText(QStringLiteral("Depth Pre-pass"));
+  depthPrepass->setChecked(true);
+
+  temporalReprojection = new QCheckBox();
+  temporalReprojection->setText(QStringLiteral("Temporal Reprojection"));
+  temporalReprojection->setChecked(true);
+
+  tileCulling = new QCheckBox();
+  tileCulling->setText(QStringLiteral("Tile Culling"));
+  tileCulling->setChecked(true);
+
+  shadowCulling = new QCheckBox();
+  shadowCulling->setText(QStringLiteral("Shadow Culling"));
+  shadowCulling->setChecked(true);
+
+  noiseVolume = new QCheckBox();
+  noiseVolume->setText(QStringLiteral("Noise Volume"));
+  noiseVolume->setChecked(true);
+
+  terrainBake = new QCheckBox();
+  terrainBake->setText(QStringLiteral("Terrain Bake"));
+  terrainBake->setChecked(true);
+
+  cloudBuffer = new QCheckBox();
+  cloudBuffer->setText(QStringLiteral("Cloud Buffer"));
+  cloudBuffer->setChecked(true);
+
+  skyCubemap = new QCheckBox();
+  skyCubemap->setText(QStringLiteral("Sky Cubemap"));
+  skyCubemap->setChecked(true);
+
+  halfResSecondary = new QCheckBox();
+  halfResSecondary->setText(QStringLiteral("Half-res Secondary"));
+  halfResSecondary->setChecked(true);
+
+  areaShadowReuse = new QCheckBox();
+  areaShadowReuse->setText(QStringLiteral("Area Shadow Reuse"));
+  areaShadowReuse->setChecked(true);
+
+  fractalLOD = new QCheckBox();
+  fractalLOD->setText(QStringLiteral("Fractal LOD"));
+  fractalLOD->setChecked(true);
+
+  adaptiveOctaves = new QCheckBox();
+  adaptiveOctaves->setText(QStringLiteral("Adaptive Octaves"));
+  adaptiveOctaves->setChecked(true);
+
+  deepZoom = new QCheckBox();
+  deepZoom->setText(QStringLiteral("Deep Zoom"));
+  deepZoom->setChecked(true);
+
+  fractalCache = new QCheckBox();
+  fractalCache->setText(QStringLiteral("Fractal Cache"));
+  fractalCache->setChecked(true);
+
+  computeShader = new QCheckBox();
+  computeShader->setText(QStringLiteral("Compute Shader"));
+  computeShader->setChecked(false);
+
   skyboxOption = new QComboBox();
   skyboxOption->addItem("None");
   skyboxOption->addItem("Beach");
@@ -145,7 +226,7 @@ void MainWindow::initialize() {
   octaveBox->setMinimum(1);
   octaveBox->setMaximum(15);
   octaveBox->setSingleStep(1);
-  octaveBox->setValue(8);
+  octaveBox->setValue(9);
 
   terrainH = new QDoubleSpinBox();
   terrainH->setMinimum(0);
@@ -159,6 +240,18 @@ void MainWindow::initialize() {
   terrainS->setSingleStep(0.25);
   terrainS->setValue(2.75);
 
+  maxBounces = new QDoubleSpinBox();
+  maxBounces->setMinimum(0);
+  maxBounces->setMaximum(8);
+  maxBounces->setSingleStep(1);
+  maxBounces->setValue(1);
+
+  areaSamples = new QDoubleSpinBox();
+  areaSamples->setMinimum(1);
+  areaSamples->setMaximum(16);
+  areaSamples->setSingleStep(1);
+  areaSamples->setValue(1);
+
   QGroupBox *nearLayout = new QGroupBox(); // horizonal near slider alignment
   QHBoxLayout *lnear = new QHBoxLayout();
   QGroupBox *farLayout = new QGroupBox(); // horizonal far slider alignment
@@ -168,6 +261,8 @@ void MainWindow::initialize() {
   QHBoxLayout *octLayout = new QHBoxLayout();
   QHBoxLayout *terrainHL = new QHBoxLayout();
   QHBoxLayout *terrainSL = new QHBoxLayout();
+  QHBoxLayout *bounceLayout = new QHBoxLayout();
+  QHBoxLayout *areaLayout = new QHBoxLayout();
 
   // Adds the slider and number box to the parameter layouts
   lnear->addWidget(near_label);
@@ -193,6 +288,12 @@ void MainWindow::initialize() {
   terrainSL->addWidget(ts_label);
   terrainSL->addWidget(terrainS);
 
+  bounceLayout->addWidget(bounce_label);
+  bounceLayout->addWidget(maxBounces);
+
+  areaLayout->addWidget(area_label);
+  areaLayout->addWidget(areaSamples);
+
   vLayout->addWidget(uploadFile);
   vLayout->addWidget(saveImage);
   vLayout->addWidget(camera_label);
@@ -202,7 +303,10 @@ void MainWindow::initialize() {
   vLayout->addWidget(softShadow);
   vLayout->addWidget(reflection);
   vLayout->addWidget(refraction);
+  vLayout->addLayout(bounceLayout);
+  vLayout->addLayout(areaLayout);
   vLayout->addWidget(ambientOcculusion);
+  vLayout->addWidget(aoOption);
   vLayout->addWidget(skybox_label);
   vLayout->addWidget(skyboxOption);
   vLayout->addWidget(postproc_option_label);
@@ -218,6 +322,24 @@ void MainWindow::initialize() {
   vLayout->addLayout(terrainHL);
   vLayout->addLayout(terrainSL);
   vLayout->addLayout(octLayout);
+  vLayout->addWidget(perf_label);
+  vLayout->addWidget(adaptiveEpsilon);
+  vLayout->addWidget(relaxedTracing);
+  vLayout->addWidget(depthPrepass);
+  vLayout->addWidget(temporalReprojection);
+  vLayout->addWidget(tileCulling);
+  vLayout->addWidget(shadowCulling);
+  vLayout->addWidget(noiseVolume);
+  vLayout->addWidget(terrainBake);
+  vLayout->addWidget(cloudBuffer);
+  vLayout->addWidget(skyCubemap);
+  vLayout->addWidget(halfResSecondary);
+  vLayout->addWidget(areaShadowReuse);
+  vLayout->addWidget(fractalLOD);
+  vLayout->addWidget(adaptiveOctaves);
+  vLayout->addWidget(deepZoom);
+  vLayout->addWidget(fractalCache);
+  vLayout->addWidget(computeShader);
 
   connectUIElements();
 
@@ -243,6 +365,7 @@ void MainWindow::connectUIElements() {
   connectReflection();
   connectRefraction();
   connectAmbientOcculusion();
+  connectAOMethod();
   connectFXAA();
   connectSkyBox();
   connectDispOption();
@@ -253,6 +376,25 @@ void MainWindow::connectUIElements() {
   connectOctave();
   connectTerrainH();
   connectTerrainS();
+  connectMaxBounces();
+  connectAreaSamples();
+  connectAdaptiveEpsilon();
+  connectRelaxedTracing();
+  connectDepthPrepass();
+  connectTemporalReprojection();
+  connectTileCulling();
+  connectShadowCulling();
+  connectNoiseVolume();
+  connectTerrainBake();
+  connectCloudBuffer();
+  connectSkyCubemap();
+  connectHalfResSecondary();
+  connectAreaShadowReuse();
+  connectFractalLOD();
+  connectAdaptiveOctaves();
+  connectDeepZoom();
+  connectFractalCache();
+  connectComputeShader();
 }
 
 void MainWindow::connectUploadFile() {
@@ -298,6 +440,11 @@ void MainWindow::connectAmbientOcculusion() {
           &MainWindow::onAmbientOcculusion);
 }
 
+void MainWindow::connectAOMethod() {
+  connect(aoOption, &QComboBox::currentIndexChanged, this,
+          &MainWindow::onAOMethod);
+}
+
 void MainWindow::connectFXAA() {
   connect(fxaa, &QCheckBox::clicked, this, &MainWindow::onFXAA);
 }
@@ -352,12 +499,103 @@ void MainWindow::connectTerrainS() {
           this, &MainWindow::onTerrainS);
 }
 
+void MainWindow::connectMaxBounces() {
+  connect(maxBounces,
+          static_cast<void (QDoubleSpinBox::*)(double)>(
+              &QDoubleSpinBox::valueChanged),
+          this, &MainWindow::onMaxBounces);
+}
+
+void MainWindow::connectAreaSamples() {
+  connect(areaSamples,
+          static_cast<void (QDoubleSpinBox::*)(double)>(
+              &QDoubleSpinBox::valueChanged),
+          this, &MainWindow::onAreaSamples);
+}
+
+void MainWindow::connectAdaptiveEpsilon() {
+  connect(adaptiveEpsilon, &QCheckBox::clicked, this,
+          &MainWindow::onAdaptiveEpsilon);
+}
+
+void MainWindow::connectRelaxedTracing() {
+  connect(relaxedTracing, &QCheckBox::clicked, this,
+          &MainWindow::onRelaxedTracing);
+}
+
+void MainWindow::connectDepthPrepass() {
+  connect(depthPrepass, &QCheckBox::clicked, this,
+          &MainWindow::onDepthPrepass);
+}
+
+void MainWindow::connectTemporalReprojection() {
+  connect(temporalReprojection, &QCheckBox::clicked, this,
+          &MainWindow::onTemporalReprojection);
+}
+
+void MainWindow::connectTileCulling() {
+  connect(tileCulling, &QCheckBox::clicked, this, &MainWindow::onTileCulling);
+}
+
+void MainWindow::connectShadowCulling() {
+  connect(shadowCulling, &QCheckBox::clicked, this,
+          &MainWindow::onShadowCulling);
+}
+
+void MainWindow::connectNoiseVolume() {
+  connect(noiseVolume, &QCheckBox::clicked, this, &MainWindow::onNoiseVolume);
+}
+
+void MainWindow::connectTerrainBake() {
+  connect(terrainBake, &QCheckBox::clicked, this, &MainWindow::onTerrainBake);
+}
+
+void MainWindow::connectCloudBuffer() {
+  connect(cloudBuffer, &QCheckBox::clicked, this, &MainWindow::onCloudBuffer);
+}
+
+void MainWindow::connectSkyCubemap() {
+  connect(skyCubemap, &QCheckBox::clicked, this, &MainWindow::onSkyCubemap);
+}
+
+void MainWindow::connectHalfResSecondary() {
+  connect(halfResSecondary, &QCheckBox::clicked, this,
+          &MainWindow::onHalfResSecondary);
+}
+
+void MainWindow::connectAreaShadowReuse() {
+  connect(areaShadowReuse, &QCheckBox::clicked, this,
+          &MainWindow::onAreaShadowReuse);
+}
+
+void MainWindow::connectFractalLOD() {
+  connect(fractalLOD, &QCheckBox::clicked, this, &MainWindow::onFractalLOD);
+}
+
+void MainWindow::connectAdaptiveOctaves() {
+  connect(adaptiveOctaves, &QCheckBox::clicked, this,
+          &MainWindow::onAdaptiveOctaves);
+}
+
+void MainWindow::connectDeepZoom() {
+  connect(deepZoom, &QCheckBox::clicked, this, &MainWindow::onDeepZoom);
+}
+
+void MainWindow::connectFractalCache() {
+  connect(fractalCache, &QCheckBox::clicked, this, &MainWindow::onFractalCache);
+}
+
+void MainWindow::connectComputeShader() {
+  connect(computeShader, &QCheckBox::clicked, this,
+          &MainWindow::onComputeShader);
+}
+
 void MainWindow::onUploadFile() {
   // Get abs path of scene file
   QString configFilePath = QFileDialog::getOpenFileName(
       this, tr("Upload File"),
       QDir::currentPath().append(QDir::separator()).append("scenefiles"),
-      tr("Scene Files (*.json)"));
+      tr("Scene Files (*.json *.scenebin)"));
   if (configFilePath.isNull()) {
     std::cout << "Failed to load null scenefile." << std::endl;
     return;
@@ -433,6 +671,11 @@ void MainWindow::onAmbientOcculusion() {
   realtime->settingsChanged();
 }
 
+void MainWindow::onAOMethod(int idx) {
+  settings.aoMethod = idx;
+  realtime->settingsChanged();
+}
+
 void MainWindow::onFXAA() {
   settings.enableFXAA = !settings.enableFXAA;
   realtime->settingsChanged();
@@ -518,3 +761,98 @@ void MainWindow::onTerrainS(double newValue) {
   settings.terrainS = newValue;
   realtime->settingsChanged();
 }
+
+void MainWindow::onMaxBounces(double newValue) {
+  settings.maxBounces = newValue;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onAreaSamples(double newValue) {
+  settings.areaLightSamples = newValue;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onAdaptiveEpsilon() {
+  settings.enableAdaptiveEpsilon = !settings.enableAdaptiveEpsilon;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onRelaxedTracing() {
+  settings.enableRelaxedTracing = !settings.enableRelaxedTracing;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onDepthPrepass() {
+  settings.enableDepthPrepass = !settings.enableDepthPrepass;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onTemporalReprojection() {
+  settings.enableTemporalReprojection = !settings.enableTemporalReprojection;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onTileCulling() {
+  settings.enableTileCulling = !settings.enableTileCulling;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onShadowCulling() {
+  settings.enableShadowCulling = !settings.enableShadowCulling;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onNoiseVolume() {
+  settings.enableNoiseVolume = !settings.enableNoiseVolume;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onTerrainBake() {
+  settings.enableTerrainBake = !settings.enableTerrainBake;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onCloudBuffer() {
+  settings.enableCloudBuffer = !settings.enableCloudBuffer;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onSkyCubemap() {
+  settings.enableSkyCubemap = !settings.enableSkyCubemap;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onHalfResSecondary() {
+  settings.enableHalfResSecondary = !settings.enableHalfResSecondary;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onAreaShadowReuse() {
+  settings.enableAreaShadowReuse = !settings.enableAreaShadowReuse;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onFractalLOD() {
+  settings.enableFractalLOD = !settings.enableFractalLOD;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onAdaptiveOctaves() {
+  settings.enableAdaptiveOctaves = !settings.enableAdaptiveOctaves;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onDeepZoom() {
+  settings.enableDeepZoom = !settings.enableDeepZoom;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onFractalCache() {
+  settings.enableFractalCache = !settings.enableFractalCache;
+  realtime->settingsChanged();
+}
+
+void MainWindow::onComputeShader() {
+  settings.enableComputeShader = !settings.enableComputeShader;
+  realtime->settingsChanged();
+}
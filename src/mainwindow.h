@@ -25,6 +25,7 @@ private:
   void connectReflection();
   void connectRefraction();
   void connectAmbientOcculusion();
+  void connectAOMethod();
   void connectFXAA();
   void connectSkyBox();
   void connectFractal();
@@ -37,6 +38,25 @@ private:
   void connectOctave();
   void connectTerrainH();
   void connectTerrainS();
+  void connectMaxBounces();
+  void connectAreaSamples();
+  void connectAdaptiveEpsilon();
+  void connectRelaxedTracing();
+  void connectDepthPrepass();
+  void connectTemporalReprojection();
+  void connectTileCulling();
+  void connectShadowCulling();
+  void connectNoiseVolume();
+  void connectTerrainBake();
+  void connectCloudBuffer();
+  void connectSkyCubemap();
+  void connectHalfResSecondary();
+  void connectAreaShadowReuse();
+  void connectFractalLOD();
+  void connectAdaptiveOctaves();
+  void connectDeepZoom();
+  void connectFractalCache();
+  void connectComputeShader();
 
   Realtime *realtime;
   AspectRatioWidget *aspectRatioWidget;
@@ -51,12 +71,32 @@ private:
   QDoubleSpinBox *octaveBox;
   QDoubleSpinBox *terrainH;
   QDoubleSpinBox *terrainS;
+  QDoubleSpinBox *maxBounces;
+  QDoubleSpinBox *areaSamples;
 
   QCheckBox *softShadow;
   QCheckBox *reflection;
   QCheckBox *refraction;
   QCheckBox *ambientOcculusion;
+  QComboBox *aoOption;
   QCheckBox *fxaa;
+  QCheckBox *adaptiveEpsilon;
+  QCheckBox *relaxedTracing;
+  QCheckBox *depthPrepass;
+  QCheckBox *temporalReprojection;
+  QCheckBox *tileCulling;
+  QCheckBox *shadowCulling;
+  QCheckBox *noiseVolume;
+  QCheckBox *terrainBake;
+  QCheckBox *cloudBuffer;
+  QCheckBox *skyCubemap;
+  QCheckBox *halfResSecondary;
+  QCheckBox *areaShadowReuse;
+  QCheckBox *fractalLOD;
+  QCheckBox *adaptiveOctaves;
+  QCheckBox *deepZoom;
+  QCheckBox *fractalCache;
+  QCheckBox *computeShader;
   QComboBox *skyboxOption;
   QComboBox *lightOption;
   QComboBox *fractalOption;
@@ -70,6 +110,7 @@ private slots:
   void onReflection();
   void onRefraction();
   void onAmbientOcculusion();
+  void onAOMethod(int idx);
   void onFXAA();
   void onSkyBox(int idx);
   void onDispOption(int idx);
@@ -80,4 +121,23 @@ private slots:
   void onOctave(double newValue);
   void onTerrainH(double newValue);
   void onTerrainS(double newValue);
+  void onMaxBounces(double newValue);
+  void onAreaSamples(double newValue);
+  void onAdaptiveEpsilon();
+  void onRelaxedTracing();
+  void onDepthPrepass();
+  void onTemporalReprojection();
+  void onTileCulling();
+  void onShadowCulling();
+  void onNoiseVolume();
+  void onTerrainBake();
+  void onCloudBuffer();
+  void onSkyCubemap();
+  void onHalfResSecondary();
+  void onAreaShadowReuse();
+  void onFractalLOD();
+  void onAdaptiveOctaves();
+  void onDeepZoom();
+  void onFractalCache();
+  void onComputeShader();
 };
@@ -43,6 +43,14 @@ struct RayMarchObj {
   // - we need this idx for shadow
   int m_lightIdx = -1;
   glm::vec4 m_color = glm::vec4(0.f);
+
+  // Relaxed sphere tracing
+  // - step scale used when this object is the closest one
+  float m_relaxation = 1.f;
+
+  // Bounding sphere in world space (center, radius)
+  // - radius < 0 if the object is unbounded (fractals, custom SDFs)
+  glm::vec4 m_bounds = glm::vec4(0.f, 0.f, 0.f, -1.f);
 };
 
 #endif // RAYMARCHOBJ_H
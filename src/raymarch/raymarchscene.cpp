@@ -1,10 +1,80 @@
 #include "raymarchscene.h"
 #include "utils/sceneparser.h"
+#include <QFileInfo>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
 #include <random>
 
+// Relaxed sphere tracing
+// - default over-relaxation when the scene file does not set one
+#define DEFAULT_RELAXATION 1.6f
+
+namespace {
+/**
+ * @brief Compares the global coefficients of two scenes
+ */
+bool sameGlobals(const SceneGlobalData &a, const SceneGlobalData &b) {
+  return a.ka == b.ka && a.kd == b.kd && a.ks == b.ks && a.kt == b.kt &&
+         a.relaxation == b.relaxation;
+}
+
+/**
+ * @brief Whether a texture file was saved over since it was decoded
+ */
+bool textureFileChanged(const TextureInfo &texture, const std::string &file) {
+  QFileInfo info(QString::fromStdString(file));
+  return info.lastModified() != texture.modified ||
+         info.size() != texture.fileSize;
+}
+
+/**
+ * @brief Compares two texture or bump maps
+ */
+bool sameFileMap(const SceneFileMap &a, const SceneFileMap &b) {
+  return a.isUsed == b.isUsed && a.filename == b.filename &&
+         a.repeatU == b.repeatU && a.repeatV == b.repeatV;
+}
+
+/**
+ * @brief Compares everything the shaders see of two objects
+ */
+bool sameObject(const RayMarchObj &a, const RayMarchObj &b) {
+  const SceneMaterial &ma = a.m_material;
+  const SceneMaterial &mb = b.m_material;
+  return a.m_type == b.m_type && a.m_ctm == b.m_ctm &&
+         a.m_scale == b.m_scale && a.m_isEmissive == b.m_isEmissive &&
+         a.m_lightIdx == b.m_lightIdx && a.m_color == b.m_color &&
+         a.m_relaxation == b.m_relaxation && ma.cAmbient == mb.cAmbient &&
+         ma.cDiffuse == mb.cDiffuse && ma.cSpecular == mb.cSpecular &&
+         ma.shininess == mb.shininess && ma.cReflective == mb.cReflective &&
+         ma.cTransparent == mb.cTransparent && ma.ior == mb.ior &&
+         sameFileMap(ma.textureMap, mb.textureMap) && ma.blend == mb.blend &&
+         ma.cEmissive == mb.cEmissive && sameFileMap(ma.bumpMap, mb.bumpMap);
+}
+
+/**
+ * @brief Compares two lights
+ */
+bool sameLight(const SceneLightData &a, const SceneLightData &b) {
+  return a.id == b.id && a.type == b.type && a.color == b.color &&
+         a.function == b.function && a.pos == b.pos && a.dir == b.dir &&
+         a.penumbra == b.penumbra && a.angle == b.angle &&
+         a.width == b.width && a.height == b.height && a.ctm == b.ctm &&
+         a.intensity == b.intensity;
+}
+} // namespace
+
+/**
+ * @brief Checks whether a reload changed anything
+ * @returns True if nothing changed
+ */
+bool SceneDiff::empty() const {
+  return changedShapes == 0 && changedLights == 0 && !changedGlobals &&
+         !resized && addedTextures == 0 && removedTextures == 0 &&
+         editedTextures.empty();
+}
+
 /**
  * @brief Gets the shapes in the scene
  * @returns vector containing RealTimeShapes
@@ -116,8 +186,86 @@ void RayMarchScene::initScene(Settings &from, bool &isAreaLightUsed) {
   //-  Camera
   m_camera.initializeCamera(rd.cameraData, from);
   // - Shapes
+  m_textures.clear();
   initRayMarchObjs(m_textures, rd.shapes);
   // - Lights
+  initLights(rd, isAreaLightUsed);
+}
+
+/**
+ * @brief Re-reads the scene file after it was edited
+ * - the camera stays where the user moved it
+ * - textures are only decoded for files that were not used before, or
+ *   whose modification time or size changed
+ * - objects and lights are compared in file order, an edit that adds or
+ *   removes one shifts everything after it
+ * @param from Latest settings
+ * @param isAreaLightUsed Set to whether the new scene has area lights
+ * @param diff On return, what changed
+ * @returns False if the file could not be parsed (the scene is kept)
+ */
+bool RayMarchScene::reloadScene(Settings &from, bool &isAreaLightUsed,
+                                SceneDiff &diff) {
+  RenderData rd;
+  if (!SceneParser::parse(from.sceneFilePath, rd)) {
+    return false;
+  }
+  std::vector<RayMarchObj> prevShapes = std::move(m_shapes);
+  std::vector<SceneLightData> prevLights = std::move(m_lights);
+  std::map<std::string, TextureInfo> prevTextures = std::move(m_textures);
+
+  // Keep the decoded textures that are still used and were not saved over
+  m_textures.clear();
+  for (const RenderShapeData &shapeData : rd.shapes) {
+    const SceneFileMap &map = shapeData.primitive.material.textureMap;
+    if (!map.isUsed || !prevTextures.contains(map.filename)) {
+      continue;
+    }
+    if (textureFileChanged(prevTextures.at(map.filename), map.filename)) {
+      diff.editedTextures.push_back(map.filename);
+      prevTextures.erase(map.filename);
+    } else {
+      m_textures.insert(prevTextures.extract(map.filename));
+    }
+  }
+  size_t keptTextures = m_textures.size();
+  diff.removedTextures = prevTextures.size();
+
+  // Construct our scene
+  // - a different relaxation bound changes every object
+  bool relaxationChanged = rd.globalData.relaxation != m_globalData.relaxation;
+  diff.changedGlobals = !sameGlobals(rd.globalData, m_globalData);
+  m_globalData = rd.globalData;
+  initRayMarchObjs(m_textures, rd.shapes);
+  initLights(rd, isAreaLightUsed);
+  diff.addedTextures = m_textures.size() - keptTextures;
+  for (const std::string &file : diff.editedTextures) {
+    diff.addedTextures -= m_textures.contains(file);
+  }
+
+  diff.resized = prevShapes.size() != m_shapes.size() ||
+                 prevLights.size() != m_lights.size();
+  for (size_t i = 0; i < m_shapes.size(); i++) {
+    if (relaxationChanged || i >= prevShapes.size() ||
+        !sameObject(prevShapes[i], m_shapes[i])) {
+      diff.changedShapes++;
+    }
+  }
+  for (size_t i = 0; i < m_lights.size(); i++) {
+    if (i >= prevLights.size() || !sameLight(prevLights[i], m_lights[i])) {
+      diff.changedLights++;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Sets the lights of the scene
+ * - area lights are also drawn, as emissive rectangles after the objects
+ * @param rd Parsed scene
+ * @param isAreaLightUsed Set to whether the scene has area lights
+ */
+void RayMarchScene::initLights(const RenderData &rd, bool &isAreaLightUsed) {
   m_lights = rd.lights;
   isAreaLightUsed = rd.isAreaLightUsed;
   if (!rd.isAreaLightUsed) {
@@ -125,11 +273,15 @@ void RayMarchScene::initScene(Settings &from, bool &isAreaLightUsed) {
   }
   // We need to render area lights too
   for (int i = 0; i < rd.lights.size(); i++) {
-    SceneLightData &lightData = rd.lights[i];
+    const SceneLightData &lightData = rd.lights[i];
     if (lightData.type != LightType::LIGHT_AREA)
       continue;
     m_shapes.emplace_back(m_shapes.size(), PrimitiveType::PRIMITIVE_RECTANGLE,
                           lightData.ctm, lightData.color, i);
+    m_shapes.back().m_relaxation =
+        getRelaxation(PrimitiveType::PRIMITIVE_RECTANGLE);
+    m_shapes.back().m_bounds =
+        getBounds(PrimitiveType::PRIMITIVE_RECTANGLE, lightData.ctm);
   }
 }
 
@@ -162,7 +314,7 @@ void RayMarchScene::resetCamera() { m_camera = Camera{}; };
 
 /**
  * @brief Initializes our Raymarch objs
- * @param textureMap Texture Map that we want to populate
+ * @param textureMap Texture Map that we want to add to
  *        - a map from file name to TextureInfo struct with texture data
  * @param rd RenderShapeData with which we initialize our Raymarch objs
  */
@@ -170,7 +322,7 @@ void RayMarchScene::initRayMarchObjs(
     std::map<std::string, TextureInfo> &textureMap,
     std::vector<RenderShapeData> &rd) {
   // Clean slate
-  textureMap.clear();
+  // - textures already in textureMap are not loaded again
   m_shapes.clear();
   m_shapes.reserve(rd.size());
   int id = 0;
@@ -182,10 +334,81 @@ void RayMarchScene::initRayMarchObjs(
     }
     m_shapes.emplace_back(id, shapeData.primitive.type, shapeData.ctm,
                           shapeData.scale, shapeData.primitive.material);
+    m_shapes.back().m_relaxation = getRelaxation(shapeData.primitive.type);
+    m_shapes.back().m_bounds =
+        getBounds(shapeData.primitive.type, shapeData.ctm);
     id++;
   }
 }
 
+/**
+ * @brief Gets the over-relaxation factor for relaxed sphere tracing
+ * - the scene sets the upper bound ("relaxation" in globalData)
+ * - each type clamps it further, since fractal distance estimators are not
+ *   true bounds and overshoot thin features when relaxed
+ * @param type Type of the object
+ * @returns step scale in [1, 2)
+ */
+float RayMarchScene::getRelaxation(PrimitiveType type) const {
+  float relaxation = m_globalData.relaxation == 0.f ? DEFAULT_RELAXATION
+                                                    : m_globalData.relaxation;
+  switch (type) {
+  case PrimitiveType::MANDELBROT:
+  case PrimitiveType::MANDELBULB:
+  case PrimitiveType::SIERPINSKI:
+    return 1.f;
+  case PrimitiveType::MENGERSPONGE:
+  case PrimitiveType::CUSTOM:
+    return fmin(relaxation, 1.2f);
+  case PrimitiveType::PRIMITIVE_DEATHSTAR:
+    return fmin(relaxation, 1.4f);
+  default:
+    return relaxation;
+  }
+}
+
+/**
+ * @brief Gets the bounding sphere of an object for tile culling
+ * - radii are those of the unit primitives in sdMatch (raymarch.frag)
+ * - fractals and custom SDFs are animated or unbounded, so they are never
+ *   culled
+ * @param type Type of the object
+ * @param ctm Object to world transform
+ * @returns center and radius in world space (radius < 0 if unbounded)
+ */
+glm::vec4 RayMarchScene::getBounds(PrimitiveType type,
+                                   const glm::mat4 &ctm) const {
+  float radius;
+  switch (type) {
+  case PrimitiveType::PRIMITIVE_CUBE:
+    radius = 0.867f;
+    break;
+  case PrimitiveType::PRIMITIVE_CONE:
+  case PrimitiveType::PRIMITIVE_CYLINDER:
+  case PrimitiveType::PRIMITIVE_RECTANGLE:
+    radius = 0.708f;
+    break;
+  case PrimitiveType::PRIMITIVE_TORUS:
+    radius = 0.625f;
+    break;
+  case PrimitiveType::PRIMITIVE_CAPSULE:
+    radius = 0.6f;
+    break;
+  case PrimitiveType::PRIMITIVE_SPHERE:
+  case PrimitiveType::PRIMITIVE_OCTAHEDRON:
+  case PrimitiveType::PRIMITIVE_DEATHSTAR:
+    radius = 0.5f;
+    break;
+  default:
+    return glm::vec4(0.f, 0.f, 0.f, -1.f);
+  }
+  // Largest axis scale of the transform
+  float scale = fmax(glm::length(glm::vec3(ctm[0])),
+                     fmax(glm::length(glm::vec3(ctm[1])),
+                          glm::length(glm::vec3(ctm[2]))));
+  return glm::vec4(glm::vec3(ctm[3]), radius * scale);
+}
+
 /**
  * @brief Loads the texture given by "file" to our map
  * @param out Texture map we wish to populate
@@ -199,6 +422,11 @@ void RayMarchScene::loadTextureFromPrim(std::map<std::string, TextureInfo> &out,
     return;
   }
   // Load up
+  // - stat before decoding, so that a save during the load shows up as an
+  //   edit on the next reload
+  QFileInfo info(QString::fromStdString(file));
+  QDateTime modified = info.lastModified();
+  qint64 fileSize = info.size();
   QImage myImage;
   QString str(file.data());
   if (!myImage.load(str)) {
@@ -224,5 +452,7 @@ void RayMarchScene::loadTextureFromPrim(std::map<std::string, TextureInfo> &out,
       output,
       width,
       height,
+      modified,
+      fileSize,
   };
 }
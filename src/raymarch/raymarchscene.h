@@ -8,6 +8,27 @@
 #include <map>
 #include <string>
 #include <tuple>
+#include <vector>
+
+// What RayMarchScene::reloadScene changed
+struct SceneDiff {
+  // Objects whose type, transform or material changed
+  int changedShapes = 0;
+  // Lights that changed
+  int changedLights = 0;
+  // Whether the global coefficients (ka, kd, ks, kt, relaxation) changed
+  bool changedGlobals = false;
+  // Whether objects or lights were added or removed
+  bool resized = false;
+  // Texture files newly used (decoded) and no longer used
+  int addedTextures = 0;
+  int removedTextures = 0;
+  // Texture files still used that were saved over, and decoded again
+  std::vector<std::string> editedTextures;
+
+  // Returns True if nothing changed
+  bool empty() const;
+};
 
 struct RayMarchScene {
   // Struct that contains everything in the scene
@@ -18,6 +39,10 @@ public:
   // Initializes the Scene given a scene json file
   void initScene(Settings &from, bool &isAreaLightUsed);
 
+  // Re-reads the scene file, keeping the camera and the decoded textures
+  // that are still used
+  bool reloadScene(Settings &from, bool &isAreaLightUsed, SceneDiff &diff);
+
   // Resets scene
   void resetScene();
 
@@ -58,6 +83,15 @@ private:
   void initRayMarchObjs(std::map<std::string, TextureInfo> &textureMap,
                         std::vector<RenderShapeData> &rd);
 
+  // Sets the lights and adds an object for each area light
+  void initLights(const RenderData &rd, bool &isAreaLightUsed);
+
+  // Gets the over-relaxation factor for an object type in this scene
+  float getRelaxation(PrimitiveType type) const;
+
+  // Gets the world space bounding sphere of an object
+  glm::vec4 getBounds(PrimitiveType type, const glm::mat4 &ctm) const;
+
   // Loads texture if used
   void loadTextureFromPrim(std::map<std::string, TextureInfo> &out,
                            const std::string &file);
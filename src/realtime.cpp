@@ -2,8 +2,10 @@
 #include "settings.h"
 #include "utils/shaderloader.h"
 #include <QCoreApplication>
+#include <QFileInfo>
 #include <QKeyEvent>
 #include <QMouseEvent>
+#include <QWheelEvent>
 #include <iostream>
 
 Realtime::Realtime(QWidget *parent) : QOpenGLWidget(parent) {
@@ -17,6 +19,14 @@ Realtime::Realtime(QWidget *parent) : QOpenGLWidget(parent) {
   m_keyMap[Qt::Key_D] = false;
   m_keyMap[Qt::Key_Control] = false;
   m_keyMap[Qt::Key_Space] = false;
+
+  // Reload the scene once the editor is done saving it
+  m_sceneReloadTimer.setSingleShot(true);
+  m_sceneReloadTimer.setInterval(SCENE_RELOAD_DELAY);
+  connect(&m_sceneWatcher, &QFileSystemWatcher::fileChanged,
+          &m_sceneReloadTimer, qOverload<>(&QTimer::start));
+  connect(&m_sceneReloadTimer, &QTimer::timeout, this,
+          [this] { reloadScene(); });
 }
 
 /**
@@ -48,16 +58,28 @@ void Realtime::finish() {
   glDeleteTextures(1, &m_nullBloomBlurTexture);
   glDeleteTextures(1, &m_noiseTexture);
   glDeleteTextures(1, &m_blueNoiseTexture);
+  glDeleteTextures(1, &m_noiseVolumeTexture);
+  glDeleteTextures(1, &m_terrainTexture);
+  glDeleteFramebuffers(1, &m_terrainFBO);
+  glDeleteTextures(2, m_skyTexture);
+  glDeleteFramebuffers(1, &m_skyFBO);
+  glDeleteTextures(1, &m_deepZoomTexture);
 
   // Destroy FBO
   destroyCustomFBO();
 
   // Destroy Shaders
   glDeleteProgram(m_rayMarchShader);
-  glDeleteProgram(m_fxaaShader);
-  glDeleteProgram(m_lightOptionShader);
+  glDeleteProgram(m_postShader);
   glDeleteProgram(m_debugShader);
   glDeleteProgram(m_blurShader);
+  glDeleteProgram(m_maxMipShader);
+  glDeleteProgram(m_ssaoShader);
+  glDeleteProgram(m_aoCompositeShader);
+  if (m_computeMarchShader) {
+    glDeleteProgram(m_computeMarchShader);
+    glDeleteBuffers(1, &m_computeTileCounter);
+  }
 
   this->doneCurrent();
 }
@@ -81,7 +103,7 @@ void Realtime::initializeGL() {
   std::cout << "Initialized GL: Version " << glewGetString(GLEW_VERSION)
             << std::endl;
 
-  glEnable(GL_DEPTH_TEST);
+  // Every pass draws a fullscreen quad, so no depth buffer is needed
   glEnable(GL_CULL_FACE);
   // Set dimensions
   scene.m_width = size().width() * m_devicePixelRatio;
@@ -93,14 +115,19 @@ void Realtime::initializeGL() {
   // Load the shaders
   m_rayMarchShader = ShaderLoader::createShaderProgram(
       ":/resources/raymarch.vert", ":/resources/raymarch.frag");
-  m_fxaaShader = ShaderLoader::createShaderProgram(
-      ":/resources/fullscreen.vert", ":/resources/fxaa.frag");
-  m_lightOptionShader = ShaderLoader::createShaderProgram(
-      ":/resources/fullscreen.vert", ":/resources/hdr.frag");
+  m_postShader = ShaderLoader::createShaderProgram(
+      ":/resources/fullscreen.vert", ":/resources/post.frag");
   m_debugShader = ShaderLoader::createShaderProgram(
       ":/resources/fullscreen.vert", ":/resources/color.frag");
   m_blurShader = ShaderLoader::createShaderProgram(
       ":/resources/fullscreen.vert", ":/resources/blur.frag");
+  m_maxMipShader = ShaderLoader::createShaderProgram(
+      ":/resources/fullscreen.vert", ":/resources/maxmip.frag");
+  m_ssaoShader = ShaderLoader::createShaderProgram(
+      ":/resources/fullscreen.vert", ":/resources/ssao.frag");
+  m_aoCompositeShader = ShaderLoader::createShaderProgram(
+      ":/resources/fullscreen.vert", ":/resources/aocomposite.frag");
+  initComputeMarch();
 
   // Initialize the image plane through which we march rays
   initImagePlane();
@@ -108,6 +135,14 @@ void Realtime::initializeGL() {
   initFullScreenQuad();
   // Initialize any defaults
   initDefaults();
+  // Initialize the noise volume
+  initNoiseVolume();
+  // Initialize the terrain bake
+  initTerrainBake();
+  // Initialize the sky cubemaps
+  initSkyCubemap();
+  // Initialize the deep zoom orbit
+  initDeepZoom();
   // Initialize the custom FBO
   initCustomFBO();
   // Area Light Textures
@@ -119,6 +154,33 @@ void Realtime::initializeGL() {
   initShader();
 }
 
+/**
+ * @brief Compiles the compute version of the raymarch shader
+ * - main.cpp only asks for a 4.1 context, so the fragment shader stays the
+ *   fallback when 4.3 is not available or the shader fails to build
+ */
+void Realtime::initComputeMarch() {
+  if (!GLEW_VERSION_4_3) {
+    std::cout << "Compute Shader needs GL 4.3, using the fragment shader"
+              << std::endl;
+    return;
+  }
+  try {
+    m_computeMarchShader =
+        ShaderLoader::createComputeProgram(":/resources/raymarch.comp");
+  } catch (const std::runtime_error &e) {
+    std::cout << "Compute Shader failed, using the fragment shader: "
+              << e.what() << std::endl;
+    return;
+  }
+  // Tile counter of the persistent workgroups
+  glGenBuffers(1, &m_computeTileCounter);
+  glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, m_computeTileCounter);
+  glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(GLuint), nullptr,
+               GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+}
+
 /**
  * @brief Draws the scene
  */
@@ -126,6 +188,13 @@ void Realtime::paintGL() {
   if (!scene.isInitialized()) {
     return;
   }
+  // Qt (and saveViewportImage) bind their own framebuffer in between
+  m_glState.beginFrame();
+  // Profile the current view if requested
+  if (m_profileRequested) {
+    m_profileRequested = false;
+    profileScene();
+  }
   // Perform Raymarch and render the scene
   rayMarch();
 }
@@ -160,6 +229,7 @@ void Realtime::sceneChanged() {
   if (settings.reset) {
     scene.resetScene();
     settings.reset = false;
+    watchSceneFile();
     return;
   }
   // Initialize the Raymarch scene
@@ -170,6 +240,90 @@ void Realtime::sceneChanged() {
   m_juliaSeed = glm::vec2(0.f);
   // Update the dim
   m_twoDSpace = settings.twoDSpace;
+  // Hit distances of the old scene are meaningless
+  m_historyValid = false;
+  m_cloudHistoryValid = false;
+  m_areaHistoryValid = false;
+  m_aoHistoryValid = false;
+  // Back to the whole Mandelbrot set
+  m_deepZoom.reset();
+  m_deepZoomOrbitValid = false;
+  m_fractalCacheValid = false;
+  // Reload on save from now on
+  watchSceneFile();
+  update();
+}
+
+/**
+ * @brief Watches the file of the current scene, if there is one
+ */
+void Realtime::watchSceneFile() {
+  QStringList watched = m_sceneWatcher.files();
+  QString path = QString::fromStdString(settings.sceneFilePath);
+  if (!scene.isInitialized() || !QFileInfo::exists(path)) {
+    if (!watched.isEmpty()) {
+      m_sceneWatcher.removePaths(watched);
+    }
+    return;
+  }
+  if (watched.contains(path)) {
+    return;
+  }
+  if (!watched.isEmpty()) {
+    m_sceneWatcher.removePaths(watched);
+  }
+  m_sceneWatcher.addPath(path);
+}
+
+/**
+ * @brief Invoked when the scene file was saved
+ * - unlike sceneChanged, the camera and every GPU resource stay; only the
+ *   textures of newly used or edited files are created
+ * - object, light and global uniforms are set every frame anyway, the state
+ *   cache only lets the ones that changed through
+ */
+void Realtime::reloadScene() {
+  // Editors that save by replacing the file drop it from the watcher
+  watchSceneFile();
+  if (!scene.isInitialized()) {
+    return;
+  }
+  SceneDiff diff;
+  if (!scene.reloadScene(settings, m_isAreaLightUsed, diff)) {
+    std::cout << "Keeping the current scene" << std::endl;
+    return;
+  }
+  // The objects were rebuilt without texture IDs, hand them out again even
+  // if nothing changed (only new and edited files are uploaded)
+  makeCurrent();
+  if (!diff.editedTextures.empty()) {
+    for (const std::string &file : diff.editedTextures) {
+      if (auto search = m_TextureMap.find(file); search != m_TextureMap.end()) {
+        glDeleteTextures(1, &search->second);
+        m_TextureMap.erase(search);
+      }
+    }
+    // Deleted names get unbound and may be handed out again
+    m_glState.invalidate();
+  }
+  initShapesTextures();
+  doneCurrent();
+  if (diff.empty()) {
+    return;
+  }
+  // Hit distances and cached pixels of the old scene are meaningless
+  m_historyValid = false;
+  m_cloudHistoryValid = false;
+  m_areaHistoryValid = false;
+  m_aoHistoryValid = false;
+  m_fractalCacheValid = false;
+  std::cout << "Reloaded " << settings.sceneFilePath << ": "
+            << diff.changedShapes << " objects and " << diff.changedLights
+            << " lights changed, " << diff.addedTextures << " textures loaded, "
+            << diff.editedTextures.size() << " reloaded, "
+            << diff.removedTextures << " dropped"
+            << (diff.changedGlobals ? ", global coefficients changed" : "")
+            << std::endl;
   update();
 }
 
@@ -189,6 +343,11 @@ void Realtime::settingsChanged() {
 
 void Realtime::keyPressEvent(QKeyEvent *event) {
   m_keyMap[Qt::Key(event->key())] = true;
+  // P prints a performance profile of the current view
+  if (event->key() == Qt::Key_P && !event->isAutoRepeat()) {
+    m_profileRequested = true;
+    update();
+  }
 }
 
 void Realtime::keyReleaseEvent(QKeyEvent *event) {
@@ -224,6 +383,14 @@ void Realtime::mouseMoveEvent(QMouseEvent *event) {
       return;
     }
 
+    // Dragging moves the 2D view along with the cursor
+    if (deepZoom()) {
+      double pixel = 2.0 / size().height();
+      m_deepZoom.pan(-deltaX * pixel, deltaY * pixel);
+      update();
+      return;
+    }
+
     Camera &cam = scene.getCamera();
     cam.rotateX(deltaX);
     cam.rotateY(deltaY);
@@ -232,6 +399,18 @@ void Realtime::mouseMoveEvent(QMouseEvent *event) {
   }
 }
 
+void Realtime::wheelEvent(QWheelEvent *event) {
+  if (!scene.isInitialized() || !deepZoom()) {
+    return;
+  }
+  // Zooms about the cursor, 2x per notch
+  double pixel = 2.0 / size().height();
+  double x = (event->position().x() - size().width() / 2.0) * pixel;
+  double y = (size().height() / 2.0 - event->position().y()) * pixel;
+  m_deepZoom.zoom(x, y, std::pow(0.5, event->angleDelta().y() / 120.0));
+  update();
+}
+
 void Realtime::timerEvent(QTimerEvent *event) {
   int elapsedms = m_elapsedTimer.elapsed();
   float deltaTime = elapsedms * 0.001f;
@@ -271,6 +450,16 @@ void Realtime::timerEvent(QTimerEvent *event) {
     disp += cam.onControlPressed();
   }
 
+  // W and S zoom the 2D view in and out, 4x per second
+  if (deepZoom()) {
+    if (m_keyMap[Qt::Key_W]) {
+      m_deepZoom.zoom(0.0, 0.0, std::pow(0.25, deltaTime));
+    }
+    if (m_keyMap[Qt::Key_S]) {
+      m_deepZoom.zoom(0.0, 0.0, std::pow(4.0, deltaTime));
+    }
+  }
+
   // Check if moved
   if (glm::length(disp) != 0.f) {
     disp *= s;
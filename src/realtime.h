@@ -7,11 +7,15 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include "fractal/deepzoom.h"
 #include "raymarch/raymarchscene.h"
+#include "utils/glstatecache.h"
 #include <QElapsedTimer>
+#include <QFileSystemWatcher>
 #include <QOpenGLWidget>
 #include <QTime>
 #include <QTimer>
+#include <functional>
 #include <unordered_map>
 
 #define MAX_NUM_LIGHTS 10
@@ -24,7 +28,53 @@
 #define NOISE_TEX_UNIT_OFF 13
 #define BLUE_NOISE_TEX_UNIT_OFF 14
 #define CUSTOM_TEX_UNIT_OFF 15
+#define PREPASS_TEX_UNIT_OFF 18
+#define HISTORY_TEX_UNIT_OFF 19
+#define TILE_TEX_UNIT_OFF 20
+#define NOISE_VOLUME_TEX_UNIT_OFF 21
+#define TERRAIN_TEX_UNIT_OFF 22
+#define CLOUD_TEX_UNIT_OFF 23
+#define CLOUD_DEPTH_TEX_UNIT_OFF 24
+#define DAY_SKY_TEX_UNIT_OFF 25
+#define NIGHT_SKY_TEX_UNIT_OFF 26
+#define SECONDARY_TEX_UNIT_OFF 27
+#define SECONDARY_GBUFFER_TEX_UNIT_OFF 28
+#define AO_DEPTH_TEX_UNIT_OFF 29
+#define AO_GBUFFER_TEX_UNIT_OFF 30
+#define AO_TEX_UNIT_OFF 31
+#define AO_AMBIENT_TEX_UNIT_OFF 32
+#define AREA_HISTORY_TEX_UNIT_OFF 33
+#define DEEP_ZOOM_TEX_UNIT_OFF 34
+#define FRACTAL_TEX_UNIT_OFF 35
 #define BLOOM_BLUR_COUNT 10
+#define PROFILE_FRAMES 5
+#define PREPASS_SCALE 4
+#define TILE_SIZE 16
+#define LIGHT_CUTOFF (1.f / 1024.f)
+#define PASS_SHADE 0
+#define PASS_DEPTH 1
+#define PASS_TERRAIN 2
+#define PASS_CLOUD 3
+#define PASS_SKY 4
+#define PASS_SECONDARY 5
+#define PASS_FRACTAL 6
+#define TERRAIN_BAKE_SIZE 2048
+#define TERRAIN_BAKE_SPACING 4.f
+#define CLOUD_SCALE 2
+#define SKY_CUBEMAP_SIZE 512
+#define FRACTAL_CACHE_LEVELS 4
+#define FRACTAL_SHIFT_EPSILON 1e-3
+#define COMPUTE_TILE_SIZE 8
+#define COMPUTE_GROUPS 256
+#define SECONDARY_SCALE 2
+#define AO_SDF 0
+#define AO_SCREEN_SPACE 1
+#define AO_SCALE 2
+
+// Scene hot reload
+// - milliseconds to wait after the scene file changed, so that the editor
+//   has finished writing it
+#define SCENE_RELOAD_DELAY 100
 
 class Realtime : public QOpenGLWidget {
 public:
@@ -50,6 +100,7 @@ private:
   void mousePressEvent(QMouseEvent *event) override;
   void mouseReleaseEvent(QMouseEvent *event) override;
   void mouseMoveEvent(QMouseEvent *event) override;
+  void wheelEvent(QWheelEvent *event) override;
   void timerEvent(QTimerEvent *event) override;
 
   // Tick Related Variables
@@ -73,18 +124,31 @@ private:
 
   // RayMarch scene
   RayMarchScene scene;
+  // - reloads the scene file when it is saved
+  QFileSystemWatcher m_sceneWatcher;
+  QTimer m_sceneReloadTimer;
+
+  // GL State
+  // - binds and uniform writes of the renderer go through here, so the ones
+  //   that change nothing are skipped
+  GLStateCache m_glState;
 
   // Shader
   // - raymarch shader
   GLuint m_rayMarchShader;
-  // - fxaa shader
-  GLuint m_fxaaShader;
-  // - hdr shader
-  GLuint m_lightOptionShader;
+  // - post effects (HDR / gamma correction / bloom composite / FXAA)
+  GLuint m_postShader;
   // - debug shader
   GLuint m_debugShader;
   // - Bloom (blur shader)
   GLuint m_blurShader;
+  // - max height pyramid of the terrain bake
+  GLuint m_maxMipShader;
+  // - screen space ambient occlusion and its composite
+  GLuint m_ssaoShader;
+  GLuint m_aoCompositeShader;
+  // - compute version of the main pass, 0 without GL 4.3
+  GLuint m_computeMarchShader = 0;
 
   // Textures
   // - default material texture
@@ -102,8 +166,14 @@ private:
   GLuint m_nullCubeMapTexture;
   // - noise texture
   GLuint m_noiseTexture;
+  // - 3D noise volume (value + derivatives)
+  GLuint m_noiseVolumeTexture;
   // - blue noise texture
   GLuint m_blueNoiseTexture;
+  // - baked terrain heights, max height pyramid in the mips
+  GLuint m_terrainTexture;
+  // - baked procedural day and night skies
+  GLuint m_skyTexture[2];
   // - custom textures
   GLuint m_customTextures[3];
 
@@ -113,10 +183,49 @@ private:
   // - custom FBO
   GLuint m_customFBO;
   GLuint m_customFBOColorTexture;
-  GLuint m_customFBORenderBuffer;
   // - Bloom
   GLuint m_pingpongFBO[2];
   GLuint m_pingpongBuffer[2];
+  // - depth prepass (1 / PREPASS_SCALE resolution)
+  GLuint m_prepassFBO;
+  GLuint m_prepassTexture;
+  // - primary hit distances of this frame and the previous one
+  GLuint m_hitDepthTexture[2];
+  int m_hitDepthIdx = 0;
+  // - normals and ambient terms of the primary hits, for screen space AO
+  GLuint m_gBufferTexture;
+  GLuint m_ambientTexture;
+  // - screen space AO at 1 / AO_SCALE resolution, this frame's and the
+  //   previous one
+  GLuint m_aoFBO;
+  GLuint m_aoTexture[2];
+  int m_aoIdx = 0;
+  bool m_aoHistoryValid = false;
+  // - applies the AO to the color of the custom FBO
+  GLuint m_aoCompositeFBO;
+  // - area light visibility of this frame and the previous one
+  GLuint m_areaVisibilityTexture[2];
+  int m_areaVisibilityIdx = 0;
+  // - objects per TILE_SIZE x TILE_SIZE tile (bit i = object i)
+  GLuint m_tileTexture;
+  // - terrain bake
+  GLuint m_terrainFBO;
+  // - clouds at 1 / CLOUD_SCALE resolution, this frame's and the previous
+  GLuint m_cloudFBO;
+  GLuint m_cloudTexture[2];
+  GLuint m_cloudDepthTexture;
+  int m_cloudIdx = 0;
+  // - sky bake
+  GLuint m_skyFBO;
+  // - secondary rays at 1 / SECONDARY_SCALE resolution and the primary hits
+  //   they were traced from
+  GLuint m_secondaryFBO;
+  GLuint m_secondaryTexture;
+  GLuint m_secondaryGBufferTexture;
+  // - 2D fractal brightness per pixel, this frame's and the previous one
+  GLuint m_fractalFBO;
+  GLuint m_fractalTexture[2];
+  int m_fractalIdx = 0;
 
   // Image Plane through which we march rays
   GLuint m_imagePlaneVAO;
@@ -152,8 +261,14 @@ private:
   bool m_enableReflection;
   // - refraction
   bool m_enableRefraction;
+  // - reflection / refraction depth
+  int m_maxBounces = 1;
+  // - shadow rays per area light and pixel
+  int m_areaLightSamples = 1;
   // - ambient occulusion
   bool m_enableAmbientOcclusion;
+  // - AO_SDF or AO_SCREEN_SPACE
+  int m_aoMethod = AO_SDF;
   // - sky box
   int m_idxSkyBox;
   // Post Processing Effects
@@ -177,39 +292,199 @@ private:
   glm::vec2 m_juliaSeed = glm::vec2(0.f);
 
   // Procedural
+  // - [0, 1], drives the sun and the sky
+  float m_timeOfDay = 0.1f;
   float m_terrainH = 10.;
   float m_terrainS = 2.75;
-  int m_numOctaves = 8.;
+  int m_numOctaves = 9;
+
+  // Performance
+  // - hit threshold follows the pixel footprint
+  bool m_enableAdaptiveEpsilon = true;
+  // - over-relaxed sphere tracing
+  bool m_enableRelaxedTracing = false;
+  // - low resolution cone march that seeds the primary rays
+  bool m_enableDepthPrepass = true;
+  // - start rays near last frame's reprojected hit
+  bool m_enableTemporalReprojection = true;
+  // - camera of the frame stored in the hit history
+  bool m_historyValid = false;
+  glm::mat4 m_prevProjViewMatrix = glm::mat4(1.f);
+  glm::vec4 m_prevEyePosition = glm::vec4(0.f);
+  // - primary rays only march the objects binned into their tile
+  bool m_enableTileCulling = true;
+  // - shadow rays only march the objects that may block their light
+  bool m_enableShadowCulling = true;
+  // - sample fbm noise from the precomputed volume instead of hashing
+  bool m_enableNoiseVolume = true;
+  // - bake the terrain and skip over it using the max height pyramid
+  bool m_enableTerrainBake = true;
+  // - whether the shader renders terrain at all
+  bool m_terrainUsed = false;
+  // - region and inputs of the current bake
+  bool m_terrainBakeValid = false;
+  glm::vec2 m_terrainBakeOrigin = glm::vec2(0.f);
+  glm::vec4 m_terrainBakeKey = glm::vec4(0.f);
+  // - render clouds at low resolution and accumulate them over frames
+  bool m_enableCloudBuffer = true;
+  // - whether the shader renders clouds at all
+  bool m_cloudsUsed = false;
+  // - the other cloud buffer holds the previous frame's clouds
+  bool m_cloudHistoryValid = false;
+  // - frames rendered so far, varies the cloud jitter
+  int m_frameIndex = 0;
+  // - sample the sky from cubemaps baked once instead of per pixel
+  bool m_enableSkyCubemap = true;
+  // - whether the shader samples the sky at all
+  bool m_skyUsed = false;
+  // - time of day of the current sky bake
+  bool m_skyBakeValid = false;
+  float m_skyBakeTimeOfDay = 0.f;
+  // - trace reflections and refractions at low resolution and upsample them
+  bool m_enableHalfResSecondary = true;
+  // - accumulate area light visibility over frames
+  bool m_enableAreaShadowReuse = true;
+  // - the other visibility buffer holds the previous frame's
+  bool m_areaHistoryValid = false;
+  // - fewer fractal iterations where their detail is below a pixel
+  bool m_enableFractalLOD = true;
+  // - fewer fbm octaves for terrain, sea and clouds further away
+  bool m_enableAdaptiveOctaves = true;
+
+  // Deep Zoom
+  // - perturbation rendering of the 2D Mandelbrot set, panned and zoomed
+  //   with the mouse
+  bool m_enableDeepZoom = true;
+  DeepZoom m_deepZoom;
+  // - orbit in m_deepZoomTexture
+  DeepZoomOrbit m_deepZoomOrbit;
+  bool m_deepZoomOrbitValid = false;
+  GLuint m_deepZoomTexture;
+  // - keep the brightness of every pixel across frames, refine coarse to
+  //   fine after a zoom and only compute the strips a pan exposes
+  bool m_enableFractalCache = true;
+  // - the other cache holds the previous frame's pixels, of this view
+  bool m_fractalCacheValid = false;
+  DeepZoomView m_fractalCacheView;
+  // - offset of the refinement grid (see fractalCachePass)
+  glm::ivec2 m_fractalOrigin = glm::ivec2(0);
+
+  // Compute Shader
+  // - march the main pass in a compute shader (GL 4.3+), culling the objects
+  //   of each COMPUTE_TILE_SIZE tile in shared memory
+  bool m_enableComputeShader = false;
+  // - atomic counter the persistent workgroups take their tiles from
+  GLuint m_computeTileCounter;
+
+  // Profiling
+  // - set by the P key, consumed by the next paintGL
+  bool m_profileRequested = false;
+  // - output iteration counts instead of color
+  bool m_showStats = false;
 
   // PRIVATE METHODS
 
   // Performs raymarching using our raymarch shader
   void rayMarch();
-  // Applies FXAA post processing
-  void applyFXAA();
-  // Applies HDR post processing
-  void applyLightEffects();
+  // Sets the raymarch uniforms and draws the image plane into fbo
+  void marchScene(GLuint fbo);
+  // Sets the uniforms shared by every pass of a raymarch program
+  void configureMarchUniforms(GLuint shader);
+  // Marches the main pass into the custom FBO's textures in a compute shader
+  void dispatchMarch();
+  // Whether this frame's main pass is marched in the compute shader
+  bool computeMarch(GLuint fbo);
+  // Applies HDR / gamma correction / bloom and FXAA in one pass
+  void applyPostEffects();
   // Applies Bloom Post processing
   bool applyBloom();
+  // Darkens the ambient term of the custom FBO by screen space AO
+  void applyScreenSpaceAO();
+  // Whether this frame uses screen space AO
+  bool screenSpaceAO();
+  // Size of the screen space AO buffer
+  int aoWidth();
+  int aoHeight();
   // Draws to the fullsreen quad with given tex
   void drawToQuadWithTex(GLuint tex);
 
   // Initializes the shaders with constant uniforms
   void initShader();
+  // Points the samplers of a raymarch program to their texture units
+  void initMarchSamplers(GLuint shader);
+  // Compiles the compute raymarch shader, if the context supports it
+  void initComputeMarch();
   // Initializes all the default variables used in shader
   void initDefaults();
   // Initializes [-1,1] blank canvas to be used for raymarching
   void initImagePlane();
   // Initializes full screen quad
   void initFullScreenQuad();
-  // Initializes each and every material texture used in the scene
+  // Initializes the material textures used in the scene that do not have one
+  // yet
   void initShapesTextures();
+  // Watches the current scene file for changes
+  void watchSceneFile();
+  // Reloads the scene file after it changed
+  void reloadScene();
   // Initializes textures for custom scene
   void initCustomTextures();
   // Initializes our custom FBO for offline rendering
   void initCustomFBO();
+  // Keeps this frame's hit distances and camera for the next frame
+  void saveHitHistory();
+  // Keeps this frame's area light visibility for the next frame
+  void saveAreaHistory();
+  // Whether this frame accumulates area light visibility
+  bool areaShadowReuse();
+  // Copies the offline rendered image to the application window
+  void presentCustomFBO();
+  // Size of the depth prepass target
+  int prepassWidth();
+  int prepassHeight();
+  // Size of the cloud buffer
+  int cloudWidth();
+  int cloudHeight();
+  // Size of the secondary ray buffer
+  int secondaryWidth();
+  int secondaryHeight();
+  // Whether secondary rays are traced at low resolution this frame
+  bool halfResSecondary();
+  // Bins the objects into screen tiles for the primary rays
+  void updateTileObjects();
+  // Number of culling tiles
+  int tilesX();
+  int tilesY();
+  // Distance beyond which a light is negligible
+  float getLightRange(const SceneLightData &light);
+  // Objects that may cast a shadow from a light
+  GLuint getShadowCasters(const SceneLightData &light, float range);
+  // Initializes the precomputed 3D noise volume
+  void initNoiseVolume();
+  // Initializes the terrain bake target
+  void initTerrainBake();
+  // Whether the terrain needs to be baked again
+  bool terrainBakeStale();
+  // Bakes the terrain around the camera and builds its max height pyramid
+  void bakeTerrain();
+  // Number of mip levels of the terrain bake
+  int terrainBakeLevels();
   // Initializes our cube map
   void initCubeMap(CUBEMAP type);
+  // Initializes the procedural sky cubemaps
+  void initSkyCubemap();
+  // Initializes the deep zoom's orbit texture
+  void initDeepZoom();
+  // Uploads finished deep zoom orbits and requests new ones
+  void updateDeepZoom();
+  // Whether the 2D Mandelbrot set is drawn by perturbation this frame
+  bool deepZoom();
+  // Whether the deep zoom is drawn through the fractal cache this frame
+  bool fractalCache();
+  // Offset of the previous frame's fractal cache, also moves the refine grid
+  glm::ivec2 fractalCacheShift();
+  // Renders the procedural skies into their cubemaps
+  void bakeSky();
 
   // Sets the output FBO
   void setFBO(GLuint fbo);
@@ -225,12 +500,23 @@ private:
   void configureShapesUniforms(GLuint shader);
   // Sets the uniforms for each light in the scene
   void configureLightsUniforms(GLuint shader);
+  // Sets the uniforms for the sun and the sky
+  void configureSkyUniforms(GLuint shader);
+  // Sets the uniforms for the deep zoom of the 2D Mandelbrot set
+  void configureDeepZoomUniforms(GLuint shader);
   // Sets the uniforms for all the rendering options
   void configureSettingsUniforms(GLuint shader);
-  // Sets the uniforms for FXAA
-  void configureFXAAUniforms(GLuint shader);
-  // Sets the uniforms for applying light efects
-  void configureLightEffectsUniforms(GLuint shader, bool side);
+  // Sets the uniforms for the post effects
+  void configurePostUniforms(GLuint shader, bool side);
+
+  // Profiling
+  // - renders the current view with every performance toggle off and on
+  // and prints GPU time and average march iterations
+  void profileScene();
+  // - GPU time of a single frame in ms
+  double timeFrame(GLuint query);
+  // - average primary and total iterations per pixel
+  glm::vec2 measureSteps(GLuint fbo);
 
   // Destroies shapes textures
   void destroyShapesTextures();
@@ -239,6 +525,7 @@ private:
 
   // Utility
   void setIntUniform(GLuint shader, const char *, int val);
+  void setUIntUniform(GLuint shader, const char *, GLuint val);
   void setFloatUniform(GLuint shader, const char *, float val);
   void setMat4Uniform(GLuint shader, const char *, const glm::mat4 &);
   void setVec2Uniform(GLuint shader, const char *, const glm::vec2 &);
@@ -0,0 +1,141 @@
+#include "realtime.h"
+#include "settings.h"
+#include <iomanip>
+#include <iostream>
+
+// ========================== PROFILING ==============================
+
+/**
+ * @brief Renders the current view once per performance toggle (off and on)
+ * and prints the GPU time together with the average number of march
+ * iterations per pixel and the GL calls the state cache let through or
+ * skipped
+ * - Press P in the viewport to trigger
+ * - Compare rows of the same scene to see where a toggle helps
+ */
+void Realtime::profileScene() {
+  // Toggles that are compared off vs on
+  std::vector<std::pair<std::string, bool *>> toggles = {
+      {"Adaptive Epsilon", &m_enableAdaptiveEpsilon},
+      {"Relaxed Tracing", &m_enableRelaxedTracing},
+      {"Depth Pre-pass", &m_enableDepthPrepass},
+      {"Temporal Reprojection", &m_enableTemporalReprojection},
+      {"Tile Culling", &m_enableTileCulling},
+      {"Shadow Culling", &m_enableShadowCulling},
+      {"Noise Volume", &m_enableNoiseVolume},
+      {"Terrain Bake", &m_enableTerrainBake},
+      {"Cloud Buffer", &m_enableCloudBuffer},
+      {"Sky Cubemap", &m_enableSkyCubemap},
+      {"Half-res Secondary", &m_enableHalfResSecondary},
+      {"Area Shadow Reuse", &m_enableAreaShadowReuse},
+      {"Fractal LOD", &m_enableFractalLOD},
+      {"Adaptive Octaves", &m_enableAdaptiveOctaves},
+      {"Deep Zoom", &m_enableDeepZoom},
+      {"Fractal Cache", &m_enableFractalCache},
+      {"Compute Shader", &m_enableComputeShader},
+  };
+
+  // Iteration counts are written to a float target the size of the screen
+  GLuint statsTexture, statsFBO, query;
+  glGenTextures(1, &statsTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, statsTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, scene.m_width, scene.m_height, 0,
+               GL_RG, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
+  glGenFramebuffers(1, &statsFBO);
+  m_glState.bindFramebuffer(statsFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         statsTexture, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "Stats Buffer Incomplete" << std::endl;
+  }
+  glGenQueries(1, &query);
+
+  std::cout << "===== Profile: " << settings.sceneFilePath << " ("
+            << scene.m_width << "x" << scene.m_height << ") =====" << std::endl;
+  auto report = [&](const std::string &label) {
+    // Warm up once so that shader recompiles are not timed
+    timeFrame(query);
+    double ms = 0.0;
+    for (int i = 0; i < PROFILE_FRAMES; i++) {
+      m_glState.resetStats();
+      ms += timeFrame(query);
+    }
+    ms /= PROFILE_FRAMES;
+    // - GL calls of the last timed frame
+    GLStateCache::Stats calls = m_glState.getStats();
+    glm::vec2 steps = measureSteps(statsFBO);
+    std::cout << std::left << std::setw(32) << label << std::right
+              << std::fixed << std::setprecision(2) << std::setw(8) << ms
+              << " ms   primary steps " << std::setw(7) << steps.x
+              << "   total steps " << std::setw(8) << steps.y
+              << "   GL calls " << std::setw(5) << calls.issued << " issued "
+              << std::setw(5) << calls.elided << " elided" << std::endl;
+  };
+  report("Current settings");
+  for (auto &[name, flag] : toggles) {
+    bool prev = *flag;
+    *flag = false;
+    report(name + " off");
+    *flag = true;
+    report(name + " on");
+    *flag = prev;
+  }
+  // Ambient occlusion methods
+  bool prevAO = m_enableAmbientOcclusion;
+  int prevAOMethod = m_aoMethod;
+  m_enableAmbientOcclusion = false;
+  report("AO off");
+  m_enableAmbientOcclusion = true;
+  m_aoMethod = AO_SDF;
+  report("AO SDF");
+  m_aoMethod = AO_SCREEN_SPACE;
+  report("AO screen-space");
+  m_enableAmbientOcclusion = prevAO;
+  m_aoMethod = prevAOMethod;
+
+  glDeleteQueries(1, &query);
+  glDeleteFramebuffers(1, &statsFBO);
+  glDeleteTextures(1, &statsTexture);
+  m_glState.bindFramebuffer(m_defaultFBO);
+}
+
+/**
+ * @brief Renders a full frame and measures it on the GPU
+ * @param query GL_TIME_ELAPSED query object to use
+ * @returns GPU time of the frame in ms
+ */
+double Realtime::timeFrame(GLuint query) {
+  glBeginQuery(GL_TIME_ELAPSED, query);
+  rayMarch();
+  glEndQuery(GL_TIME_ELAPSED);
+  // Blocks until the frame is done
+  GLuint64 ns = 0;
+  glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+  return ns * 1e-6;
+}
+
+/**
+ * @brief Renders the iteration counts of the current view and averages them
+ * @param fbo FBO with a RG32F color attachment the size of the screen
+ * @returns average primary ray and total iterations per pixel
+ */
+glm::vec2 Realtime::measureSteps(GLuint fbo) {
+  m_showStats = true;
+  marchScene(fbo);
+  m_showStats = false;
+
+  std::vector<GLfloat> steps(scene.m_width * scene.m_height * 2);
+  m_glState.bindFramebuffer(fbo);
+  glReadPixels(0, 0, scene.m_width, scene.m_height, GL_RG, GL_FLOAT,
+               steps.data());
+  m_glState.bindFramebuffer(m_defaultFBO);
+
+  glm::dvec2 sum(0.0);
+  for (size_t i = 0; i < steps.size(); i += 2) {
+    sum += glm::dvec2(steps[i], steps[i + 1]);
+  }
+  return glm::vec2(sum / double(scene.m_width * scene.m_height));
+}
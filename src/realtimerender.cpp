@@ -1,42 +1,42 @@
 #include "realtime.h"
 #include "utils/ltc_matrix.h"
+#include "utils/noisevolume.h"
+#include <cfloat>
 #include <filesystem>
 #include <iostream>
 
 // ======================== UTILITY FUNCTIONS ========================
 
 void Realtime::setIntUniform(GLuint shader, const char *var, int val) {
-  GLuint loc = glGetUniformLocation(shader, var);
-  glUniform1i(loc, val);
+  m_glState.uniform1i(shader, var, val);
+}
+
+void Realtime::setUIntUniform(GLuint shader, const char *var, GLuint val) {
+  m_glState.uniform1ui(shader, var, val);
 }
 
 void Realtime::setFloatUniform(GLuint shader, const char *var, float val) {
-  GLuint loc = glGetUniformLocation(shader, var);
-  glUniform1f(loc, val);
+  m_glState.uniform1f(shader, var, val);
 }
 
 void Realtime::setMat4Uniform(GLuint shader, const char *var,
                               const glm::mat4 &mat) {
-  GLint loc = glGetUniformLocation(shader, var);
-  glUniformMatrix4fv(loc, 1, GL_FALSE, &mat[0][0]);
+  m_glState.uniformMatrix4fv(shader, var, mat);
 }
 
 void Realtime::setVec2Uniform(GLuint shader, const char *var,
                               const glm::vec2 &v) {
-  GLint loc = glGetUniformLocation(shader, var);
-  glUniform2fv(loc, 1, &v[0]);
+  m_glState.uniform2fv(shader, var, v);
 }
 
 void Realtime::setVec3Uniform(GLuint shader, const char *var,
                               const glm::vec3 &v) {
-  GLint loc = glGetUniformLocation(shader, var);
-  glUniform3fv(loc, 1, &v[0]);
+  m_glState.uniform3fv(shader, var, v);
 }
 
 void Realtime::setVec4Uniform(GLuint shader, const char *var,
                               const glm::vec4 &v) {
-  GLint loc = glGetUniformLocation(shader, var);
-  glUniform4fv(loc, 1, &v[0]);
+  m_glState.uniform4fv(shader, var, v);
 }
 
 // ===================================================================
@@ -51,49 +51,367 @@ void Realtime::setVec4Uniform(GLuint shader, const char *var,
  * - Draws the Blank Screen
  */
 void Realtime::rayMarch() {
-  // Set ray march shader
-  glUseProgram(m_rayMarchShader);
+  m_frameIndex++;
+  bool postEffects =
+      m_enableFXAA || m_enableHDR || m_enableGammaCorrection || m_enableBloom;
+  bool offline = postEffects || m_enableTemporalReprojection ||
+                 screenSpaceAO() || areaShadowReuse();
   // Set FBO
-  if (m_enableFXAA || m_enableHDR || m_enableGammaCorrection || m_enableBloom) {
+  if (offline) {
     // If FXAA, HDR, Bloom, or gamma correction enabled, render offline first
-    setFBO(m_customFBO);
+    // - temporal reprojection, screen space AO and area shadow reuse need
+    //   the extra buffers of the custom FBO
+    marchScene(m_customFBO);
   } else {
     // Else go straight to application window
-    setFBO(m_defaultFBO);
+    marchScene(m_defaultFBO);
+  }
+
+  // Occlude the ambient term, before the hit distances become the history
+  if (screenSpaceAO()) {
+    applyScreenSpaceAO();
+  } else {
+    m_aoHistoryValid = false;
+  }
+
+  // Keep the hit distances for the next frame
+  if (m_enableTemporalReprojection) {
+    saveHitHistory();
+  } else {
+    m_historyValid = false;
+  }
+  // Keep the area light visibility for the next frame
+  if (areaShadowReuse()) {
+    saveAreaHistory();
+  } else {
+    m_areaHistoryValid = false;
   }
+  // Camera of this frame, for reprojecting into the next one
+  m_prevProjViewMatrix =
+      scene.getCamera().getProjMatrix() * scene.getCamera().getViewMatrix();
+  m_prevEyePosition = scene.getCamera().getCameraPosition();
+
+  // Nothing else to apply, just show the offline rendered image
+  if (!postEffects && offline) {
+    presentCustomFBO();
+  }
+
+  // Apply HDR / gamma correction / bloom and FXAA, if enabled
+  if (postEffects) {
+    applyPostEffects();
+  }
+}
+
+/**
+ * @brief Sets the raymarch uniforms and draws the image plane
+ * @param fbo FBO that we wish to render to
+ */
+void Realtime::marchScene(GLuint fbo) {
+  // Set ray march shader
+  m_glState.useProgram(m_rayMarchShader);
   // Set Uniforms
-  configureScreenUniforms(m_rayMarchShader);
-  configureCameraUniforms(m_rayMarchShader);
-  configureShapesUniforms(m_rayMarchShader);
-  configureLightsUniforms(m_rayMarchShader);
-  configureSettingsUniforms(m_rayMarchShader);
+  if (deepZoom()) {
+    updateDeepZoom();
+  }
+  configureMarchUniforms(m_rayMarchShader);
+  m_glState.bindVertexArray(m_imagePlaneVAO);
+
+  // Cached 2D fractal
+  // - copies the pixels the previous frame computed and fills in the rest,
+  //   the main pass then shows the finest pixel computed so far
+  if (fractalCache()) {
+    glm::ivec2 shift = fractalCacheShift();
+    m_glState.bindFramebuffer(m_fractalFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           m_fractalTexture[m_fractalIdx], 0);
+    glViewport(0, 0, scene.m_width, scene.m_height);
+    m_glState.bindTexture(FRACTAL_TEX_UNIT_OFF, GL_TEXTURE_2D,
+                          m_fractalTexture[!m_fractalIdx]);
+    setIntUniform(m_rayMarchShader, "fractalCacheValid", m_fractalCacheValid);
+    setVec2Uniform(m_rayMarchShader, "fractalShift", glm::vec2(shift));
+    setVec2Uniform(m_rayMarchShader, "fractalOrigin",
+                   glm::vec2(m_fractalOrigin));
+    setIntUniform(m_rayMarchShader, "renderPass", PASS_FRACTAL);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    m_glState.bindTexture(FRACTAL_TEX_UNIT_OFF, GL_TEXTURE_2D,
+                          m_fractalTexture[m_fractalIdx]);
+    m_fractalIdx = !m_fractalIdx;
+    m_fractalCacheValid = true;
+    m_fractalCacheView = m_deepZoom.getView();
+  } else {
+    m_fractalCacheValid = false;
+  }
+
+  // Procedural sky
+  if (m_enableSkyCubemap && m_skyUsed && !m_twoDSpace &&
+      (!m_skyBakeValid || m_skyBakeTimeOfDay != m_timeOfDay)) {
+    bakeSky();
+  }
+  m_glState.bindTexture(DAY_SKY_TEX_UNIT_OFF, GL_TEXTURE_CUBE_MAP,
+                        m_skyTexture[0]);
+  m_glState.bindTexture(NIGHT_SKY_TEX_UNIT_OFF, GL_TEXTURE_CUBE_MAP,
+                        m_skyTexture[1]);
+
+  // Terrain heightfield
+  if (m_enableTerrainBake && m_terrainUsed && !m_twoDSpace &&
+      terrainBakeStale()) {
+    bakeTerrain();
+  }
+  m_glState.bindTexture(TERRAIN_TEX_UNIT_OFF, GL_TEXTURE_2D, m_terrainTexture);
+  setVec2Uniform(m_rayMarchShader, "terrainBakeOrigin", m_terrainBakeOrigin);
+
+  // Depth prepass
+  // - one cone per PREPASS_SCALE x PREPASS_SCALE tile of pixels
+  if (m_enableDepthPrepass && !m_twoDSpace) {
+    m_glState.bindFramebuffer(m_prepassFBO);
+    glViewport(0, 0, prepassWidth(), prepassHeight());
+    setIntUniform(m_rayMarchShader, "renderPass", PASS_DEPTH);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    // - bound only after the pass so that it never samples its own target
+    m_glState.bindTexture(PREPASS_TEX_UNIT_OFF, GL_TEXTURE_2D,
+                          m_prepassTexture);
+  }
+  // Previous frame's hit distances
+  // - the other buffer is the one being written to (see saveHitHistory)
+  m_glState.bindTexture(HISTORY_TEX_UNIT_OFF, GL_TEXTURE_2D,
+                        m_hitDepthTexture[!m_hitDepthIdx]);
+  // Previous frame's area light visibility
+  m_glState.bindTexture(AREA_HISTORY_TEX_UNIT_OFF, GL_TEXTURE_2D,
+                        m_areaVisibilityTexture[!m_areaVisibilityIdx]);
+  // Objects per tile
+  if (m_enableTileCulling && !m_twoDSpace) {
+    updateTileObjects();
+  }
+
+  // Clouds at 1 / CLOUD_SCALE resolution
+  // - blended with the previous frame's clouds, then kept for the next one
+  if (m_enableCloudBuffer && m_cloudsUsed && !m_twoDSpace) {
+    m_glState.bindFramebuffer(m_cloudFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           m_cloudTexture[m_cloudIdx], 0);
+    glViewport(0, 0, cloudWidth(), cloudHeight());
+    m_glState.bindTexture(CLOUD_TEX_UNIT_OFF, GL_TEXTURE_2D,
+                          m_cloudTexture[!m_cloudIdx]);
+    m_glState.bindTexture(CLOUD_DEPTH_TEX_UNIT_OFF, GL_TEXTURE_2D, 0);
+    setIntUniform(m_rayMarchShader, "cloudHistoryValid", m_cloudHistoryValid);
+    setIntUniform(m_rayMarchShader, "renderPass", PASS_CLOUD);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    m_glState.bindTexture(CLOUD_DEPTH_TEX_UNIT_OFF, GL_TEXTURE_2D,
+                          m_cloudDepthTexture);
+    m_glState.bindTexture(CLOUD_TEX_UNIT_OFF, GL_TEXTURE_2D,
+                          m_cloudTexture[m_cloudIdx]);
+    m_cloudIdx = !m_cloudIdx;
+    m_cloudHistoryValid = true;
+  } else {
+    m_cloudHistoryValid = false;
+  }
+
+  // Reflections and refractions at 1 / SECONDARY_SCALE resolution
+  // - upsampled by the main pass, which falls back to its own rays where
+  //   no texel saw the same surface
+  if (halfResSecondary()) {
+    m_glState.bindFramebuffer(m_secondaryFBO);
+    glViewport(0, 0, secondaryWidth(), secondaryHeight());
+    setIntUniform(m_rayMarchShader, "renderPass", PASS_SECONDARY);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    // - bound only after the pass so that it never samples its own target
+    m_glState.bindTexture(SECONDARY_TEX_UNIT_OFF, GL_TEXTURE_2D,
+                          m_secondaryTexture);
+    m_glState.bindTexture(SECONDARY_GBUFFER_TEX_UNIT_OFF, GL_TEXTURE_2D,
+                          m_secondaryGBufferTexture);
+  }
 
   // Draw
-  glBindVertexArray(m_imagePlaneVAO);
-  glDrawArrays(GL_TRIANGLES, 0, 6);
+  setFBO(fbo);
+  if (computeMarch(fbo)) {
+    // - setFBO still attaches the targets that the post effects expect
+    dispatchMarch();
+  } else {
+    setIntUniform(m_rayMarchShader, "renderPass", PASS_SHADE);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+  }
   // Un-set
-  glBindVertexArray(0);
-  glUseProgram(0);
+  m_glState.bindVertexArray(0);
+  m_glState.useProgram(0);
+}
 
-  // Apply HDR or gamma correction, if enabled
-  if (m_enableHDR || m_enableGammaCorrection || m_enableBloom) {
-    applyLightEffects();
-  }
+/**
+ * @brief Whether the main pass is marched by the compute shader
+ * - its images are the HDR targets of the custom FBO, so only when the main
+ *   pass draws into m_hdrTexture (see setFBO)
+ * @param fbo FBO that the main pass renders to
+ */
+bool Realtime::computeMarch(GLuint fbo) {
+  return m_enableComputeShader && m_computeMarchShader && fbo == m_customFBO &&
+         (m_enableHDR || m_enableGammaCorrection || m_enableBloom);
+}
 
-  // Apply FXAA, if enabled
-  if (m_enableFXAA) {
-    applyFXAA();
+/**
+ * @brief Marches the main pass in the compute shader, straight into the
+ * textures of the custom FBO
+ * - COMPUTE_GROUPS persistent workgroups take COMPUTE_TILE_SIZE tiles off
+ *   m_computeTileCounter until the screen is covered, so the uneven cost of
+ *   fractal pixels does not leave groups idle
+ */
+void Realtime::dispatchMarch() {
+  m_glState.useProgram(m_computeMarchShader);
+  configureMarchUniforms(m_computeMarchShader);
+  setVec2Uniform(m_computeMarchShader, "terrainBakeOrigin",
+                 m_terrainBakeOrigin);
+  setIntUniform(m_computeMarchShader, "renderPass", PASS_SHADE);
+  // Same targets as the attachments of the custom FBO
+  glBindImageTexture(0, m_hdrTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                     GL_RGBA16F);
+  glBindImageTexture(1, m_bloomBrightnessTexture, 0, GL_FALSE, 0,
+                     GL_WRITE_ONLY, GL_RGBA16F);
+  glBindImageTexture(2, m_hitDepthTexture[m_hitDepthIdx], 0, GL_FALSE, 0,
+                     GL_WRITE_ONLY, GL_R32F);
+  if (screenSpaceAO()) {
+    glBindImageTexture(3, m_gBufferTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                       GL_RGBA16F);
+    glBindImageTexture(4, m_ambientTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                       GL_RGBA16F);
+  }
+  if (areaShadowReuse()) {
+    glBindImageTexture(5, m_areaVisibilityTexture[m_areaVisibilityIdx], 0,
+                       GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
   }
+  // - no tile handed out yet
+  GLuint zero = 0;
+  glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, m_computeTileCounter);
+  glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &zero);
+  int tiles = ((scene.m_width + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE) *
+              ((scene.m_height + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE);
+  glDispatchCompute(std::min(tiles, COMPUTE_GROUPS), 1, 1);
+  // - the post effects sample the images or draw into them
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+  m_glState.useProgram(m_rayMarchShader);
+}
+
+/**
+ * @brief Swaps the hit distance buffers so that the frame that was just
+ * rendered becomes the history
+ */
+void Realtime::saveHitHistory() {
+  m_hitDepthIdx = !m_hitDepthIdx;
+  m_historyValid = true;
+  // Write the next frame to the other buffer
+  // - post effects that draw to the custom FBO then cannot touch the history
+  m_glState.bindFramebuffer(m_customFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D,
+                         m_hitDepthTexture[m_hitDepthIdx], 0);
+}
+
+/**
+ * @brief Draws the custom FBO's color buffer to the application window
+ */
+void Realtime::presentCustomFBO() {
+  m_glState.useProgram(m_debugShader);
+  setFBO(m_defaultFBO);
+  drawToQuadWithTex(m_customFBOColorTexture);
+  m_glState.bindFramebuffer(0);
+  m_glState.useProgram(0);
+}
+
+/**
+ * @brief Darkens the ambient term of the custom FBO by screen space AO
+ * - the AO is computed at 1 / AO_SCALE resolution from this frame's hit
+ *   distances and normals, and accumulated over frames
+ * - the composite then subtracts the occluded part of the ambient term,
+ *   which the main pass wrote out separately
+ */
+void Realtime::applyScreenSpaceAO() {
+  m_glState.bindVertexArray(m_fullscreenVAO);
+  m_glState.bindTexture(AO_DEPTH_TEX_UNIT_OFF, GL_TEXTURE_2D,
+                        m_hitDepthTexture[m_hitDepthIdx]);
+  m_glState.bindTexture(AO_GBUFFER_TEX_UNIT_OFF, GL_TEXTURE_2D,
+                        m_gBufferTexture);
+
+  // AO buffer
+  m_glState.useProgram(m_ssaoShader);
+  m_glState.bindFramebuffer(m_aoFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         m_aoTexture[m_aoIdx], 0);
+  glViewport(0, 0, aoWidth(), aoHeight());
+  m_glState.bindTexture(AO_TEX_UNIT_OFF, GL_TEXTURE_2D, m_aoTexture[!m_aoIdx]);
+  configureCameraUniforms(m_ssaoShader);
+  setIntUniform(m_ssaoShader, "aoHistoryValid", m_aoHistoryValid);
+  setIntUniform(m_ssaoShader, "frameIndex", m_frameIndex);
+  glDrawArrays(GL_TRIANGLES, 0, 6);
+
+  // Composite
+  // - the color target is the one the main pass drew into (see setFBO)
+  m_glState.useProgram(m_aoCompositeShader);
+  m_glState.bindFramebuffer(m_aoCompositeFBO);
+  GLuint target = m_enableHDR || m_enableGammaCorrection || m_enableBloom
+                      ? m_hdrTexture
+                      : m_customFBOColorTexture;
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         target, 0);
+  glViewport(0, 0, scene.m_width, scene.m_height);
+  m_glState.bindTexture(AO_TEX_UNIT_OFF, GL_TEXTURE_2D, m_aoTexture[m_aoIdx]);
+  m_glState.bindTexture(AO_AMBIENT_TEX_UNIT_OFF, GL_TEXTURE_2D,
+                        m_ambientTexture);
+  glEnable(GL_BLEND);
+  glBlendEquation(GL_FUNC_REVERSE_SUBTRACT);
+  glBlendFunc(GL_ONE, GL_ONE);
+  glDrawArrays(GL_TRIANGLES, 0, 6);
+  glBlendEquation(GL_FUNC_ADD);
+  glDisable(GL_BLEND);
+
+  m_aoIdx = !m_aoIdx;
+  m_aoHistoryValid = true;
+  m_glState.bindVertexArray(0);
+  m_glState.bindFramebuffer(0);
+  m_glState.useProgram(0);
+}
+
+/**
+ * @brief Swaps the area light visibility buffers so that the frame that was
+ * just rendered becomes the history
+ */
+void Realtime::saveAreaHistory() {
+  m_areaVisibilityIdx = !m_areaVisibilityIdx;
+  m_areaHistoryValid = true;
+  m_glState.bindFramebuffer(m_customFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT5, GL_TEXTURE_2D,
+                         m_areaVisibilityTexture[m_areaVisibilityIdx], 0);
+}
+
+/**
+ * @brief Whether this frame accumulates area light visibility
+ * - only worth the extra buffer when the scene has area lights
+ */
+bool Realtime::areaShadowReuse() {
+  return m_enableAreaShadowReuse && m_isAreaLightUsed && !m_twoDSpace;
+}
+
+/**
+ * @brief Whether this frame uses screen space AO
+ */
+bool Realtime::screenSpaceAO() {
+  return m_enableAmbientOcclusion && m_aoMethod == AO_SCREEN_SPACE &&
+         !m_twoDSpace;
+}
+
+/**
+ * @brief Size of the screen space AO buffer
+ * - rounded up so that every pixel has a texel
+ */
+int Realtime::aoWidth() { return (scene.m_width + AO_SCALE - 1) / AO_SCALE; }
+
+int Realtime::aoHeight() {
+  return (scene.m_height + AO_SCALE - 1) / AO_SCALE;
 }
 
 /**
  * @brief Apply Gaussian Blur for Bloom lighting effect
  */
 bool Realtime::applyBloom() {
-  glUseProgram(m_blurShader);
+  m_glState.useProgram(m_blurShader);
   bool horizontal = true;
   for (int i = 0; i < BLOOM_BLUR_COUNT; i++) {
-    glBindFramebuffer(GL_FRAMEBUFFER, m_pingpongFBO[horizontal]);
+    m_glState.bindFramebuffer(m_pingpongFBO[horizontal]);
     setIntUniform(m_blurShader, "horizontal", horizontal);
     // If this is the first iteration, use the brightness texture
     // Else just used the previously blurred texture
@@ -102,50 +420,32 @@ bool Realtime::applyBloom() {
     drawToQuadWithTex(texToBind);
     horizontal = !horizontal;
   }
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  glUseProgram(0);
+  m_glState.bindFramebuffer(0);
+  m_glState.useProgram(0);
   return horizontal;
 }
 
 /**
- * @brief Applies HDR, Bloom, or Gamma Correction
+ * @brief Applies HDR, Bloom or Gamma Correction, then FXAA, in a single pass
+ * to the application window
+ * - FXAA tone maps the taps it reads itself, so the HDR image is read once
+ *   instead of going through an intermediate LDR texture
  */
-void Realtime::applyLightEffects() {
+void Realtime::applyPostEffects() {
   bool side = false;
   if (m_enableBloom) {
     side = applyBloom();
   }
-  glUseProgram(m_lightOptionShader);
-  if (m_enableFXAA) {
-    // If applying FXAA later output to default color texture
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-                           m_customFBOColorTexture, 0);
-    glViewport(0, 0, scene.m_width, scene.m_height);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  } else {
-    setFBO(m_defaultFBO);
-  }
-  // Set Uniforms
-  configureLightEffectsUniforms(m_lightOptionShader, side);
-  // Draw to Full Screen Quad using offline rendered hdr texture
-  drawToQuadWithTex(m_hdrTexture);
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  glUseProgram(0);
-}
-
-/**
- * @brief Applies FXAA
- */
-void Realtime::applyFXAA() {
-  glUseProgram(m_fxaaShader);
-  // FXAA is last processing we apply
+  m_glState.useProgram(m_postShader);
   setFBO(m_defaultFBO);
   // Set Uniforms
-  configureFXAAUniforms(m_fxaaShader);
-  // Draw to Full Screen Quad using offline rendered texture
-  drawToQuadWithTex(m_customFBOColorTexture);
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  glUseProgram(0);
+  configurePostUniforms(m_postShader, side);
+  // Draw to Full Screen Quad using the offline rendered texture
+  // - the main pass only renders to the hdr texture for HDR, gamma or bloom
+  bool lightEffects = m_enableHDR || m_enableGammaCorrection || m_enableBloom;
+  drawToQuadWithTex(lightEffects ? m_hdrTexture : m_customFBOColorTexture);
+  m_glState.bindFramebuffer(0);
+  m_glState.useProgram(0);
 }
 
 /**
@@ -154,14 +454,13 @@ void Realtime::applyFXAA() {
  */
 void Realtime::drawToQuadWithTex(GLuint tex) {
   // Bind full screen quad vao
-  glBindVertexArray(m_fullscreenVAO);
-  // Activate 0
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, tex);
+  m_glState.bindVertexArray(m_fullscreenVAO);
+  // Sample tex from unit 0
+  m_glState.bindTexture(0, GL_TEXTURE_2D, tex);
   // Draw
   glDrawArrays(GL_TRIANGLES, 0, 6);
-  glBindTexture(GL_TEXTURE_2D, 0);
-  glBindVertexArray(0);
+  m_glState.bindTexture(0, GL_TEXTURE_2D, 0);
+  m_glState.bindVertexArray(0);
 }
 
 /**
@@ -169,7 +468,7 @@ void Realtime::drawToQuadWithTex(GLuint tex) {
  * @param fbo FBO that we wish to render to
  */
 void Realtime::setFBO(GLuint fbo) {
-  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  m_glState.bindFramebuffer(fbo);
   if (fbo == m_customFBO) {
     if (m_enableHDR || m_enableGammaCorrection || m_enableBloom) {
       // use HDR color buf to prevent clamping
@@ -180,9 +479,20 @@ void Realtime::setFBO(GLuint fbo) {
       glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
                              GL_TEXTURE_2D, m_customFBOColorTexture, 0);
     }
+    // - the normals, ambient terms and area light visibility are only
+    //   written when they are used
+    bool ao = screenSpaceAO();
+    GLuint attachments[6] = {
+        GL_COLOR_ATTACHMENT0,
+        GL_COLOR_ATTACHMENT1,
+        GL_COLOR_ATTACHMENT2,
+        ao ? GL_COLOR_ATTACHMENT3 : GL_NONE,
+        ao ? GL_COLOR_ATTACHMENT4 : GL_NONE,
+        areaShadowReuse() ? GL_COLOR_ATTACHMENT5 : GL_NONE};
+    glDrawBuffers(6, attachments);
   }
+  // - no clear, every pass covers the whole target
   glViewport(0, 0, scene.m_width, scene.m_height);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
 /**
@@ -208,12 +518,12 @@ void Realtime::initImagePlane() {
 
   // VAO
   glGenVertexArrays(1, &m_imagePlaneVAO);
-  glBindVertexArray(m_imagePlaneVAO);
+  m_glState.bindVertexArray(m_imagePlaneVAO);
   glEnableVertexAttribArray(0);
   glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), nullptr);
 
   glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
+  m_glState.bindVertexArray(0);
 }
 
 /**
@@ -246,7 +556,7 @@ void Realtime::initFullScreenQuad() {
                fullscreen_quad_data.data(), GL_STATIC_DRAW);
   // - VAO
   glGenVertexArrays(1, &m_fullscreenVAO);
-  glBindVertexArray(m_fullscreenVAO);
+  m_glState.bindVertexArray(m_fullscreenVAO);
   // pos
   glEnableVertexAttribArray(0);
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), nullptr);
@@ -257,48 +567,63 @@ void Realtime::initFullScreenQuad() {
 
   // unbind the fullscreen quad's VBO and VAO
   glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
+  m_glState.bindVertexArray(0);
 }
 
 /**
- * @brief Creates the material texture object for each shape
- * Invoke once when the scene is first loaded
+ * @brief Creates the textures of the material files used by the shapes
+ * - files that already have a texture keep it, so a reload only uploads the
+ *   files it added
+ * - textures of files that are no longer used are deleted
  */
 void Realtime::initShapesTextures() {
-  std::unordered_map<std::string, GLuint> texMap;
+  const std::map<std::string, TextureInfo> &sceneTexs =
+      scene.getShapesTextures();
+  // Delete the textures of files that are no longer used
+  bool deleted = false;
+  for (auto it = m_TextureMap.begin(); it != m_TextureMap.end();) {
+    if (sceneTexs.contains(it->first)) {
+      it++;
+      continue;
+    }
+    glDeleteTextures(1, &it->second);
+    it = m_TextureMap.erase(it);
+    deleted = true;
+  }
+  if (deleted) {
+    // Deleted names get unbound and may be handed out again
+    m_glState.invalidate();
+  }
+
   // Set the texture IDs for the shapes that use them
   for (RayMarchObj &rts : scene.getShapes()) {
     if (!rts.m_material.textureMap.isUsed) {
       continue;
     }
     std::string texName = rts.m_material.textureMap.filename;
-    if (texMap.find(texName) == texMap.end()) {
-      // not found yet -> generate
-      glGenTextures(1, &rts.m_texture);
-      texMap[texName] = rts.m_texture;
-    } else {
+    if (auto search = m_TextureMap.find(texName);
+        search != m_TextureMap.end()) {
       // found a texture id -> reuse
-      rts.m_texture = texMap[texName];
+      rts.m_texture = search->second;
+      continue;
     }
-  }
-
-  // For destruction later
-  m_TextureMap = texMap;
-
-  // For each texture, initialize
-  std::map<std::string, TextureInfo> sceneTexs = scene.getShapesTextures();
-  int cnt = 0;
-  for (auto const &[name, id] : texMap) {
-    TextureInfo texInfo = sceneTexs[name];
-    glActiveTexture(GL_TEXTURE0 + cnt);
-    glBindTexture(GL_TEXTURE_2D, id);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texInfo.width, texInfo.height, 0,
-                 GL_RGBA, GL_UNSIGNED_BYTE, texInfo.image.bits());
+    // not found yet -> generate
+    glGenTextures(1, &rts.m_texture);
+    m_TextureMap[texName] = rts.m_texture;
+    auto texInfo = sceneTexs.find(texName);
+    if (texInfo == sceneTexs.end()) {
+      // - the file failed to load
+      continue;
+    }
+    m_glState.activeTexture(0);
+    m_glState.bindTexture(GL_TEXTURE_2D, rts.m_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texInfo->second.width,
+                 texInfo->second.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 texInfo->second.image.bits());
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    cnt++;
   }
 }
 
@@ -316,8 +641,8 @@ void Realtime::initCustomTextures() {
   };
   for (int i = 0; i < corridorScene.size(); i++) {
     glGenTextures(1, &m_customTextures[i]);
-    glActiveTexture(GL_TEXTURE0 + CUSTOM_TEX_UNIT_OFF + i);
-    glBindTexture(GL_TEXTURE_2D, m_customTextures[i]);
+    m_glState.activeTexture(CUSTOM_TEX_UNIT_OFF + i);
+    m_glState.bindTexture(GL_TEXTURE_2D, m_customTextures[i]);
     QImage myImage;
     std::filesystem::path fileRelativePath(corridorScene[i]);
     QString str((basepath / fileRelativePath).string().data());
@@ -332,7 +657,6 @@ void Realtime::initCustomTextures() {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glActiveTexture(0);
   }
 }
 
@@ -343,41 +667,41 @@ void Realtime::initDefaults() {
   // Default material texture
   // - for shapes that don't have textures associated with them
   //    - if we don't do this GLSL complains
-  glActiveTexture(GL_TEXTURE0);
+  m_glState.activeTexture(0);
   glGenTextures(1, &m_defaultShapeTexture);
-  glBindTexture(GL_TEXTURE_2D, m_defaultShapeTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_defaultShapeTexture);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE,
                std::vector<GLfloat>{0, 0}.data());
-  glBindTexture(GL_TEXTURE_2D, 0);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
 
   // NULL CUBE MAP TEXTURE
-  glActiveTexture(GL_TEXTURE0 + SKYBOX_TEX_UNIT_OFF);
+  m_glState.activeTexture(SKYBOX_TEX_UNIT_OFF);
   glGenTextures(1, &m_nullCubeMapTexture);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, m_nullCubeMapTexture);
+  m_glState.bindTexture(GL_TEXTURE_CUBE_MAP, m_nullCubeMapTexture);
   for (int i = 0; i < 6; i++) {
     glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, 1, 1, 0,
                  GL_RGBA, GL_UNSIGNED_BYTE, std::vector<GLfloat>{0, 0}.data());
   }
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  m_glState.bindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
   // NULL Bloom Texture
   glGenTextures(1, &m_nullBloomBlurTexture);
-  glBindTexture(GL_TEXTURE_2D, m_nullBloomBlurTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_nullBloomBlurTexture);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, scene.m_width, scene.m_height, 0,
                GL_RGBA, GL_FLOAT, std::vector<GLfloat>{0, 0}.data());
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
 
   // Noise Texture
   glGenTextures(1, &m_noiseTexture);
-  glBindTexture(GL_TEXTURE_2D, m_noiseTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_noiseTexture);
   std::filesystem::path basepath = std::filesystem::current_path();
   QImage myImage;
   std::filesystem::path fileRelativePath(
@@ -392,11 +716,11 @@ void Realtime::initDefaults() {
                GL_RGBA, GL_UNSIGNED_BYTE, myImage.bits());
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
 
   // Blue Noise Texture
   glGenTextures(1, &m_blueNoiseTexture);
-  glBindTexture(GL_TEXTURE_2D, m_blueNoiseTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_blueNoiseTexture);
   QImage myImage2;
   std::filesystem::path fileRelativePath2(
       "scenefiles/texture_store/blue_noise_texture.png");
@@ -411,7 +735,51 @@ void Realtime::initDefaults() {
                0, GL_RGBA, GL_UNSIGNED_BYTE, myImage2.bits());
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
+}
+
+/**
+ * @brief Initializes the 3D noise volume used by the fbm functions
+ * - baked on the CPU on the first run and cached on disk afterwards
+ */
+void Realtime::initNoiseVolume() {
+  NoiseVolume volume;
+  volume.load();
+  glGenTextures(1, &m_noiseVolumeTexture);
+  m_glState.bindTexture(GL_TEXTURE_3D, m_noiseVolumeTexture);
+  glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, NoiseVolume::SIZE,
+               NoiseVolume::SIZE, NoiseVolume::SIZE, 0, GL_RGBA, GL_HALF_FLOAT,
+               volume.getData().data());
+  // - tileable, so it repeats along every axis
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  m_glState.bindTexture(GL_TEXTURE_3D, 0);
+}
+
+/**
+ * @brief Initializes the terrain bake target
+ * - level 0 holds the heights, level k >= 1 the max height of the samples
+ *   [m, m + 1] * 2^k (see bakeTerrain)
+ */
+void Realtime::initTerrainBake() {
+  glGenTextures(1, &m_terrainTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_terrainTexture);
+  for (int level = 0; level < terrainBakeLevels(); level++) {
+    int size = TERRAIN_BAKE_SIZE >> level;
+    glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, size, size, 0, GL_RED,
+                 GL_FLOAT, nullptr);
+  }
+  // - heights are interpolated from level 0, the pyramid is only fetched
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
+  glGenFramebuffers(1, &m_terrainFBO);
 }
 
 /**
@@ -419,58 +787,120 @@ void Realtime::initDefaults() {
  */
 void Realtime::initShader() {
   // Raymarch shader
-  glUseProgram(m_rayMarchShader);
+  m_glState.useProgram(m_rayMarchShader);
+  initMarchSamplers(m_rayMarchShader);
+  // - the sampler is optimized out unless TERRAIN is defined
+  m_terrainUsed =
+      glGetUniformLocation(m_rayMarchShader, "terrainHeights") != -1;
+  // - optimized out unless CLOUD is defined
+  m_cloudsUsed = glGetUniformLocation(m_rayMarchShader, "clouds") != -1;
+  // - optimized out unless a background or the sea samples the sky
+  m_skyUsed = glGetUniformLocation(m_rayMarchShader, "daySky") != -1 ||
+              glGetUniformLocation(m_rayMarchShader, "nightSky") != -1;
+  // Bind the textures
+  m_glState.activeTexture(LTC1_TEX_UNIT_OFF);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_mTexture);
+  m_glState.activeTexture(LTC2_TEX_UNIT_OFF);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_ltuTexture);
+  m_glState.useProgram(0);
+
+  // Compute version of the raymarch shader
+  if (m_computeMarchShader) {
+    m_glState.useProgram(m_computeMarchShader);
+    initMarchSamplers(m_computeMarchShader);
+    m_glState.useProgram(0);
+  }
+
+  // Post Effects Shader (gamma correct / HDR / Bloom / FXAA)
+  m_glState.useProgram(m_postShader);
+  setIntUniform(m_postShader, "colorBuffer", 0);
+  setIntUniform(m_postShader, "bloomBlur", 1);
+  m_glState.useProgram(0);
+
+  // Debugging Shader
+  m_glState.useProgram(m_debugShader);
+  setIntUniform(m_debugShader, "debugTexture", 0);
+  m_glState.useProgram(0);
+
+  // Bloom Blur Shader
+  m_glState.useProgram(m_blurShader);
+  setIntUniform(m_blurShader, "image", 0);
+  m_glState.useProgram(0);
+
+  // Terrain Max Height Shader
+  m_glState.useProgram(m_maxMipShader);
+  setIntUniform(m_maxMipShader, "heights", TERRAIN_TEX_UNIT_OFF);
+  m_glState.useProgram(0);
+
+  // Screen Space AO Shaders
+  m_glState.useProgram(m_ssaoShader);
+  setIntUniform(m_ssaoShader, "hitDepth", AO_DEPTH_TEX_UNIT_OFF);
+  setIntUniform(m_ssaoShader, "gBuffer", AO_GBUFFER_TEX_UNIT_OFF);
+  setIntUniform(m_ssaoShader, "aoHistory", AO_TEX_UNIT_OFF);
+  m_glState.useProgram(m_aoCompositeShader);
+  setIntUniform(m_aoCompositeShader, "hitDepth", AO_DEPTH_TEX_UNIT_OFF);
+  setIntUniform(m_aoCompositeShader, "gBuffer", AO_GBUFFER_TEX_UNIT_OFF);
+  setIntUniform(m_aoCompositeShader, "aoBuffer", AO_TEX_UNIT_OFF);
+  setIntUniform(m_aoCompositeShader, "ambient", AO_AMBIENT_TEX_UNIT_OFF);
+  m_glState.useProgram(0);
+}
+
+/**
+ * @brief Points the samplers of a raymarch program to their texture units
+ * - shared by the fragment and the compute version of the shader
+ * @param shader Raymarch program, which must be in use
+ */
+void Realtime::initMarchSamplers(GLuint shader) {
   // Set the textures to use correct slots
-  GLuint texsLoc = glGetUniformLocation(m_rayMarchShader, "objTextures");
+  GLuint texsLoc = glGetUniformLocation(shader, "objTextures");
   for (int i = 0; i < MAX_NUM_TEXTURES; i++) {
     // Bind to default
-    glActiveTexture(GL_TEXTURE0 + i);
-    glBindTexture(GL_TEXTURE_2D, m_defaultShapeTexture);
+    m_glState.activeTexture(i);
+    m_glState.bindTexture(GL_TEXTURE_2D, m_defaultShapeTexture);
     glUniform1i(texsLoc + i, i);
   }
   // Set custom scene textures
-  GLuint cusTexsLoc = glGetUniformLocation(m_rayMarchShader, "customTextures");
+  GLuint cusTexsLoc = glGetUniformLocation(shader, "customTextures");
   for (int i = 0; i < MAX_NUM_CUSTOM_TEXTURES; i++) {
-    glActiveTexture(GL_TEXTURE0 + CUSTOM_TEX_UNIT_OFF + i);
-    glBindTexture(GL_TEXTURE_2D, m_customTextures[i]);
+    m_glState.activeTexture(CUSTOM_TEX_UNIT_OFF + i);
+    m_glState.bindTexture(GL_TEXTURE_2D, m_customTextures[i]);
     glUniform1i(cusTexsLoc + i, CUSTOM_TEX_UNIT_OFF + i);
   }
   // Set the skybox tex unit to the next available
-  setIntUniform(m_rayMarchShader, "skybox", SKYBOX_TEX_UNIT_OFF);
+  setIntUniform(shader, "skybox", SKYBOX_TEX_UNIT_OFF);
   // Set the M and LTU texture units for area lights
-  setIntUniform(m_rayMarchShader, "LTC1", LTC1_TEX_UNIT_OFF);
-  setIntUniform(m_rayMarchShader, "LTC2", LTC2_TEX_UNIT_OFF);
+  setIntUniform(shader, "LTC1", LTC1_TEX_UNIT_OFF);
+  setIntUniform(shader, "LTC2", LTC2_TEX_UNIT_OFF);
   // Set the noise texture unit for procedual stuff
-  setIntUniform(m_rayMarchShader, "noise", NOISE_TEX_UNIT_OFF);
+  setIntUniform(shader, "noise", NOISE_TEX_UNIT_OFF);
   // Set the blue noise texture unit for volumetric rendering
-  setIntUniform(m_rayMarchShader, "bluenoise", BLUE_NOISE_TEX_UNIT_OFF);
-  // Bind the textures
-  glActiveTexture(GL_TEXTURE0 + LTC1_TEX_UNIT_OFF);
-  glBindTexture(GL_TEXTURE_2D, m_mTexture);
-  glActiveTexture(GL_TEXTURE0 + LTC2_TEX_UNIT_OFF);
-  glBindTexture(GL_TEXTURE_2D, m_ltuTexture);
-  glUseProgram(0);
-
-  // FXAA Shader (fxaa)
-  glUseProgram(m_fxaaShader);
-  setIntUniform(m_fxaaShader, "screenTexture", 0);
-  glUseProgram(0);
-
-  // Display Option Shader (gamma correct / HDR / Bloom)
-  glUseProgram(m_lightOptionShader);
-  setIntUniform(m_lightOptionShader, "hdrBuffer", 0);
-  setIntUniform(m_lightOptionShader, "bloomBlur", 1);
-  glUseProgram(0);
-
-  // Debugging Shader
-  glUseProgram(m_debugShader);
-  setIntUniform(m_debugShader, "debugTexture", 0);
-  glUseProgram(0);
-
-  // Bloom Blur Shader
-  glUseProgram(m_blurShader);
-  setIntUniform(m_blurShader, "image", 0);
-  glUseProgram(0);
+  setIntUniform(shader, "bluenoise", BLUE_NOISE_TEX_UNIT_OFF);
+  // Set the depth prepass texture unit
+  setIntUniform(shader, "prepassDepth", PREPASS_TEX_UNIT_OFF);
+  // Set the hit history texture unit for temporal reprojection
+  setIntUniform(shader, "hitHistory", HISTORY_TEX_UNIT_OFF);
+  // Set the object tiles texture unit for tile culling
+  setIntUniform(shader, "tileObjects", TILE_TEX_UNIT_OFF);
+  // Set the noise volume texture unit for fbm
+  setIntUniform(shader, "noiseVolume", NOISE_VOLUME_TEX_UNIT_OFF);
+  // Set the terrain bake texture unit and layout
+  setIntUniform(shader, "terrainHeights", TERRAIN_TEX_UNIT_OFF);
+  setFloatUniform(shader, "terrainBakeSpacing", TERRAIN_BAKE_SPACING);
+  setIntUniform(shader, "terrainBakeLevels", terrainBakeLevels());
+  // Set the cloud buffer texture units
+  setIntUniform(shader, "clouds", CLOUD_TEX_UNIT_OFF);
+  setIntUniform(shader, "cloudDepth", CLOUD_DEPTH_TEX_UNIT_OFF);
+  // Set the secondary ray buffer texture units
+  setIntUniform(shader, "secondaryColor", SECONDARY_TEX_UNIT_OFF);
+  setIntUniform(shader, "secondaryGBuffer", SECONDARY_GBUFFER_TEX_UNIT_OFF);
+  // Set the area light visibility history texture unit
+  setIntUniform(shader, "areaHistory", AREA_HISTORY_TEX_UNIT_OFF);
+  // Set the deep zoom orbit texture unit
+  setIntUniform(shader, "deepZoomOrbit", DEEP_ZOOM_TEX_UNIT_OFF);
+  setIntUniform(shader, "fractalCache", FRACTAL_TEX_UNIT_OFF);
+  // Set the sky cubemap texture units
+  setIntUniform(shader, "daySky", DAY_SKY_TEX_UNIT_OFF);
+  setIntUniform(shader, "nightSky", NIGHT_SKY_TEX_UNIT_OFF);
 }
 
 /**
@@ -479,55 +909,102 @@ void Realtime::initShader() {
 void Realtime::initCustomFBO() {
   // ColorBuffer
   glGenTextures(1, &m_customFBOColorTexture);
-  glBindTexture(GL_TEXTURE_2D, m_customFBOColorTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_customFBOColorTexture);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, scene.m_width, scene.m_height, 0,
                GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
 
   // HDR ColorBuffer
   glGenTextures(1, &m_hdrTexture);
-  glBindTexture(GL_TEXTURE_2D, m_hdrTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_hdrTexture);
   // - note the RGBA16F internal format
   // - this will prevent from frag shader clamping color val to [0, 1] range
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, scene.m_width, scene.m_height, 0,
                GL_RGBA, GL_FLOAT, nullptr);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
 
   // Bloom BrightColorBuffer
   glGenTextures(1, &m_bloomBrightnessTexture);
-  glBindTexture(GL_TEXTURE_2D, m_bloomBrightnessTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_bloomBrightnessTexture);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, scene.m_width, scene.m_height, 0,
                GL_RGBA, GL_FLOAT, nullptr);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
 
-  // RenderBuffer
-  glGenRenderbuffers(1, &m_customFBORenderBuffer);
-  glBindRenderbuffer(GL_RENDERBUFFER, m_customFBORenderBuffer);
-  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, scene.m_width,
-                        scene.m_height);
-  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  // Hit distance buffers (ping-pong between frames)
+  glGenTextures(2, m_hitDepthTexture);
+  for (GLuint i = 0; i < 2; i++) {
+    m_glState.bindTexture(GL_TEXTURE_2D, m_hitDepthTexture[i]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, scene.m_width, scene.m_height, 0,
+                 GL_RED, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  }
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
+  // - contents do not survive a resize
+  m_historyValid = false;
+  m_cloudHistoryValid = false;
+  m_aoHistoryValid = false;
+
+  // Normals and ambient terms of the primary hits
+  glGenTextures(1, &m_gBufferTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_gBufferTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, scene.m_width, scene.m_height, 0,
+               GL_RGBA, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glGenTextures(1, &m_ambientTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_ambientTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, scene.m_width, scene.m_height, 0,
+               GL_RGBA, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
+
+  // Area light visibility buffers (ping-pong between frames)
+  glGenTextures(2, m_areaVisibilityTexture);
+  for (GLuint i = 0; i < 2; i++) {
+    m_glState.bindTexture(GL_TEXTURE_2D, m_areaVisibilityTexture[i]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, scene.m_width, scene.m_height,
+                 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
+  m_areaHistoryValid = false;
 
   // FBO
   glGenFramebuffers(1, &m_customFBO);
-  glBindFramebuffer(GL_FRAMEBUFFER, m_customFBO);
+  m_glState.bindFramebuffer(m_customFBO);
   // - set normal color buffer as default 0
   glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
                          m_customFBOColorTexture, 0);
   // - set brightness as default 1
   glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
                          m_bloomBrightnessTexture, 0);
-  GLuint attachments[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
-  glDrawBuffers(2, attachments);
-  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
-                            GL_RENDERBUFFER, m_customFBORenderBuffer);
+  // - set hit distance as default 2
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D,
+                         m_hitDepthTexture[m_hitDepthIdx], 0);
+  // - normals and ambient terms as 3 and 4 (drawn to only for screen space AO)
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D,
+                         m_gBufferTexture, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT4, GL_TEXTURE_2D,
+                         m_ambientTexture, 0);
+  // - area light visibility as 5 (see saveAreaHistory)
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT5, GL_TEXTURE_2D,
+                         m_areaVisibilityTexture[m_areaVisibilityIdx], 0);
+  GLuint attachments[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1,
+                           GL_COLOR_ATTACHMENT2};
+  glDrawBuffers(3, attachments);
   if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
     std::cout << "Custom Buffer Incomplete" << std::endl;
   }
@@ -537,8 +1014,8 @@ void Realtime::initCustomFBO() {
   glGenFramebuffers(2, m_pingpongFBO);
   glGenTextures(2, m_pingpongBuffer);
   for (GLuint i = 0; i < 2; i++) {
-    glBindFramebuffer(GL_FRAMEBUFFER, m_pingpongFBO[i]);
-    glBindTexture(GL_TEXTURE_2D, m_pingpongBuffer[i]);
+    m_glState.bindFramebuffer(m_pingpongFBO[i]);
+    m_glState.bindTexture(GL_TEXTURE_2D, m_pingpongBuffer[i]);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, scene.m_width, scene.m_height, 0,
                  GL_RGBA, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -548,7 +1025,357 @@ void Realtime::initCustomFBO() {
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
                            m_pingpongBuffer[i], 0);
   }
-  glBindFramebuffer(GL_FRAMEBUFFER, m_defaultFBO);
+
+  // =================== Depth Prepass ========================
+  // - distance from the eye per tile, so a single float channel
+  glGenTextures(1, &m_prepassTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_prepassTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, prepassWidth(), prepassHeight(), 0,
+               GL_RED, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
+  glGenFramebuffers(1, &m_prepassFBO);
+  m_glState.bindFramebuffer(m_prepassFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         m_prepassTexture, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "Prepass Buffer Incomplete" << std::endl;
+  }
+  m_glState.bindFramebuffer(m_defaultFBO);
+
+  // =================== Tile Culling ========================
+  // - one bitmask of objects per tile, filled by updateTileObjects
+  glGenTextures(1, &m_tileTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_tileTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, tilesX(), tilesY(), 0,
+               GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
+
+  // =================== Cloud Buffer ========================
+  // - premultiplied cloud color and opacity (ping-pong between frames)
+  glGenTextures(2, m_cloudTexture);
+  for (GLuint i = 0; i < 2; i++) {
+    m_glState.bindTexture(GL_TEXTURE_2D, m_cloudTexture[i]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, cloudWidth(), cloudHeight(), 0,
+                 GL_RGBA, GL_FLOAT, nullptr);
+    // - linear for the reprojection, the upsample fetches texels
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+  // - distance to the first cloud sample, -1 if there is none
+  glGenTextures(1, &m_cloudDepthTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_cloudDepthTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, cloudWidth(), cloudHeight(), 0,
+               GL_RED, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
+  glGenFramebuffers(1, &m_cloudFBO);
+  m_glState.bindFramebuffer(m_cloudFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         m_cloudTexture[m_cloudIdx], 0);
+  // - the shader writes the cloud distance to hitDepth
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D,
+                         m_cloudDepthTexture, 0);
+  GLuint cloudAttachments[3] = {GL_COLOR_ATTACHMENT0, GL_NONE,
+                                GL_COLOR_ATTACHMENT2};
+  glDrawBuffers(3, cloudAttachments);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "Cloud Buffer Incomplete" << std::endl;
+  }
+
+  // =================== Secondary Ray Buffer ========================
+  // - summed color of the reflected and refracted rays
+  glGenTextures(1, &m_secondaryTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_secondaryTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, secondaryWidth(),
+               secondaryHeight(), 0, GL_RGBA, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  // - normal and distance of the primary hit, w < 0 if there is none
+  glGenTextures(1, &m_secondaryGBufferTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_secondaryGBufferTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, secondaryWidth(),
+               secondaryHeight(), 0, GL_RGBA, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
+  glGenFramebuffers(1, &m_secondaryFBO);
+  m_glState.bindFramebuffer(m_secondaryFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         m_secondaryTexture, 0);
+  // - the shader writes the primary hit to gBuffer
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D,
+                         m_secondaryGBufferTexture, 0);
+  GLuint secondaryAttachments[4] = {GL_COLOR_ATTACHMENT0, GL_NONE, GL_NONE,
+                                    GL_COLOR_ATTACHMENT3};
+  glDrawBuffers(4, secondaryAttachments);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "Secondary Ray Buffer Incomplete" << std::endl;
+  }
+
+  // =================== Fractal Cache ========================
+  // - brightness, whether it was computed and the level its area is refined
+  //   to (ping-pong between frames)
+  glGenTextures(2, m_fractalTexture);
+  for (GLuint i = 0; i < 2; i++) {
+    m_glState.bindTexture(GL_TEXTURE_2D, m_fractalTexture[i]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, scene.m_width, scene.m_height,
+                 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  }
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
+  glGenFramebuffers(1, &m_fractalFBO);
+  m_glState.bindFramebuffer(m_fractalFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         m_fractalTexture[m_fractalIdx], 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "Fractal Cache Buffer Incomplete" << std::endl;
+  }
+  m_fractalCacheValid = false;
+
+  // =================== Screen Space AO ========================
+  // - AO and the distance it was computed at (ping-pong between frames)
+  glGenTextures(2, m_aoTexture);
+  for (GLuint i = 0; i < 2; i++) {
+    m_glState.bindTexture(GL_TEXTURE_2D, m_aoTexture[i]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, aoWidth(), aoHeight(), 0, GL_RG,
+                 GL_FLOAT, nullptr);
+    // - linear for the reprojection, the composite fetches texels
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
+  glGenFramebuffers(1, &m_aoFBO);
+  m_glState.bindFramebuffer(m_aoFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         m_aoTexture[m_aoIdx], 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "AO Buffer Incomplete" << std::endl;
+  }
+  // - only the color of the custom FBO is attached, so the composite never
+  //   draws into the buffers it reads
+  glGenFramebuffers(1, &m_aoCompositeFBO);
+  m_glState.bindFramebuffer(m_aoCompositeFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         m_customFBOColorTexture, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "AO Composite Buffer Incomplete" << std::endl;
+  }
+  m_glState.bindFramebuffer(m_defaultFBO);
+}
+
+/**
+ * @brief Size of the cloud buffer
+ * - rounded up so that every pixel has a texel
+ */
+int Realtime::cloudWidth() {
+  return (scene.m_width + CLOUD_SCALE - 1) / CLOUD_SCALE;
+}
+
+int Realtime::cloudHeight() {
+  return (scene.m_height + CLOUD_SCALE - 1) / CLOUD_SCALE;
+}
+
+/**
+ * @brief Size of the secondary ray buffer
+ * - rounded up so that every pixel has a texel
+ */
+int Realtime::secondaryWidth() {
+  return (scene.m_width + SECONDARY_SCALE - 1) / SECONDARY_SCALE;
+}
+
+int Realtime::secondaryHeight() {
+  return (scene.m_height + SECONDARY_SCALE - 1) / SECONDARY_SCALE;
+}
+
+/**
+ * @brief Whether this frame traces its secondary rays at low resolution
+ * - only worth a pass when reflections or refractions are on
+ */
+bool Realtime::halfResSecondary() {
+  return m_enableHalfResSecondary &&
+         (m_enableReflection || m_enableRefraction) && !m_twoDSpace;
+}
+
+/**
+ * @brief Size of the depth prepass target
+ * - rounded up so that partial tiles at the border are covered
+ */
+int Realtime::prepassWidth() {
+  return (scene.m_width + PREPASS_SCALE - 1) / PREPASS_SCALE;
+}
+
+int Realtime::prepassHeight() {
+  return (scene.m_height + PREPASS_SCALE - 1) / PREPASS_SCALE;
+}
+
+/**
+ * @brief Number of culling tiles
+ * - rounded up so that partial tiles at the border are covered
+ */
+int Realtime::tilesX() { return (scene.m_width + TILE_SIZE - 1) / TILE_SIZE; }
+
+int Realtime::tilesY() { return (scene.m_height + TILE_SIZE - 1) / TILE_SIZE; }
+
+/**
+ * @brief Bins the bounding sphere of every object into the screen tiles
+ * - bit i of a tile is set if a primary ray of the tile may hit object i
+ * - the sphere's bounding box is projected to get its screen rectangle,
+ *   grown by a pixel for the hit threshold
+ * - objects crossing the near plane or without bounds cover every tile
+ */
+void Realtime::updateTileObjects() {
+  static_assert(MAX_NUM_SHAPES <= 32, "object masks are 32 bits");
+  int w = tilesX(), h = tilesY();
+  std::vector<GLuint> masks(w * h, 0);
+  glm::mat4 projView =
+      scene.getCamera().getProjMatrix() * scene.getCamera().getViewMatrix();
+  float near = scene.getCamera().getNearPlane();
+  glm::vec2 screen(scene.m_width, scene.m_height);
+
+  std::vector<RayMarchObj> &shapes = scene.getShapes();
+  for (int i = 0; i < shapes.size() && i < MAX_NUM_SHAPES; i++) {
+    glm::vec4 bounds = shapes[i].m_bounds;
+    // Covered tiles (inclusive)
+    glm::ivec2 lo(0), hi(w - 1, h - 1);
+    if (bounds.w >= 0.f) {
+      glm::vec2 minP(FLT_MAX), maxP(-FLT_MAX);
+      int behind = 0;
+      for (int c = 0; c < 8; c++) {
+        glm::vec3 corner(c & 1 ? 1.f : -1.f, c & 2 ? 1.f : -1.f,
+                         c & 4 ? 1.f : -1.f);
+        glm::vec4 clip =
+            projView * glm::vec4(glm::vec3(bounds) + bounds.w * corner, 1.f);
+        if (clip.w < near) {
+          behind++;
+          continue;
+        }
+        glm::vec2 ndc = glm::vec2(clip) / clip.w;
+        minP = glm::min(minP, ndc);
+        maxP = glm::max(maxP, ndc);
+      }
+      if (behind == 8) {
+        // Entirely behind the near plane
+        continue;
+      }
+      if (behind == 0) {
+        // NDC -> pixels
+        minP = (minP * 0.5f + 0.5f) * screen - 1.f;
+        maxP = (maxP * 0.5f + 0.5f) * screen + 1.f;
+        if (maxP.x < 0.f || maxP.y < 0.f || minP.x >= screen.x ||
+            minP.y >= screen.y) {
+          // Off screen
+          continue;
+        }
+        lo = glm::ivec2(glm::max(minP, glm::vec2(0.f))) / TILE_SIZE;
+        hi = glm::min(glm::ivec2(maxP) / TILE_SIZE, glm::ivec2(w - 1, h - 1));
+      }
+    }
+    for (int y = lo.y; y <= hi.y; y++) {
+      for (int x = lo.x; x <= hi.x; x++) {
+        masks[y * w + x] |= 1u << i;
+      }
+    }
+  }
+
+  m_glState.activeTexture(TILE_TEX_UNIT_OFF);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_tileTexture);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RED_INTEGER,
+                  GL_UNSIGNED_INT, masks.data());
+}
+
+/**
+ * @brief Number of mip levels of the terrain bake, down to 1 x 1
+ */
+int Realtime::terrainBakeLevels() {
+  int levels = 1;
+  while ((TERRAIN_BAKE_SIZE >> levels) > 0) {
+    levels++;
+  }
+  return levels;
+}
+
+/**
+ * @brief Checks whether the terrain bake is out of date
+ * - the terrain inputs changed, or the camera got within a quarter of the
+ *   bake's extent of its border
+ */
+bool Realtime::terrainBakeStale() {
+  glm::vec4 key(m_terrainH, m_terrainS, m_numOctaves, m_enableNoiseVolume);
+  if (!m_terrainBakeValid || key != m_terrainBakeKey) {
+    return true;
+  }
+  float extent = TERRAIN_BAKE_SPACING * (TERRAIN_BAKE_SIZE - 1);
+  glm::vec4 eye = scene.getCamera().getCameraPosition();
+  glm::vec2 offset =
+      glm::vec2(eye.x, eye.z) - (m_terrainBakeOrigin + 0.5f * extent);
+  return glm::max(glm::abs(offset.x), glm::abs(offset.y)) > 0.25f * extent;
+}
+
+/**
+ * @brief Bakes the terrain heights around the camera and builds their max
+ * height pyramid
+ * - the raymarch shader must be in use with the image plane bound
+ * - the heights are sdTerrain itself, evaluated by the raymarch shader
+ */
+void Realtime::bakeTerrain() {
+  float extent = TERRAIN_BAKE_SPACING * (TERRAIN_BAKE_SIZE - 1);
+  glm::vec4 eye = scene.getCamera().getCameraPosition();
+  // - snapped to the samples so that recentering does not move them
+  m_terrainBakeOrigin =
+      glm::floor((glm::vec2(eye.x, eye.z) - 0.5f * extent) /
+                 TERRAIN_BAKE_SPACING) *
+      TERRAIN_BAKE_SPACING;
+  m_terrainBakeKey =
+      glm::vec4(m_terrainH, m_terrainS, m_numOctaves, m_enableNoiseVolume);
+  m_terrainBakeValid = true;
+
+  // Heights
+  // - unbound so that the target is never sampled
+  m_glState.activeTexture(TERRAIN_TEX_UNIT_OFF);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
+  m_glState.bindFramebuffer(m_terrainFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         m_terrainTexture, 0);
+  glViewport(0, 0, TERRAIN_BAKE_SIZE, TERRAIN_BAKE_SIZE);
+  setVec2Uniform(m_rayMarchShader, "terrainBakeOrigin", m_terrainBakeOrigin);
+  setIntUniform(m_rayMarchShader, "renderPass", PASS_TERRAIN);
+  glDrawArrays(GL_TRIANGLES, 0, 6);
+
+  // Max height pyramid
+  // - each level reads the one below it, which is the only level the shader
+  //   sees while the next one is written
+  // - sampled from the terrain unit so that the shape textures stay bound
+  m_glState.useProgram(m_maxMipShader);
+  m_glState.bindVertexArray(m_fullscreenVAO);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_terrainTexture);
+  for (int level = 1; level < terrainBakeLevels(); level++) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, m_terrainTexture, level);
+    glViewport(0, 0, TERRAIN_BAKE_SIZE >> level, TERRAIN_BAKE_SIZE >> level);
+    setIntUniform(m_maxMipShader, "firstLevel", level == 1);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                  terrainBakeLevels() - 1);
+
+  // Back to the raymarch shader
+  m_glState.useProgram(m_rayMarchShader);
+  m_glState.bindVertexArray(m_imagePlaneVAO);
 }
 
 /**
@@ -562,7 +1389,7 @@ void Realtime::initCubeMap(CUBEMAP type) {
   // Get the image paths
   std::vector<std::string> faces = scene.getCubeMapWithType(type);
   glGenTextures(1, &m_cubeMapTexture);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, m_cubeMapTexture);
+  m_glState.bindTexture(GL_TEXTURE_CUBE_MAP, m_cubeMapTexture);
   int width, height;
   for (int i = 0; i < faces.size(); i++) {
     // Load up each face
@@ -586,7 +1413,137 @@ void Realtime::initCubeMap(CUBEMAP type) {
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  m_glState.bindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
+
+/**
+ * @brief Initializes the cubemaps the procedural skies are baked into
+ * - [0] is getSky, [1] is getMoonColor
+ */
+void Realtime::initSkyCubemap() {
+  glGenTextures(2, m_skyTexture);
+  for (GLuint i = 0; i < 2; i++) {
+    m_glState.bindTexture(GL_TEXTURE_CUBE_MAP, m_skyTexture[i]);
+    for (int face = 0; face < 6; face++) {
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA16F,
+                   SKY_CUBEMAP_SIZE, SKY_CUBEMAP_SIZE, 0, GL_RGBA, GL_FLOAT,
+                   nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  }
+  m_glState.bindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  // - filter across the face edges
+  glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+  glGenFramebuffers(1, &m_skyFBO);
+}
+
+/**
+ * @brief Renders the procedural skies into their cubemaps, one face at a time
+ * - the raymarch shader must be in use with the image plane bound
+ * - the stars are frozen at iTime 0 so that the bake does not go stale
+ */
+void Realtime::bakeSky() {
+  m_skyBakeValid = true;
+  m_skyBakeTimeOfDay = m_timeOfDay;
+
+  // - unbound so that the targets are never sampled
+  m_glState.activeTexture(DAY_SKY_TEX_UNIT_OFF);
+  m_glState.bindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  m_glState.activeTexture(NIGHT_SKY_TEX_UNIT_OFF);
+  m_glState.bindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  m_glState.bindFramebuffer(m_skyFBO);
+  glViewport(0, 0, SKY_CUBEMAP_SIZE, SKY_CUBEMAP_SIZE);
+  setIntUniform(m_rayMarchShader, "renderPass", PASS_SKY);
+  setFloatUniform(m_rayMarchShader, "iTime", 0.f);
+  for (int layer = 0; layer < 2; layer++) {
+    setIntUniform(m_rayMarchShader, "skyLayer", layer);
+    for (int face = 0; face < 6; face++) {
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                             GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+                             m_skyTexture[layer], 0);
+      setIntUniform(m_rayMarchShader, "skyFace", face);
+      glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+  }
+  setFloatUniform(m_rayMarchShader, "iTime", m_delta);
+}
+
+/**
+ * @brief Initializes the texture that holds the deep zoom's reference orbit
+ * - DeepZoom::ORBIT_WIDTH points per row, resized with every orbit
+ */
+void Realtime::initDeepZoom() {
+  glGenTextures(1, &m_deepZoomTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_deepZoomTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, DeepZoom::ORBIT_WIDTH, 1, 0, GL_RG,
+               GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool Realtime::deepZoom() { return m_enableDeepZoom && m_twoDSpace; }
+
+bool Realtime::fractalCache() {
+  return m_enableFractalCache && deepZoom() && m_deepZoomOrbitValid;
+}
+
+/**
+ * @brief Where the previous frame's fractal cache lies relative to the
+ * current view, in pixels
+ * - the cache is kept when the view only moved by whole pixels, so that a
+ *   pan just computes the pixels it exposes; the pixels it keeps go on
+ *   refining from their own level, and the refinement grid moves with them
+ * - anything else starts over with every 2^(FRACTAL_CACHE_LEVELS - 1)th
+ *   pixel, one level finer per frame
+ */
+glm::ivec2 Realtime::fractalCacheShift() {
+  const DeepZoomView &view = m_deepZoom.getView();
+  glm::dvec2 size(scene.m_width, scene.m_height);
+  glm::dvec2 shift = m_deepZoom.offsetFrom(m_fractalCacheView) * size.y * 0.5;
+  glm::dvec2 pixels = glm::round(shift);
+  bool kept = m_fractalCacheValid && view.scale == m_fractalCacheView.scale &&
+              glm::all(glm::lessThan(glm::abs(shift - pixels),
+                                     glm::dvec2(FRACTAL_SHIFT_EPSILON))) &&
+              glm::all(glm::lessThan(glm::abs(pixels), size));
+  if (!kept) {
+    m_fractalCacheValid = false;
+    m_fractalOrigin = glm::ivec2(0);
+    return glm::ivec2(0);
+  }
+  // - the grid only repeats every 2^(FRACTAL_CACHE_LEVELS - 1) pixels
+  m_fractalOrigin = (m_fractalOrigin + glm::ivec2(pixels)) &
+                    ((1 << (FRACTAL_CACHE_LEVELS - 1)) - 1);
+  return glm::ivec2(pixels);
+}
+
+/**
+ * @brief Uploads the orbit the worker finished last, and asks for a new one
+ * once the view has moved too far from the orbit it is drawn with
+ * - until the first orbit arrives the set is drawn in floats
+ */
+void Realtime::updateDeepZoom() {
+  DeepZoomOrbit orbit;
+  if (m_deepZoom.takeOrbit(orbit)) {
+    // - the last row is padded
+    int rows = (int(orbit.points.size()) + DeepZoom::ORBIT_WIDTH - 1) /
+               DeepZoom::ORBIT_WIDTH;
+    std::vector<glm::vec2> texels = orbit.points;
+    texels.resize(rows * DeepZoom::ORBIT_WIDTH, glm::vec2(0.f));
+    m_glState.activeTexture(DEEP_ZOOM_TEX_UNIT_OFF);
+    m_glState.bindTexture(GL_TEXTURE_2D, m_deepZoomTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, DeepZoom::ORBIT_WIDTH, rows, 0,
+                 GL_RG, GL_FLOAT, texels.data());
+    m_deepZoomOrbit = std::move(orbit);
+    m_deepZoomOrbitValid = true;
+  }
+  if (!m_deepZoomOrbitValid || m_deepZoom.isStale(m_deepZoomOrbit)) {
+    m_deepZoom.requestOrbit(double(scene.m_width) / scene.m_height);
+  }
 }
 
 /**
@@ -612,6 +1569,31 @@ void Realtime::configureCameraUniforms(GLuint shader) {
   setVec4Uniform(shader, "eyePosition", camPosition);
   // Inv Proj View
   setMat4Uniform(shader, "invProjViewMatrix", invProjViewMatrix);
+  // Previous frame's camera
+  setIntUniform(shader, "historyValid", m_historyValid);
+  setMat4Uniform(shader, "prevProjViewMatrix", m_prevProjViewMatrix);
+  setMat4Uniform(shader, "prevInvProjViewMatrix",
+                 glm::inverse(m_prevProjViewMatrix));
+  setVec4Uniform(shader, "prevEyePosition", m_prevEyePosition);
+  // Size of a pixel at unit distance
+  // - the image plane at distance 1 is 2 * tan(fov / 2) tall
+  float heightAngle = scene.getCamera().getHeightAngle();
+  setFloatUniform(shader, "pixelFootprint",
+                  2.f * glm::tan(heightAngle / 2.f) / scene.m_height);
+}
+
+/**
+ * @brief Sets the uniforms that every pass of a raymarch program reads
+ * @param shader Shader program we are using
+ */
+void Realtime::configureMarchUniforms(GLuint shader) {
+  configureScreenUniforms(shader);
+  configureCameraUniforms(shader);
+  configureShapesUniforms(shader);
+  configureLightsUniforms(shader);
+  configureSettingsUniforms(shader);
+  configureSkyUniforms(shader);
+  configureDeepZoomUniforms(shader);
 }
 
 /**
@@ -629,19 +1611,24 @@ void Realtime::configureScreenUniforms(GLuint shader) {
   setVec2Uniform(shader, "screenDimensions", screenD);
   // ITime
   setFloatUniform(shader, "iTime", m_delta);
+  // Frame Index
+  setIntUniform(shader, "frameIndex", m_frameIndex);
   // Sky Box
-  glActiveTexture(GL_TEXTURE0 + SKYBOX_TEX_UNIT_OFF);
   if (m_idxSkyBox) {
-    glBindTexture(GL_TEXTURE_CUBE_MAP, m_cubeMapTexture);
+    m_glState.bindTexture(SKYBOX_TEX_UNIT_OFF, GL_TEXTURE_CUBE_MAP,
+                          m_cubeMapTexture);
   } else {
-    glBindTexture(GL_TEXTURE_CUBE_MAP, m_nullCubeMapTexture);
+    m_glState.bindTexture(SKYBOX_TEX_UNIT_OFF, GL_TEXTURE_CUBE_MAP,
+                          m_nullCubeMapTexture);
   }
   // Noise
-  glActiveTexture(GL_TEXTURE0 + NOISE_TEX_UNIT_OFF);
-  glBindTexture(GL_TEXTURE_2D, m_noiseTexture);
+  m_glState.bindTexture(NOISE_TEX_UNIT_OFF, GL_TEXTURE_2D, m_noiseTexture);
   // Blue Noise
-  glActiveTexture(GL_TEXTURE0 + BLUE_NOISE_TEX_UNIT_OFF);
-  glBindTexture(GL_TEXTURE_2D, m_blueNoiseTexture);
+  m_glState.bindTexture(BLUE_NOISE_TEX_UNIT_OFF, GL_TEXTURE_2D,
+                        m_blueNoiseTexture);
+  // Noise Volume
+  m_glState.bindTexture(NOISE_VOLUME_TEX_UNIT_OFF, GL_TEXTURE_3D,
+                        m_noiseVolumeTexture);
 }
 
 /**
@@ -678,6 +1665,12 @@ void Realtime::configureLightsUniforms(GLuint shader) {
     setFloatUniform(shader, (base + "lightAngle").c_str(), light.angle);
     // Penumbra
     setFloatUniform(shader, (base + "lightPenumbra").c_str(), light.penumbra);
+    // Shadow casters
+    float range = m_enableShadowCulling ? getLightRange(light) : -1.f;
+    setFloatUniform(shader, (base + "range").c_str(), range);
+    setUIntUniform(shader, (base + "casterMask").c_str(),
+                   m_enableShadowCulling ? getShadowCasters(light, range)
+                                         : ~0u);
     // Area Light Uniforms
     if (light.type == LightType::LIGHT_AREA) {
       // Area Light Intensity
@@ -697,10 +1690,84 @@ void Realtime::configureLightsUniforms(GLuint shader) {
   // Number of lights
   setIntUniform(shader, "numLights", cnt);
 
-  glActiveTexture(GL_TEXTURE0 + LTC1_TEX_UNIT_OFF);
-  glBindTexture(GL_TEXTURE_2D, m_mTexture);
-  glActiveTexture(GL_TEXTURE0 + LTC2_TEX_UNIT_OFF);
-  glBindTexture(GL_TEXTURE_2D, m_ltuTexture);
+  m_glState.bindTexture(LTC1_TEX_UNIT_OFF, GL_TEXTURE_2D, m_mTexture);
+  m_glState.bindTexture(LTC2_TEX_UNIT_OFF, GL_TEXTURE_2D, m_ltuTexture);
+}
+
+/**
+ * @brief Gets the distance at which a point or spot light's attenuated color
+ * drops below LIGHT_CUTOFF
+ * - solves c0 + c1 * d + c2 * d^2 = max(color) / LIGHT_CUTOFF
+ * @param light Light in question
+ * @returns range, or -1 if the light never falls off
+ */
+float Realtime::getLightRange(const SceneLightData &light) {
+  if (light.type != LightType::LIGHT_POINT &&
+      light.type != LightType::LIGHT_SPOT) {
+    return -1.f;
+  }
+  float c0 = light.function[0], c1 = light.function[1],
+        c2 = light.function[2];
+  float k = fmax(light.color.r, fmax(light.color.g, light.color.b)) /
+            LIGHT_CUTOFF;
+  if (c0 >= k) {
+    // Negligible everywhere
+    return 0.f;
+  }
+  if (c2 > 0.f) {
+    return (-c1 + std::sqrt(c1 * c1 - 4.f * c2 * (c0 - k))) / (2.f * c2);
+  }
+  if (c1 > 0.f) {
+    return (k - c0) / c1;
+  }
+  return -1.f;
+}
+
+/**
+ * @brief Gets the objects that may block a light
+ * - a shadow ray runs from a lit point to the light, so it stays inside the
+ *   light's range (point / spot) and cone (spot)
+ * - objects whose bounding sphere misses that region are dropped
+ * - directional and area lights reach everything, so nothing is dropped
+ * @param light Light in question
+ * @param range Range of the light (-1 if unbounded)
+ * @returns bitmask of objects (bit i = object i)
+ */
+GLuint Realtime::getShadowCasters(const SceneLightData &light, float range) {
+  if (light.type != LightType::LIGHT_POINT &&
+      light.type != LightType::LIGHT_SPOT) {
+    return ~0u;
+  }
+  glm::vec3 apex(light.pos);
+  glm::vec3 axis = glm::normalize(glm::vec3(light.dir));
+  GLuint mask = 0;
+  std::vector<RayMarchObj> &shapes = scene.getShapes();
+  for (int i = 0; i < shapes.size() && i < MAX_NUM_SHAPES; i++) {
+    glm::vec4 bounds = shapes[i].m_bounds;
+    if (bounds.w < 0.f) {
+      // Unbounded
+      mask |= 1u << i;
+      continue;
+    }
+    glm::vec3 v = glm::vec3(bounds) - apex;
+    float dist = glm::length(v);
+    if (range >= 0.f && dist - bounds.w > range) {
+      // Out of range
+      continue;
+    }
+    if (light.type == LightType::LIGHT_SPOT && dist > bounds.w &&
+        light.angle < M_PI / 2.f) {
+      // Angle between the axis and the center, minus the sphere's half angle
+      float toCenter =
+          std::acos(glm::clamp(glm::dot(v / dist, axis), -1.f, 1.f));
+      if (toCenter - std::asin(bounds.w / dist) > light.angle) {
+        // Outside of the cone
+        continue;
+      }
+    }
+    mask |= 1u << i;
+  }
+  return mask;
 }
 
 /**
@@ -714,8 +1781,14 @@ void Realtime::configureSettingsUniforms(GLuint shader) {
   setIntUniform(shader, "enableReflection", m_enableReflection);
   // Refraction
   setIntUniform(shader, "enableRefraction", m_enableRefraction);
+  // Max Bounces
+  setIntUniform(shader, "maxBounces", m_maxBounces);
+  // Area Light Samples
+  setIntUniform(shader, "areaLightSamples", m_areaLightSamples);
   // Ambient Occulusion
   setIntUniform(shader, "enableAmbientOcculusion", m_enableAmbientOcclusion);
+  // - applied after the main pass when computed in screen space
+  setIntUniform(shader, "enableScreenSpaceAO", screenSpaceAO());
   // Sky Box
   setIntUniform(shader, "enableSkyBox", m_idxSkyBox);
   // Terrain
@@ -723,6 +1796,100 @@ void Realtime::configureSettingsUniforms(GLuint shader) {
   setFloatUniform(shader, "terrainScale", m_terrainS);
   // Number of Octaves
   setIntUniform(shader, "numOctaves", m_numOctaves);
+  // Adaptive Epsilon
+  setIntUniform(shader, "enableAdaptiveEpsilon", m_enableAdaptiveEpsilon);
+  // Relaxed Sphere Tracing
+  setIntUniform(shader, "enableRelaxedTracing", m_enableRelaxedTracing);
+  // Depth Prepass
+  setIntUniform(shader, "enableDepthPrepass", m_enableDepthPrepass);
+  // Temporal Reprojection
+  setIntUniform(shader, "enableTemporalReprojection",
+                m_enableTemporalReprojection);
+  // Tile Culling
+  setIntUniform(shader, "enableTileCulling", m_enableTileCulling);
+  // Shadow Culling
+  setIntUniform(shader, "enableShadowCulling", m_enableShadowCulling);
+  // Noise Volume
+  setIntUniform(shader, "enableNoiseVolume", m_enableNoiseVolume);
+  // Fractal LOD
+  setIntUniform(shader, "enableFractalLOD", m_enableFractalLOD);
+  // Adaptive Octaves
+  setIntUniform(shader, "enableAdaptiveOctaves", m_enableAdaptiveOctaves);
+  // Terrain Bake
+  setIntUniform(shader, "enableTerrainBake", m_enableTerrainBake);
+  // Cloud Buffer
+  setIntUniform(shader, "enableCloudBuffer", m_enableCloudBuffer);
+  // Sky Cubemap
+  setIntUniform(shader, "enableSkyCubemap", m_enableSkyCubemap);
+  // Half-res Secondary
+  setIntUniform(shader, "enableHalfResSecondary", halfResSecondary());
+  setIntUniform(shader, "enableFractalCache", fractalCache());
+  // Area Shadow Reuse
+  setIntUniform(shader, "enableAreaShadowReuse", areaShadowReuse());
+  setIntUniform(shader, "areaHistoryValid", m_areaHistoryValid);
+  // Statistics
+  setIntUniform(shader, "showStats", m_showStats);
+}
+
+/**
+ * @brief Sets the uniforms for the sun and the sky
+ * - these only depend on the time of day, so they are computed here once
+ *   instead of per pixel
+ * @param shader Shader program we are using
+ */
+void Realtime::configureSkyUniforms(GLuint shader) {
+  float sunriseStart = 0.2f, sunsetStart = 0.8f;
+  float sunrise = glm::smoothstep(0.f, sunriseStart, m_timeOfDay);
+  float sunset = glm::smoothstep(sunsetStart, 1.f, m_timeOfDay);
+  glm::vec3 sunriseColor(1.f, 0.5f, 0.2f), sunsetColor(1.f, 0.8f, 0.5f);
+  // Sun Direction
+  float elevation = glm::mix(0.f, 3.14f, m_timeOfDay);
+  setVec3Uniform(shader, "sunDirection",
+                 glm::normalize(glm::vec3(glm::cos(elevation),
+                                          glm::sin(elevation), -0.577f)));
+  // Sun Color
+  glm::vec3 sunColor =
+      glm::mix(sunriseColor, glm::vec3(1.f, 1.f, 0.8f), sunrise);
+  setVec3Uniform(shader, "sunColor", glm::mix(sunColor, sunsetColor, sunset));
+  // Sky Color
+  glm::vec3 skyColor =
+      glm::mix(sunriseColor, glm::vec3(0.8f, 0.9f, 1.1f), sunrise);
+  setVec3Uniform(shader, "skyColor", glm::mix(skyColor, sunsetColor, sunset));
+}
+
+/**
+ * @brief Sets the uniforms for the deep zoom of the 2D Mandelbrot set
+ * - the view is drawn relative to the orbit's reference, which may lag
+ *   behind while the worker computes the next one
+ * - the series approximation is dropped while the view reaches beyond the
+ *   radius it was validated for
+ * @param shader Shader program we are using
+ */
+void Realtime::configureDeepZoomUniforms(GLuint shader) {
+  bool enabled = deepZoom() && m_deepZoomOrbitValid;
+  setIntUniform(shader, "enableDeepZoom", enabled);
+  if (!enabled) {
+    return;
+  }
+  const DeepZoomOrbit &orbit = m_deepZoomOrbit;
+  glm::dvec2 offset = m_deepZoom.offsetFrom(orbit.view);
+  double ratio = m_deepZoom.getView().scale / orbit.view.scale;
+  double aspect = double(scene.m_width) / scene.m_height;
+  double reach = glm::length(offset) + ratio * std::sqrt(aspect * aspect + 1.);
+  bool series = reach <= orbit.radius;
+  setIntUniform(shader, "deepZoomOrbitLength", int(orbit.points.size()));
+  setIntUniform(shader, "deepZoomIterations", m_deepZoom.getIterations());
+  setIntUniform(shader, "deepZoomSkip", series ? orbit.skip : 0);
+  for (int i = 0; i < 3; i++) {
+    std::string name = "deepZoomCoeffs[" + std::to_string(i) + "]";
+    setVec2Uniform(shader, name.c_str(),
+                   series ? glm::vec2(orbit.coeffs[i]) : glm::vec2(0.f));
+  }
+  setFloatUniform(shader, "deepZoomScale", orbit.view.scale);
+  setFloatUniform(shader, "deepZoomViewRatio", ratio);
+  setVec2Uniform(shader, "deepZoomOffset", glm::vec2(offset));
+  m_glState.bindTexture(DEEP_ZOOM_TEX_UNIT_OFF, GL_TEXTURE_2D,
+                        m_deepZoomTexture);
 }
 
 /**
@@ -783,6 +1950,10 @@ void Realtime::configureShapesUniforms(GLuint shader) {
     setVec3Uniform(shader, (base + "color").c_str(), obj.m_color);
     // lightidx
     setIntUniform(shader, (base + "lightIdx").c_str(), obj.m_lightIdx);
+    // relaxation
+    setFloatUniform(shader, (base + "relaxation").c_str(), obj.m_relaxation);
+    // bounds
+    setVec4Uniform(shader, (base + "bounds").c_str(), obj.m_bounds);
 
     cnt++;
 
@@ -796,12 +1967,10 @@ void Realtime::configureShapesUniforms(GLuint shader) {
 
     if (texMap.find(texName) == texMap.end() && texCnt != MAX_NUM_TEXTURES) {
       // If texture not bound yet and we have not reached the limit
-      glActiveTexture(GL_TEXTURE0 + texCnt);
-      glBindTexture(GL_TEXTURE_2D, obj.m_texture);
+      m_glState.bindTexture(texCnt, GL_TEXTURE_2D, obj.m_texture);
       // "texName" is bound to unit 0 + "texCnt"
       texMap[texName] = texCnt;
       texCnt++;
-      glActiveTexture(0);
     }
     setIntUniform(shader, (base + "texLoc").c_str(), texMap[texName]);
   }
@@ -811,33 +1980,28 @@ void Realtime::configureShapesUniforms(GLuint shader) {
 }
 
 /**
- * @brief Initializes fxaa uniforms
+ * @brief Initializes post effect uniforms
+ * @param side Ping-pong buffer that holds the final bloom blur
  */
-void Realtime::configureFXAAUniforms(GLuint shader) {
-  float inverseWidth = 1.0 / scene.m_width;
-  float inverseHeight = 1.0 / scene.m_height;
-  glm::vec2 inverseScreen{inverseWidth, inverseHeight};
+void Realtime::configurePostUniforms(GLuint shader, bool side) {
   // Inverse Screen Dimensions
-  setVec2Uniform(shader, "inverseScreenSize", inverseScreen);
-}
-
-/**
- * @brief Initializes light effect uniforms
- */
-void Realtime::configureLightEffectsUniforms(GLuint shader, bool side) {
+  setVec2Uniform(shader, "inverseScreenSize",
+                 glm::vec2(1.f / scene.m_width, 1.f / scene.m_height));
+  // FXAA enable
+  setIntUniform(shader, "fxaa", m_enableFXAA);
+  // Gamma correction enable
+  setIntUniform(shader, "gamma", m_enableGammaCorrection);
   // Exposure
   setFloatUniform(shader, "exposure", m_exposure);
   // HDR enable
   setIntUniform(shader, "hdr", m_enableHDR);
   // Bloom enable
   setIntUniform(shader, "bloom", m_enableBloom);
-  glActiveTexture(GL_TEXTURE1);
   if (m_enableBloom) {
-    glBindTexture(GL_TEXTURE_2D, m_pingpongBuffer[side]);
+    m_glState.bindTexture(1, GL_TEXTURE_2D, m_pingpongBuffer[side]);
   } else {
-    glBindTexture(GL_TEXTURE_2D, m_nullBloomBlurTexture);
+    m_glState.bindTexture(1, GL_TEXTURE_2D, m_nullBloomBlurTexture);
   }
-  glActiveTexture(0);
 }
 
 /**
@@ -848,6 +2012,8 @@ void Realtime::destroyShapesTextures() {
     glDeleteTextures(1, &id);
   }
   m_TextureMap.clear();
+  // Deleted names get unbound and may be handed out again
+  m_glState.invalidate();
 }
 
 /**
@@ -858,9 +2024,28 @@ void Realtime::destroyCustomFBO() {
   glDeleteTextures(1, &m_bloomBrightnessTexture);
   glDeleteTextures(1, &m_customFBOColorTexture);
   glDeleteTextures(2, m_pingpongBuffer);
-  glDeleteRenderbuffers(1, &m_customFBORenderBuffer);
   glDeleteFramebuffers(1, &m_customFBO);
   glDeleteFramebuffers(2, m_pingpongFBO);
+  glDeleteTextures(1, &m_prepassTexture);
+  glDeleteTextures(2, m_hitDepthTexture);
+  glDeleteTextures(1, &m_tileTexture);
+  glDeleteFramebuffers(1, &m_prepassFBO);
+  glDeleteTextures(2, m_cloudTexture);
+  glDeleteTextures(1, &m_cloudDepthTexture);
+  glDeleteFramebuffers(1, &m_cloudFBO);
+  glDeleteTextures(1, &m_secondaryTexture);
+  glDeleteTextures(1, &m_secondaryGBufferTexture);
+  glDeleteFramebuffers(1, &m_secondaryFBO);
+  glDeleteTextures(1, &m_gBufferTexture);
+  glDeleteTextures(1, &m_ambientTexture);
+  glDeleteTextures(2, m_aoTexture);
+  glDeleteFramebuffers(1, &m_aoFBO);
+  glDeleteFramebuffers(1, &m_aoCompositeFBO);
+  glDeleteTextures(2, m_areaVisibilityTexture);
+  glDeleteTextures(2, m_fractalTexture);
+  glDeleteFramebuffers(1, &m_fractalFBO);
+  // Deleted names get unbound and may be handed out again
+  m_glState.invalidate();
 }
 
 /**
@@ -875,18 +2060,39 @@ void Realtime::updateUISettings() {
   m_enableSoftShadow = settings.enableSoftShadow;
   m_enableReflection = settings.enableReflection;
   m_enableRefraction = settings.enableRefraction;
+  m_maxBounces = settings.maxBounces;
+  m_areaLightSamples = settings.areaLightSamples;
   m_enableAmbientOcclusion = settings.enableAmbientOcculusion;
+  m_aoMethod = settings.aoMethod;
   m_power = settings.power;
   m_enableFXAA = settings.enableFXAA;
   m_juliaSeed = settings.juliaSeed;
   m_terrainH = settings.terrainH;
   m_terrainS = settings.terrainS;
   m_numOctaves = settings.numOctaves;
+  m_enableAdaptiveEpsilon = settings.enableAdaptiveEpsilon;
+  m_enableRelaxedTracing = settings.enableRelaxedTracing;
+  m_enableDepthPrepass = settings.enableDepthPrepass;
+  m_enableTemporalReprojection = settings.enableTemporalReprojection;
+  m_enableTileCulling = settings.enableTileCulling;
+  m_enableShadowCulling = settings.enableShadowCulling;
+  m_enableNoiseVolume = settings.enableNoiseVolume;
+  m_enableTerrainBake = settings.enableTerrainBake;
+  m_enableCloudBuffer = settings.enableCloudBuffer;
+  m_enableSkyCubemap = settings.enableSkyCubemap;
+  m_enableHalfResSecondary = settings.enableHalfResSecondary;
+  m_enableAreaShadowReuse = settings.enableAreaShadowReuse;
+  m_enableFractalLOD = settings.enableFractalLOD;
+  m_enableAdaptiveOctaves = settings.enableAdaptiveOctaves;
+  m_enableDeepZoom = settings.enableDeepZoom;
+  m_enableFractalCache = settings.enableFractalCache;
+  m_enableComputeShader = settings.enableComputeShader;
   if (m_idxSkyBox != settings.idxSkyBox) {
     // If new sky box is selected
     if (m_idxSkyBox) {
       // If a cube map was already loaded
       glDeleteTextures(1, &m_cubeMapTexture);
+      m_glState.invalidate();
     }
     // Create the new cube map for selected skybox
     initCubeMap(static_cast<CUBEMAP>(settings.idxSkyBox));
@@ -903,7 +2109,7 @@ void Realtime::updateUISettings() {
  */
 void Realtime::loadMTexture() {
   glGenTextures(1, &m_mTexture);
-  glBindTexture(GL_TEXTURE_2D, m_mTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_mTexture);
 
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 64, 64, 0, GL_RGBA, GL_FLOAT, LTC1);
 
@@ -912,7 +2118,7 @@ void Realtime::loadMTexture() {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-  glBindTexture(GL_TEXTURE_2D, 0);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
 }
 
 /**
@@ -920,7 +2126,7 @@ void Realtime::loadMTexture() {
  */
 void Realtime::loadLTUTexture() {
   glGenTextures(1, &m_ltuTexture);
-  glBindTexture(GL_TEXTURE_2D, m_ltuTexture);
+  m_glState.bindTexture(GL_TEXTURE_2D, m_ltuTexture);
 
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 64, 64, 0, GL_RGBA, GL_FLOAT, LTC2);
 
@@ -929,5 +2135,5 @@ void Realtime::loadLTUTexture() {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-  glBindTexture(GL_TEXTURE_2D, 0);
+  m_glState.bindTexture(GL_TEXTURE_2D, 0);
 }
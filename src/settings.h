@@ -32,7 +32,10 @@ struct Settings {
   bool enableSoftShadow;
   bool enableReflection;
   bool enableRefraction;
+  int maxBounces = 1;
+  int areaLightSamples = 1;
   bool enableAmbientOcculusion;
+  int aoMethod = 0;
   // Post Processing Options
   bool enableFXAA;
   bool enableGammaCorrection;
@@ -46,9 +49,27 @@ struct Settings {
   float power = 8.f;
   glm::vec2 juliaSeed = glm::vec2(0.f);
   // Procedural
-  int numOctaves = 8;
+  int numOctaves = 9;
   float terrainH = 10.;
   float terrainS = 2.75;
+  // Performance
+  bool enableAdaptiveEpsilon = true;
+  bool enableRelaxedTracing = false;
+  bool enableDepthPrepass = true;
+  bool enableTemporalReprojection = true;
+  bool enableTileCulling = true;
+  bool enableShadowCulling = true;
+  bool enableNoiseVolume = true;
+  bool enableTerrainBake = true;
+  bool enableCloudBuffer = true;
+  bool enableSkyCubemap = true;
+  bool enableHalfResSecondary = true;
+  bool enableAreaShadowReuse = true;
+  bool enableFractalLOD = true;
+  bool enableAdaptiveOctaves = true;
+  bool enableDeepZoom = true;
+  bool enableFractalCache = true;
+  bool enableComputeShader = false;
 };
 
 // The global Settings object, will be initialized by MainWindow
@@ -0,0 +1,190 @@
+#include "glstatecache.h"
+
+#include <cstring>
+
+/**
+ * @brief Counts a call
+ * @param changed Whether the call changes any state
+ * @returns changed
+ */
+bool GLStateCache::issue(bool changed) {
+  if (changed) {
+    m_stats.issued++;
+  } else {
+    m_stats.elided++;
+  }
+  return changed;
+}
+
+void GLStateCache::useProgram(GLuint program) {
+  if (issue(m_program != program)) {
+    glUseProgram(program);
+    m_program = program;
+  }
+}
+
+void GLStateCache::bindVertexArray(GLuint vao) {
+  if (issue(m_vao != vao)) {
+    glBindVertexArray(vao);
+    m_vao = vao;
+  }
+}
+
+void GLStateCache::bindFramebuffer(GLuint fbo) {
+  if (issue(m_fbo != fbo)) {
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    m_fbo = fbo;
+  }
+}
+
+void GLStateCache::activeTexture(GLuint unit) {
+  if (issue(m_activeUnit != unit)) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    m_activeUnit = unit;
+  }
+}
+
+/**
+ * @brief Binds texture to target of the active unit
+ * - always issued while the active unit is unknown
+ */
+void GLStateCache::bindTexture(GLenum target, GLuint texture) {
+  if (m_activeUnit == UNKNOWN) {
+    issue(true);
+    glBindTexture(target, texture);
+    return;
+  }
+  auto [it, inserted] =
+      m_textures.try_emplace({m_activeUnit, target}, UNKNOWN);
+  if (issue(it->second != texture)) {
+    glBindTexture(target, texture);
+    it->second = texture;
+  }
+}
+
+void GLStateCache::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+  auto [it, inserted] = m_textures.try_emplace({unit, target}, UNKNOWN);
+  if (!issue(it->second != texture)) {
+    return;
+  }
+  activeTexture(unit);
+  glBindTexture(target, texture);
+  it->second = texture;
+}
+
+GLint GLStateCache::uniformLocation(GLuint program, const char *name) {
+  auto [it, inserted] = m_locations[program].try_emplace(name, -1);
+  if (issue(inserted)) {
+    it->second = glGetUniformLocation(program, name);
+  }
+  return it->second;
+}
+
+/**
+ * @brief Compares a uniform with its last written value
+ * - unused uniforms (location -1) never change
+ */
+bool GLStateCache::uniformChanged(GLuint program, GLint loc, const void *data,
+                                  size_t size) {
+  if (loc == -1) {
+    return issue(false);
+  }
+  std::vector<unsigned char> &value = m_uniforms[program][loc];
+  if (value.size() == size && std::memcmp(value.data(), data, size) == 0) {
+    return issue(false);
+  }
+  value.assign(static_cast<const unsigned char *>(data),
+               static_cast<const unsigned char *>(data) + size);
+  return issue(true);
+}
+
+void GLStateCache::uniform1i(GLuint program, const char *name, int v) {
+  GLint loc = uniformLocation(program, name);
+  if (uniformChanged(program, loc, &v, sizeof(v))) {
+    glUniform1i(loc, v);
+  }
+}
+
+void GLStateCache::uniform1ui(GLuint program, const char *name, GLuint v) {
+  GLint loc = uniformLocation(program, name);
+  if (uniformChanged(program, loc, &v, sizeof(v))) {
+    glUniform1ui(loc, v);
+  }
+}
+
+void GLStateCache::uniform1f(GLuint program, const char *name, float v) {
+  GLint loc = uniformLocation(program, name);
+  if (uniformChanged(program, loc, &v, sizeof(v))) {
+    glUniform1f(loc, v);
+  }
+}
+
+void GLStateCache::uniform2fv(GLuint program, const char *name,
+                              const glm::vec2 &v) {
+  GLint loc = uniformLocation(program, name);
+  if (uniformChanged(program, loc, &v[0], sizeof(v))) {
+    glUniform2fv(loc, 1, &v[0]);
+  }
+}
+
+void GLStateCache::uniform3fv(GLuint program, const char *name,
+                              const glm::vec3 &v) {
+  GLint loc = uniformLocation(program, name);
+  if (uniformChanged(program, loc, &v[0], sizeof(v))) {
+    glUniform3fv(loc, 1, &v[0]);
+  }
+}
+
+void GLStateCache::uniform4fv(GLuint program, const char *name,
+                              const glm::vec4 &v) {
+  GLint loc = uniformLocation(program, name);
+  if (uniformChanged(program, loc, &v[0], sizeof(v))) {
+    glUniform4fv(loc, 1, &v[0]);
+  }
+}
+
+void GLStateCache::uniformMatrix4fv(GLuint program, const char *name,
+                                    const glm::mat4 &m) {
+  GLint loc = uniformLocation(program, name);
+  if (uniformChanged(program, loc, &m[0][0], sizeof(m))) {
+    glUniformMatrix4fv(loc, 1, GL_FALSE, &m[0][0]);
+  }
+}
+
+void GLStateCache::invalidate() {
+  m_program = UNKNOWN;
+  m_vao = UNKNOWN;
+  m_fbo = UNKNOWN;
+  m_activeUnit = UNKNOWN;
+  m_textures.clear();
+}
+
+/**
+ * @brief Forgets the state other code may touch between two frames
+ * - textures on the other units stay known, which is what lets the
+ *   per-frame sampler binds be skipped
+ */
+void GLStateCache::beginFrame() {
+  m_program = UNKNOWN;
+  m_vao = UNKNOWN;
+  m_fbo = UNKNOWN;
+  if (m_activeUnit == UNKNOWN) {
+    m_textures.clear();
+    return;
+  }
+  std::erase_if(m_textures, [this](const auto &binding) {
+    return binding.first.first == m_activeUnit;
+  });
+}
+
+void GLStateCache::forgetProgram(GLuint program) {
+  m_locations.erase(program);
+  m_uniforms.erase(program);
+  if (m_program == program) {
+    m_program = UNKNOWN;
+  }
+}
+
+const GLStateCache::Stats &GLStateCache::getStats() const { return m_stats; }
+
+void GLStateCache::resetStats() { m_stats = Stats(); }
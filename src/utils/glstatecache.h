@@ -0,0 +1,88 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Thin shadow of the GL bindings and uniform values that the renderer sets
+// every frame. Calls that would not change anything are skipped, so the
+// per-frame rebinding of the same programs, textures and constant uniforms
+// stops reaching the driver.
+// - only knows about what went through it: after raw GL calls that change
+// bindings (or delete bound objects) call invalidate()
+// - uniform setters act on the program passed in, which has to be the
+// current one (as with glUniform*)
+class GLStateCache {
+public:
+  // Calls forwarded to GL and calls skipped since the last resetStats()
+  struct Stats {
+    int issued = 0;
+    int elided = 0;
+  };
+
+  void useProgram(GLuint program);
+  void bindVertexArray(GLuint vao);
+  // Binds to GL_FRAMEBUFFER (read and draw)
+  void bindFramebuffer(GLuint fbo);
+  // Mirrors glActiveTexture(GL_TEXTURE0 + unit) and glBindTexture, for code
+  // that goes on to modify the bound texture
+  void activeTexture(GLuint unit);
+  void bindTexture(GLenum target, GLuint texture);
+  // Binds texture to unit for sampling
+  // - the active unit only changes when the binding does
+  void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+  // Location of a uniform, looked up once per program
+  GLint uniformLocation(GLuint program, const char *name);
+  void uniform1i(GLuint program, const char *name, int v);
+  void uniform1ui(GLuint program, const char *name, GLuint v);
+  void uniform1f(GLuint program, const char *name, float v);
+  void uniform2fv(GLuint program, const char *name, const glm::vec2 &v);
+  void uniform3fv(GLuint program, const char *name, const glm::vec3 &v);
+  void uniform4fv(GLuint program, const char *name, const glm::vec4 &v);
+  void uniformMatrix4fv(GLuint program, const char *name, const glm::mat4 &m);
+
+  // Forgets every binding (uniform values are kept, they live in the
+  // programs)
+  void invalidate();
+  // Forgets what may change between frames behind the cache's back: the
+  // framebuffer (QOpenGLWidget binds its own before paintGL), program, VAO
+  // and the textures of the active unit
+  void beginFrame();
+  // Forgets the locations and values of a program that is deleted or
+  // relinked
+  void forgetProgram(GLuint program);
+
+  const Stats &getStats() const;
+  void resetStats();
+
+private:
+  // Value of a binding that has not been seen yet
+  static constexpr GLuint UNKNOWN = ~0u;
+
+  // Counts the call and returns whether it has to reach GL
+  bool issue(bool changed);
+  // Whether size bytes at data differ from the cached value of the uniform
+  // (also updates it)
+  bool uniformChanged(GLuint program, GLint loc, const void *data,
+                      size_t size);
+
+  GLuint m_program = UNKNOWN;
+  GLuint m_vao = UNKNOWN;
+  GLuint m_fbo = UNKNOWN;
+  GLuint m_activeUnit = UNKNOWN;
+  // (unit, target) -> texture
+  std::map<std::pair<GLuint, GLenum>, GLuint> m_textures;
+  // program -> uniform name -> location
+  std::unordered_map<GLuint, std::unordered_map<std::string, GLint>>
+      m_locations;
+  // program -> location -> bytes last written
+  std::unordered_map<GLuint,
+                     std::unordered_map<GLint, std::vector<unsigned char>>>
+      m_uniforms;
+  Stats m_stats;
+};
@@ -0,0 +1,178 @@
+#include "noisevolume.h"
+
+#include <QStandardPaths>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <iostream>
+#include <thread>
+
+// Bump whenever the baked noise changes so that old caches are rebuilt
+#define NOISE_VOLUME_VERSION 1
+#define NOISE_VOLUME_MAGIC 0x4c4f564e // "NVOL"
+
+namespace {
+/**
+ * @brief Hashes a lattice point to [0, 1)
+ * - coordinates are wrapped by the period, which makes the noise tileable
+ */
+float hashLattice(int x, int y, int z) {
+  uint32_t h = uint32_t(x & (NoiseVolume::PERIOD - 1)) * 73856093u ^
+               uint32_t(y & (NoiseVolume::PERIOD - 1)) * 19349663u ^
+               uint32_t(z & (NoiseVolume::PERIOD - 1)) * 83492791u;
+  // murmur3 finalizer
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return float(h >> 8) / float(1u << 24);
+}
+
+/**
+ * @brief Value noise with quintic interpolation and its derivatives
+ * - same construction as noised(vec3) in raymarch.frag
+ * @param x Point in lattice units
+ * @returns (value in [-1, 1], d/dx, d/dy, d/dz)
+ */
+glm::vec4 noised(const glm::vec3 &x) {
+  glm::vec3 p = glm::floor(x);
+  glm::vec3 w = x - p;
+  glm::vec3 u = w * w * w * (w * (w * 6.f - 15.f) + 10.f);
+  glm::vec3 du = 30.f * w * w * (w * (w - 2.f) + 1.f);
+  int i = int(p.x), j = int(p.y), k = int(p.z);
+
+  float a = hashLattice(i, j, k);
+  float b = hashLattice(i + 1, j, k);
+  float c = hashLattice(i, j + 1, k);
+  float d = hashLattice(i + 1, j + 1, k);
+  float e = hashLattice(i, j, k + 1);
+  float f = hashLattice(i + 1, j, k + 1);
+  float g = hashLattice(i, j + 1, k + 1);
+  float h = hashLattice(i + 1, j + 1, k + 1);
+
+  float k0 = a;
+  float k1 = b - a;
+  float k2 = c - a;
+  float k3 = e - a;
+  float k4 = a - b - c + d;
+  float k5 = a - c - e + g;
+  float k6 = a - b - e + f;
+  float k7 = -a + b + c - d + e - f - g + h;
+
+  float value = k0 + k1 * u.x + k2 * u.y + k3 * u.z + k4 * u.x * u.y +
+                k5 * u.y * u.z + k6 * u.z * u.x + k7 * u.x * u.y * u.z;
+  glm::vec3 deriv =
+      2.f * du *
+      glm::vec3(k1 + k4 * u.y + k6 * u.z + k7 * u.y * u.z,
+                k2 + k5 * u.z + k4 * u.x + k7 * u.z * u.x,
+                k3 + k6 * u.x + k5 * u.y + k7 * u.x * u.y);
+  return glm::vec4(-1.f + 2.f * value, deriv);
+}
+} // namespace
+
+/**
+ * @brief Loads the volume
+ * - the cache lives in the user's cache directory, so the volume is only
+ *   baked on the first run (or after NOISE_VOLUME_VERSION changes)
+ */
+void NoiseVolume::load() {
+  std::filesystem::path dir =
+      QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+          .toStdString();
+  std::string path = (dir / "noise_volume.bin").string();
+  if (readCache(path)) {
+    return;
+  }
+  bake();
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  writeCache(path);
+}
+
+/**
+ * @brief Gets the baked texels
+ * @returns SIZE^3 half float RGBA texels
+ */
+const std::vector<uint16_t> &NoiseVolume::getData() const { return m_data; }
+
+/**
+ * @brief Bakes the volume, splitting the z slices over all hardware threads
+ */
+void NoiseVolume::bake() {
+  m_data.assign(size_t(SIZE) * SIZE * SIZE * 4, 0);
+  int numThreads =
+      std::clamp(int(std::thread::hardware_concurrency()), 1, SIZE);
+  int slicesPerThread = (SIZE + numThreads - 1) / numThreads;
+  std::vector<std::thread> threads;
+  for (int z0 = 0; z0 < SIZE; z0 += slicesPerThread) {
+    threads.emplace_back(&NoiseVolume::bakeSlices, this, z0,
+                         std::min(z0 + slicesPerThread, SIZE));
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+}
+
+/**
+ * @brief Bakes a range of z slices
+ * - texel i is centered at (i + 0.5) / SAMPLES_PER_CELL lattice units, which
+ *   is where texture() hits it with coordinates x / PERIOD
+ * @param z0 First slice
+ * @param z1 One past the last slice
+ */
+void NoiseVolume::bakeSlices(int z0, int z1) {
+  for (int z = z0; z < z1; z++) {
+    for (int y = 0; y < SIZE; y++) {
+      for (int x = 0; x < SIZE; x++) {
+        glm::vec4 n =
+            noised((glm::vec3(x, y, z) + 0.5f) / float(SAMPLES_PER_CELL));
+        size_t idx = ((size_t(z) * SIZE + y) * SIZE + x) * 4;
+        for (int c = 0; c < 4; c++) {
+          m_data[idx + c] = glm::packHalf1x16(n[c]);
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief Reads the cached volume
+ * @param path Cache file
+ * @returns true if the cache exists and matches this build's volume
+ */
+bool NoiseVolume::readCache(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  int32_t header[4];
+  in.read(reinterpret_cast<char *>(header), sizeof(header));
+  if (!in || header[0] != NOISE_VOLUME_MAGIC ||
+      header[1] != NOISE_VOLUME_VERSION || header[2] != SIZE ||
+      header[3] != PERIOD) {
+    return false;
+  }
+  m_data.resize(size_t(SIZE) * SIZE * SIZE * 4);
+  in.read(reinterpret_cast<char *>(m_data.data()),
+          m_data.size() * sizeof(uint16_t));
+  return bool(in);
+}
+
+/**
+ * @brief Writes the volume to the cache
+ * @param path Cache file
+ */
+void NoiseVolume::writeCache(const std::string &path) const {
+  std::ofstream out(path, std::ios::binary);
+  if (!out) {
+    std::cout << "Failed to write noise volume cache " << path << std::endl;
+    return;
+  }
+  int32_t header[4] = {NOISE_VOLUME_MAGIC, NOISE_VOLUME_VERSION, SIZE, PERIOD};
+  out.write(reinterpret_cast<const char *>(header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(m_data.data()),
+            m_data.size() * sizeof(uint16_t));
+}
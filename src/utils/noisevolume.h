@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Tileable 3D value noise and its analytic derivatives, baked once on the CPU
+// and cached on disk. Uploaded as a 3D texture so that the fbm loops in
+// raymarch.frag can replace the per-sample hashing with a single fetch.
+class NoiseVolume {
+public:
+  // Number of lattice cells along each axis before the noise repeats
+  static constexpr int PERIOD = 32;
+  // Texels per lattice cell along each axis
+  static constexpr int SAMPLES_PER_CELL = 4;
+  // Texels along each axis
+  static constexpr int SIZE = PERIOD * SAMPLES_PER_CELL;
+
+  // Loads the volume from the cache, baking and caching it if needed
+  void load();
+
+  // Half float RGBA texels (value, d/dx, d/dy, d/dz), x fastest
+  const std::vector<uint16_t> &getData() const;
+
+private:
+  // Bakes the whole volume using every hardware thread
+  void bake();
+  // Bakes the z slices [z0, z1)
+  void bakeSlices(int z0, int z1);
+
+  // Reads the cache, returns false if it is missing or stale
+  bool readCache(const std::string &path);
+  // Writes the cache
+  void writeCache(const std::string &path) const;
+
+  std::vector<uint16_t> m_data;
+};
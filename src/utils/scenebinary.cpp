@@ -0,0 +1,327 @@
+#include "scenebinary.h"
+
+#include <QFile>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+
+// Bump whenever the records below change so that old files are rejected
+#define SCENE_BINARY_VERSION 1
+#define SCENE_BINARY_MAGIC 0x4e435352 // "RSCN"
+
+namespace {
+// File layout:
+// Header | SceneLightData[numLights] | ShapeRecord[numShapes]
+//        | uint32_t stringOffsets[numStrings + 1] | char strings[stringBytes]
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  // - sizes of the records, a different compiler or glm may lay them out
+  //   differently
+  uint32_t headerSize;
+  uint32_t lightSize;
+  uint32_t shapeSize;
+  uint32_t numLights;
+  uint32_t numShapes;
+  uint32_t numStrings;
+  uint32_t stringBytes;
+  uint32_t isAreaLightUsed;
+  SceneGlobalData globalData;
+  SceneCameraData cameraData;
+};
+
+// SceneFileMap with the file name interned (-1 = no file)
+struct FileMapRecord {
+  int32_t name;
+  uint32_t isUsed;
+  float repeatU;
+  float repeatV;
+};
+
+// RenderShapeData with the strings interned
+struct ShapeRecord {
+  glm::mat4 ctm;
+  glm::mat4 scale;
+  SceneColor cAmbient;
+  SceneColor cDiffuse;
+  SceneColor cSpecular;
+  SceneColor cReflective;
+  SceneColor cTransparent;
+  SceneColor cEmissive;
+  float shininess;
+  float ior;
+  float blend;
+  PrimitiveType type;
+  FileMapRecord textureMap;
+  FileMapRecord bumpMap;
+  int32_t meshfile;
+};
+
+static_assert(std::is_trivially_copyable_v<Header>);
+static_assert(std::is_trivially_copyable_v<SceneLightData>);
+static_assert(std::is_trivially_copyable_v<ShapeRecord>);
+
+// Interns strings in the order they are first seen
+class StringTable {
+public:
+  int32_t intern(const std::string &s) {
+    if (s.empty()) {
+      return -1;
+    }
+    auto [it, inserted] = m_index.try_emplace(s, int32_t(m_offsets.size()));
+    if (inserted) {
+      m_offsets.push_back(uint32_t(m_chars.size()));
+      m_chars += s;
+    }
+    return it->second;
+  }
+
+  uint32_t size() const { return uint32_t(m_offsets.size()); }
+
+  // Offsets of every string followed by the end of the last one
+  std::vector<uint32_t> offsets() const {
+    std::vector<uint32_t> offsets = m_offsets;
+    offsets.push_back(uint32_t(m_chars.size()));
+    return offsets;
+  }
+
+  const std::string &chars() const { return m_chars; }
+
+private:
+  std::unordered_map<std::string, int32_t> m_index;
+  std::vector<uint32_t> m_offsets;
+  std::string m_chars;
+};
+
+// File name as stored: relative to dir, the folder of the compiled scene
+// - names are resolved against the working directory of the compiler, as
+//   the JSON reader left them
+// - kept absolute when there is no relative path (another drive)
+std::string relativeTo(const std::string &file,
+                       const std::filesystem::path &dir) {
+  if (file.empty()) {
+    return file;
+  }
+  std::filesystem::path absolute =
+      std::filesystem::absolute(file).lexically_normal();
+  std::filesystem::path relative = absolute.lexically_relative(dir);
+  return (relative.empty() ? absolute : relative).generic_string();
+}
+
+// File name as loaded: resolved against dir, the folder of the compiled scene
+std::string resolveFrom(std::string_view file,
+                        const std::filesystem::path &dir) {
+  return (dir / std::filesystem::path(file)).lexically_normal().string();
+}
+
+FileMapRecord packFileMap(const SceneFileMap &map, StringTable &strings,
+                          const std::filesystem::path &dir) {
+  return FileMapRecord{strings.intern(relativeTo(map.filename, dir)),
+                       map.isUsed, map.repeatU, map.repeatV};
+}
+
+SceneFileMap unpackFileMap(const FileMapRecord &record,
+                           const std::vector<std::string_view> &strings,
+                           const std::filesystem::path &dir) {
+  SceneFileMap map;
+  map.isUsed = record.isUsed;
+  if (record.name >= 0) {
+    map.filename = resolveFrom(strings[record.name], dir);
+  }
+  map.repeatU = record.repeatU;
+  map.repeatV = record.repeatV;
+  return map;
+}
+
+bool validName(int32_t name, uint32_t numStrings) {
+  return name >= -1 && name < int32_t(numStrings);
+}
+} // namespace
+
+/**
+ * @brief Writes the flattened scene
+ * @param path File to write
+ * @param renderData Parsed scene
+ * @returns True on success
+ */
+bool SceneBinary::write(const std::string &path,
+                        const RenderData &renderData) {
+  std::filesystem::path dir =
+      std::filesystem::absolute(path).lexically_normal().parent_path();
+  StringTable strings;
+  std::vector<ShapeRecord> shapes;
+  shapes.reserve(renderData.shapes.size());
+  for (const RenderShapeData &shape : renderData.shapes) {
+    const SceneMaterial &material = shape.primitive.material;
+    shapes.push_back(ShapeRecord{
+        shape.ctm,
+        shape.scale,
+        material.cAmbient,
+        material.cDiffuse,
+        material.cSpecular,
+        material.cReflective,
+        material.cTransparent,
+        material.cEmissive,
+        material.shininess,
+        material.ior,
+        material.blend,
+        shape.primitive.type,
+        packFileMap(material.textureMap, strings, dir),
+        packFileMap(material.bumpMap, strings, dir),
+        strings.intern(relativeTo(shape.primitive.meshfile, dir)),
+    });
+  }
+  std::vector<uint32_t> offsets = strings.offsets();
+
+  Header header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = SCENE_BINARY_MAGIC;
+  header.version = SCENE_BINARY_VERSION;
+  header.headerSize = sizeof(Header);
+  header.lightSize = sizeof(SceneLightData);
+  header.shapeSize = sizeof(ShapeRecord);
+  header.numLights = uint32_t(renderData.lights.size());
+  header.numShapes = uint32_t(shapes.size());
+  header.numStrings = strings.size();
+  header.stringBytes = uint32_t(strings.chars().size());
+  header.isAreaLightUsed = renderData.isAreaLightUsed;
+  header.globalData = renderData.globalData;
+  header.cameraData = renderData.cameraData;
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    std::cout << "could not open " << path << std::endl;
+    return false;
+  }
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(renderData.lights.data()),
+            renderData.lights.size() * sizeof(SceneLightData));
+  out.write(reinterpret_cast<const char *>(shapes.data()),
+            shapes.size() * sizeof(ShapeRecord));
+  out.write(reinterpret_cast<const char *>(offsets.data()),
+            offsets.size() * sizeof(uint32_t));
+  out.write(strings.chars().data(), strings.chars().size());
+  if (!out) {
+    std::cout << "could not write " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Maps a compiled scene and copies it into renderData
+ * - one allocation per array; only the file names of shapes that use a
+ *   texture, bump map or mesh allocate per shape
+ * @param path File to read
+ * @param renderData On return, the scene
+ * @returns True on success
+ */
+bool SceneBinary::read(const std::string &path, RenderData &renderData) {
+  QFile file(path.c_str());
+  if (!file.open(QFile::ReadOnly)) {
+    std::cout << "could not open " << path << std::endl;
+    return false;
+  }
+  qint64 size = file.size();
+  if (size < qint64(sizeof(Header))) {
+    std::cout << path << " is not a compiled scene" << std::endl;
+    return false;
+  }
+  const uchar *data = file.map(0, size);
+  if (!data) {
+    std::cout << "could not map " << path << std::endl;
+    return false;
+  }
+
+  Header header;
+  std::memcpy(&header, data, sizeof(header));
+  if (header.magic != SCENE_BINARY_MAGIC ||
+      header.version != SCENE_BINARY_VERSION ||
+      header.headerSize != sizeof(Header) ||
+      header.lightSize != sizeof(SceneLightData) ||
+      header.shapeSize != sizeof(ShapeRecord)) {
+    std::cout << path << " was compiled by a different version, recompile it"
+              << std::endl;
+    return false;
+  }
+  // Section offsets
+  qint64 lightsAt = sizeof(Header);
+  qint64 shapesAt = lightsAt + qint64(header.numLights) * header.lightSize;
+  qint64 offsetsAt = shapesAt + qint64(header.numShapes) * header.shapeSize;
+  qint64 charsAt =
+      offsetsAt + (qint64(header.numStrings) + 1) * sizeof(uint32_t);
+  if (charsAt + header.stringBytes != size) {
+    std::cout << path << " is truncated" << std::endl;
+    return false;
+  }
+
+  // String table, viewed in place
+  std::vector<uint32_t> offsets(header.numStrings + 1);
+  std::memcpy(offsets.data(), data + offsetsAt,
+              offsets.size() * sizeof(uint32_t));
+  std::vector<std::string_view> strings;
+  strings.reserve(header.numStrings);
+  const char *chars = reinterpret_cast<const char *>(data + charsAt);
+  for (uint32_t i = 0; i < header.numStrings; i++) {
+    if (offsets[i] > offsets[i + 1] || offsets[i + 1] > header.stringBytes) {
+      std::cout << path << " has a corrupt string table" << std::endl;
+      return false;
+    }
+    strings.emplace_back(chars + offsets[i], offsets[i + 1] - offsets[i]);
+  }
+
+  // File names are relative to the compiled scene
+  std::filesystem::path dir =
+      std::filesystem::absolute(path).lexically_normal().parent_path();
+  renderData.globalData = header.globalData;
+  renderData.cameraData = header.cameraData;
+  renderData.isAreaLightUsed = header.isAreaLightUsed;
+  renderData.lights.resize(header.numLights);
+  std::memcpy(renderData.lights.data(), data + lightsAt,
+              header.numLights * sizeof(SceneLightData));
+  renderData.shapes.clear();
+  renderData.shapes.reserve(header.numShapes);
+  for (uint32_t i = 0; i < header.numShapes; i++) {
+    ShapeRecord record;
+    std::memcpy(&record, data + shapesAt + qint64(i) * sizeof(ShapeRecord),
+                sizeof(record));
+    if (!validName(record.textureMap.name, header.numStrings) ||
+        !validName(record.bumpMap.name, header.numStrings) ||
+        !validName(record.meshfile, header.numStrings)) {
+      std::cout << path << " has a corrupt shape" << std::endl;
+      return false;
+    }
+    RenderShapeData &shape = renderData.shapes.emplace_back();
+    SceneMaterial &material = shape.primitive.material;
+    shape.primitive.type = record.type;
+    if (record.meshfile >= 0) {
+      shape.primitive.meshfile = resolveFrom(strings[record.meshfile], dir);
+    }
+    material.cAmbient = record.cAmbient;
+    material.cDiffuse = record.cDiffuse;
+    material.cSpecular = record.cSpecular;
+    material.shininess = record.shininess;
+    material.cReflective = record.cReflective;
+    material.cTransparent = record.cTransparent;
+    material.ior = record.ior;
+    material.textureMap = unpackFileMap(record.textureMap, strings, dir);
+    material.blend = record.blend;
+    material.cEmissive = record.cEmissive;
+    material.bumpMap = unpackFileMap(record.bumpMap, strings, dir);
+    shape.ctm = record.ctm;
+    shape.scale = record.scale;
+  }
+  return true;
+}
+
+bool SceneBinary::isBinary(const std::string &path) {
+  std::string_view extension = SCENE_BINARY_EXTENSION;
+  return path.size() >= extension.size() &&
+         path.compare(path.size() - extension.size(), extension.size(),
+                      extension) == 0;
+}
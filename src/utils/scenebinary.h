@@ -0,0 +1,30 @@
+#pragma once
+
+#include "sceneparser.h"
+#include <string>
+
+// File extension of compiled scenes
+#define SCENE_BINARY_EXTENSION ".scenebin"
+
+// Precompiled scene: the flattened RenderData of a JSON scene file, written
+// as fixed size records so that loading it is a single mmap and a copy per
+// array instead of a JSON parse and a scene graph walk.
+// - file names (texture and bump maps, meshes) are interned into a string
+//   table that the records index into
+// - file names are stored relative to the folder of the compiled scene and
+//   resolved against it on load, so the file can be opened from any working
+//   directory as long as it keeps its place next to the textures
+// - native byte order and struct layout, files are rejected when the
+//   version or the record sizes do not match the running build
+class SceneBinary {
+public:
+  // Writes renderData to path, returns false on failure
+  static bool write(const std::string &path, const RenderData &renderData);
+
+  // Reads path into renderData, returns false if the file is missing,
+  // truncated or was written by an incompatible build
+  static bool read(const std::string &path, RenderData &renderData);
+
+  // Whether path names a compiled scene
+  static bool isBinary(const std::string &path);
+};
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "rgba.h"
+#include <QDateTime>
 #include <QImage>
 #include <glm/glm.hpp>
+#include <memory_resource>
 #include <string>
 #include <vector>
 
@@ -53,6 +55,9 @@ struct TextureInfo {
   std::vector<RGBA> data;
   int width;
   int height;
+  // File as it was when decoded, to notice edits saved under the same name
+  QDateTime modified;
+  qint64 fileSize = -1;
 };
 
 // Type which can be used to store an RGBA color in floats [0,1]
@@ -66,6 +71,7 @@ struct SceneGlobalData {
   float kd; // Diffuse term
   float ks; // Specular term
   float kt; // Transparency; used for extra credit (refraction)
+  float relaxation; // Over-relaxation for relaxed sphere tracing (0 = default)
 };
 
 // Struct which contains raw parsed data fro a single light
@@ -199,10 +205,17 @@ struct SceneTransformation {
 
 // Struct which represents a node in the scene graph/tree, to be parsed by the
 // student's `SceneParser`.
+// - the lists live in the arena the node is allocated from (see
+// ScenefileReader)
 struct SceneNode {
-  std::vector<SceneTransformation *>
+  explicit SceneNode(std::pmr::memory_resource *arena =
+                         std::pmr::get_default_resource())
+      : transformations(arena), primitives(arena), lights(arena),
+        children(arena) {}
+
+  std::pmr::vector<SceneTransformation *>
       transformations; // Note the order of transformations described in lab 5
-  std::vector<ScenePrimitive *> primitives;
-  std::vector<SceneLight *> lights;
-  std::vector<SceneNode *> children;
+  std::pmr::vector<ScenePrimitive *> primitives;
+  std::pmr::vector<SceneLight *> lights;
+  std::pmr::vector<SceneNode *> children;
 };
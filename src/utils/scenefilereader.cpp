@@ -7,6 +7,8 @@
 #include <cstring>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <type_traits>
 
 #include <QFile>
 #include <QJsonArray>
@@ -20,14 +22,29 @@
   std::cout << ERROR_AT(e) << "unsupported element <"                          \
             << e.tagName().toStdString() << ">" << std::endl;
 
+// Size of the first block of the parse arena, later blocks grow from there
+#define SCENE_ARENA_BLOCK_SIZE (64 * 1024)
+
+// Only primitives (and nodes) need their destructors run before the arena
+// is released
+static_assert(std::is_trivially_destructible_v<SceneTransformation>);
+static_assert(std::is_trivially_destructible_v<SceneLight>);
+
+template <typename T, typename... Args>
+T *ScenefileReader::create(Args &&...args) {
+  return std::pmr::polymorphic_allocator<>(&m_arena).new_object<T>(
+      std::forward<Args>(args)...);
+}
+
 // Students, please ignore this file.
-ScenefileReader::ScenefileReader(const std::string &name) {
+ScenefileReader::ScenefileReader(const std::string &name)
+    : m_arena(SCENE_ARENA_BLOCK_SIZE) {
   file_name = name;
 
   memset(&m_cameraData, 0, sizeof(SceneCameraData));
   memset(&m_globalData, 0, sizeof(SceneGlobalData));
 
-  m_root = new SceneNode;
+  m_root = create<SceneNode>(&m_arena);
 
   m_templates.clear();
   m_nodes.clear();
@@ -36,18 +53,13 @@ ScenefileReader::ScenefileReader(const std::string &name) {
 }
 
 ScenefileReader::~ScenefileReader() {
-  // Delete all Scene Nodes
-  for (unsigned int node = 0; node < m_nodes.size(); node++) {
-    for (size_t i = 0; i < (m_nodes[node])->transformations.size(); i++) {
-      delete (m_nodes[node])->transformations[i];
-    }
-    for (size_t i = 0; i < (m_nodes[node])->primitives.size(); i++) {
-      delete (m_nodes[node])->primitives[i];
+  // Destroy all Scene Nodes, m_arena then frees their memory at once
+  // - the strings of the primitives may own heap memory
+  for (SceneNode *node : m_nodes) {
+    for (ScenePrimitive *primitive : node->primitives) {
+      std::destroy_at(primitive);
     }
-    (m_nodes[node])->transformations.clear();
-    (m_nodes[node])->primitives.clear();
-    (m_nodes[node])->children.clear();
-    delete m_nodes[node];
+    std::destroy_at(node);
   }
 
   m_nodes.clear();
@@ -148,7 +160,7 @@ bool ScenefileReader::readJSON() {
 bool ScenefileReader::parseGlobalData(const QJsonObject &globalData) {
   QStringList requiredFields = {"ambientCoeff", "diffuseCoeff",
                                 "specularCoeff"};
-  QStringList optionalFields = {"transparentCoeff"};
+  QStringList optionalFields = {"transparentCoeff", "relaxation"};
   QStringList allFields = requiredFields + optionalFields;
   for (auto field : globalData.keys()) {
     if (!allFields.contains(field)) {
@@ -196,6 +208,18 @@ bool ScenefileReader::parseGlobalData(const QJsonObject &globalData) {
       return false;
     }
   }
+  if (globalData.contains("relaxation")) {
+    if (!globalData["relaxation"].isDouble()) {
+      std::cout << "globalData relaxation must be a floating-point value"
+                << std::endl;
+      return false;
+    }
+    m_globalData.relaxation = globalData["relaxation"].toDouble();
+    if (m_globalData.relaxation < 1.f || m_globalData.relaxation >= 2.f) {
+      std::cout << "globalData relaxation must be in [1, 2)" << std::endl;
+      return false;
+    }
+  }
 
   return true;
 }
@@ -226,7 +250,7 @@ bool ScenefileReader::parseLightData(const QJsonObject &lightData,
   }
 
   // Create a default light
-  SceneLight *light = new SceneLight();
+  SceneLight *light = create<SceneLight>();
   memset(light, 0, sizeof(SceneLight));
   node->lights.push_back(light);
 
@@ -650,7 +674,7 @@ bool ScenefileReader::parseTemplateGroupData(const QJsonObject &templateGroup) {
     std::cout << "templateGroups cannot have the same" << std::endl;
   }
 
-  SceneNode *templateNode = new SceneNode;
+  SceneNode *templateNode = create<SceneNode>(&m_arena);
   m_nodes.push_back(templateNode);
   m_templates[templateGroup["name"].toString().toStdString()] = templateNode;
 
@@ -693,7 +717,7 @@ bool ScenefileReader::parseGroupData(const QJsonObject &object,
       return false;
     }
 
-    SceneTransformation *translation = new SceneTransformation();
+    SceneTransformation *translation = create<SceneTransformation>();
     translation->type = TransformationType::TRANSFORMATION_TRANSLATE;
     translation->translate.x = translateArray[0].toDouble();
     translation->translate.y = translateArray[1].toDouble();
@@ -721,7 +745,7 @@ bool ScenefileReader::parseGroupData(const QJsonObject &object,
       return false;
     }
 
-    SceneTransformation *rotation = new SceneTransformation();
+    SceneTransformation *rotation = create<SceneTransformation>();
     rotation->type = TransformationType::TRANSFORMATION_ROTATE;
     rotation->rotate.x = rotateArray[0].toDouble();
     rotation->rotate.y = rotateArray[1].toDouble();
@@ -750,7 +774,7 @@ bool ScenefileReader::parseGroupData(const QJsonObject &object,
       return false;
     }
 
-    SceneTransformation *scale = new SceneTransformation();
+    SceneTransformation *scale = create<SceneTransformation>();
     scale->type = TransformationType::TRANSFORMATION_SCALE;
     scale->scale.x = scaleArray[0].toDouble();
     scale->scale.y = scaleArray[1].toDouble();
@@ -772,7 +796,8 @@ bool ScenefileReader::parseGroupData(const QJsonObject &object,
       return false;
     }
 
-    SceneTransformation *matrixTransformation = new SceneTransformation();
+    SceneTransformation *matrixTransformation =
+        create<SceneTransformation>();
     matrixTransformation->type = TransformationType::TRANSFORMATION_MATRIX;
 
     float *matrixPtr = glm::value_ptr(matrixTransformation->matrix);
@@ -883,7 +908,7 @@ bool ScenefileReader::parseGroups(const QJsonValue &groups, SceneNode *parent) {
       }
     }
 
-    SceneNode *node = new SceneNode;
+    SceneNode *node = create<SceneNode>(&m_arena);
     m_nodes.push_back(node);
     parent->children.push_back(node);
 
@@ -928,7 +953,7 @@ bool ScenefileReader::parsePrimitive(const QJsonObject &prim, SceneNode *node) {
   std::string primType = prim["type"].toString().toStdString();
 
   // Default primitive
-  ScenePrimitive *primitive = new ScenePrimitive();
+  ScenePrimitive *primitive = create<ScenePrimitive>();
   SceneMaterial &mat = primitive->material;
   mat.clear();
   primitive->type = PrimitiveType::PRIMITIVE_CUBE;
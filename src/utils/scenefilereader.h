@@ -3,6 +3,7 @@
 #include "scenedata.h"
 
 #include <map>
+#include <memory_resource>
 #include <vector>
 
 #include <QJsonDocument>
@@ -38,8 +39,15 @@ private:
   bool parsePrimitive(const QJsonObject &prim, SceneNode *node);
   bool parseLightData(const QJsonObject &lightData, SceneNode *node);
 
+  // Allocates a T from m_arena
+  template <typename T, typename... Args> T *create(Args &&...args);
+
   std::string file_name;
 
+  // Every node, primitive, transformation and light of the parse, released
+  // in one go when the reader is destroyed
+  std::pmr::monotonic_buffer_resource m_arena;
+
   mutable std::map<std::string, SceneNode *> m_templates;
 
   SceneGlobalData m_globalData;
@@ -1,9 +1,11 @@
 #include "sceneparser.h"
+#include "scenebinary.h"
 #include "scenefilereader.h"
 #include <glm/gtx/string_cast.hpp>
 #include <glm/gtx/transform.hpp>
 
 #include <chrono>
+#include <iostream>
 
 /**
  * @brief Given a "light", return corresponding SceneLightData after "ctm" is
@@ -36,8 +38,9 @@ SceneParser::getSceneLightDataFromSceneLight(const SceneLight &light,
  * @return glm::mat4 which is the total transformation
  */
 std::tuple<glm::mat4, glm::mat4>
-SceneParser::getLocTransMat(const std::vector<SceneTransformation *> trans,
-                            glm::mat4 parent, glm::mat4 accScale) {
+SceneParser::getLocTransMat(std::span<SceneTransformation *const> trans,
+                            const glm::mat4 &parent,
+                            const glm::mat4 &accScale) {
   glm::mat4 T = glm::mat4(1.f);
   glm::mat4 R = glm::mat4(1.f);
   glm::mat4 S = glm::mat4(1.f);
@@ -71,43 +74,55 @@ SceneParser::getLocTransMat(const std::vector<SceneTransformation *> trans,
 }
 
 /**
- * @brief Given a SceneNode "currScene" and ctm "parent", apply ctm to each
- * object in our primitive list. Also apply ctm to lights. Store all of them in
- * "renderData".
+ * @brief Walks the scene graph under "root", applies each node's ctm to its
+ * primitives and lights and stores all of them in "renderData"
+ * - depth first with an explicit stack, so deeply nested template instances
+ *   cannot overflow the call stack
+ * - shapes come out in the same order as a recursive walk would emit them
+ * @param root: root of the scene graph
  * @param renderData: RenderData we are storing our outputs to
- * @param currScene: currScene we are working with
- * @param parent: parent node's ctm
  */
-void SceneParser::parseHelper(RenderData &renderData, SceneNode *currScene,
-                              glm::mat4 parent, glm::mat4 accScale) {
-  // First we find the local transformation matrix
-  auto [ctm, s] = getLocTransMat(currScene->transformations, parent, accScale);
-  // Then compute the CTM of this node
-  // For each primitive
-  for (int i = 0; i < currScene->primitives.size(); i++) {
-    renderData.shapes.push_back(RenderShapeData{
-        *currScene->primitives[i],
-        ctm,
-        s,
-    });
-  }
-  // For each light, apply ctm
-  for (int i = 0; i < currScene->lights.size(); i++) {
-    auto sceneLightData =
-        getSceneLightDataFromSceneLight(*currScene->lights[i], ctm);
-    renderData.lights.push_back(sceneLightData);
-    if (sceneLightData.type == LightType::LIGHT_AREA) {
-      // We need to render area lights
-      renderData.isAreaLightUsed = true;
+void SceneParser::flatten(SceneNode *root, RenderData &renderData) {
+  // Node still to visit, with its parent's ctm and accumulated scale
+  struct PendingNode {
+    SceneNode *node;
+    glm::mat4 parent;
+    glm::mat4 accScale;
+  };
+  std::vector<PendingNode> stack = {{root, glm::mat4(1.f), glm::mat4(1.f)}};
+  while (!stack.empty()) {
+    PendingNode curr = stack.back();
+    stack.pop_back();
+    // First we find the local transformation matrix
+    auto [ctm, s] =
+        getLocTransMat(curr.node->transformations, curr.parent, curr.accScale);
+    // For each primitive
+    for (ScenePrimitive *primitive : curr.node->primitives) {
+      renderData.shapes.push_back(RenderShapeData{
+          *primitive,
+          ctm,
+          s,
+      });
+    }
+    // For each light, apply ctm
+    for (SceneLight *light : curr.node->lights) {
+      auto sceneLightData = getSceneLightDataFromSceneLight(*light, ctm);
+      renderData.lights.push_back(sceneLightData);
+      if (sceneLightData.type == LightType::LIGHT_AREA) {
+        // We need to render area lights
+        renderData.isAreaLightUsed = true;
+      }
+    }
+    // Children go on in reverse so that the first one is visited next
+    for (auto it = curr.node->children.rbegin();
+         it != curr.node->children.rend(); it++) {
+      stack.push_back({*it, ctm, s});
     }
-  }
-  // For each child scene, recursively call this function
-  for (int i = 0; i < currScene->children.size(); i++) {
-    parseHelper(renderData, currScene->children[i], ctm, s);
   }
 }
 
 /** Parse the scene and store the results in renderData.
+ * - compiled scenes (SCENE_BINARY_EXTENSION) are mapped instead of parsed
  * @param filepath    The path of the scene file to load.
  * @param renderData  On return, this will contain the metadata of the loaded
  * scene.
@@ -115,6 +130,25 @@ void SceneParser::parseHelper(RenderData &renderData, SceneNode *currScene,
  * successful
  */
 bool SceneParser::parse(std::string filepath, RenderData &renderData) {
+  auto start = std::chrono::steady_clock::now();
+  bool success = SceneBinary::isBinary(filepath)
+                     ? SceneBinary::read(filepath, renderData)
+                     : parseJSON(filepath, renderData);
+  if (success) {
+    std::chrono::duration<double, std::milli> ms =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "Loaded " << renderData.shapes.size() << " shapes and "
+              << renderData.lights.size() << " lights in " << ms.count()
+              << " ms" << std::endl;
+  }
+  return success;
+}
+
+/**
+ * @brief Parses a JSON scene file and flattens its scene graph
+ */
+bool SceneParser::parseJSON(const std::string &filepath,
+                            RenderData &renderData) {
   ScenefileReader fileReader = ScenefileReader(filepath);
   bool success = fileReader.readJSON();
   if (!success) {
@@ -126,8 +160,28 @@ bool SceneParser::parse(std::string filepath, RenderData &renderData) {
   // clean slate
   renderData.shapes.clear();
   renderData.lights.clear();
+  renderData.isAreaLightUsed = false;
   // start the parsign from the root
-  parseHelper(renderData, rt, glm::mat4(1.0f), glm::mat4(1.0f));
+  flatten(rt, renderData);
 
   return true;
 }
+
+/**
+ * @brief Compiles a JSON scene file into the binary format
+ * @param jsonPath Scene file to compile
+ * @param outPath Compiled scene to write
+ * @return True on success
+ */
+bool SceneParser::compile(const std::string &jsonPath,
+                          const std::string &outPath) {
+  RenderData renderData;
+  if (!parseJSON(jsonPath, renderData)) {
+    return false;
+  }
+  if (!SceneBinary::write(outPath, renderData)) {
+    return false;
+  }
+  std::cout << "Compiled " << jsonPath << " to " << outPath << std::endl;
+  return true;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "scenedata.h"
+#include <span>
 #include <string>
 #include <vector>
 
@@ -31,14 +32,22 @@ private:
   // Given a list of transformations, apply all of them in order and return the
   // total transformation
   static std::tuple<glm::mat4, glm::mat4>
-  getLocTransMat(const std::vector<SceneTransformation *> trans,
-                 glm::mat4 parent, glm::mat4 accScale);
+  getLocTransMat(std::span<SceneTransformation *const> trans,
+                 const glm::mat4 &parent, const glm::mat4 &accScale);
 
-  // Recursive helper function for parsing the scene graph
-  static void parseHelper(RenderData &renderData, SceneNode *currScene,
-                          glm::mat4 parent, glm::mat4 accScale);
+  // Parse a JSON scene file
+  static bool parseJSON(const std::string &filepath, RenderData &renderData);
 
 public:
   // Parse the scene and store the results in renderData.
   static bool parse(std::string filepath, RenderData &renderData);
+
+  // Append the shapes and lights of the scene graph under root to
+  // renderData
+  static void flatten(SceneNode *root, RenderData &renderData);
+
+  // Parse a JSON scene file and write it as a compiled scene (see
+  // SceneBinary)
+  static bool compile(const std::string &jsonPath,
+                      const std::string &outPath);
 };
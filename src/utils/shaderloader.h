@@ -7,7 +7,9 @@
 #include <GL/glew.h>
 #include <QFile>
 #include <QTextStream>
+#include <initializer_list>
 #include <iostream>
+#include <sstream>
 
 class ShaderLoader {
 public:
@@ -17,11 +19,23 @@ public:
     GLuint vertexShaderID = createShader(GL_VERTEX_SHADER, vertex_file_path);
     GLuint fragmentShaderID =
         createShader(GL_FRAGMENT_SHADER, fragment_file_path);
+    return linkProgram({vertexShaderID, fragmentShaderID});
+  }
+
+  // Needs GL 4.3. Lines of the form #include "path" are replaced by the
+  // contents of that file (without its #version line), so that a compute
+  // shader can reuse the functions of a fragment shader.
+  static GLuint createComputeProgram(const char *compute_file_path) {
+    return linkProgram({createShader(GL_COMPUTE_SHADER, compute_file_path)});
+  }
 
+private:
+  static GLuint linkProgram(std::initializer_list<GLuint> shaderIDs) {
     // Link the shader program.
     GLuint programID = glCreateProgram();
-    glAttachShader(programID, vertexShaderID);
-    glAttachShader(programID, fragmentShaderID);
+    for (GLuint shaderID : shaderIDs) {
+      glAttachShader(programID, shaderID);
+    }
     glLinkProgram(programID);
 
     // Print the info log if error
@@ -40,27 +54,44 @@ public:
     }
 
     // Shaders no longer necessary, stored in program
-    glDeleteShader(vertexShaderID);
-    glDeleteShader(fragmentShaderID);
+    for (GLuint shaderID : shaderIDs) {
+      glDeleteShader(shaderID);
+    }
 
     return programID;
   }
 
-private:
+  static std::string readShader(const char *filepath) {
+    QFile file(filepath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+      throw std::runtime_error(std::string("Failed to open shader: ") +
+                               filepath);
+    }
+    QTextStream stream(&file);
+    std::istringstream lines(stream.readAll().toStdString());
+    std::string code, line;
+    while (std::getline(lines, line)) {
+      if (line.rfind("#include \"", 0) == 0) {
+        size_t begin = line.find('"') + 1;
+        std::string path = line.substr(begin, line.find('"', begin) - begin);
+        std::string included = readShader(path.c_str());
+        // - only the including file may declare the version
+        if (included.rfind("#version", 0) == 0) {
+          included.erase(0, included.find('\n') + 1);
+        }
+        code += included;
+      } else {
+        code += line + "\n";
+      }
+    }
+    return code;
+  }
+
   static GLuint createShader(GLenum shaderType, const char *filepath) {
     GLuint shaderID = glCreateShader(shaderType);
 
     // Read shader file.
-    std::string code;
-    QString filepathStr = QString(filepath);
-    QFile file(filepathStr);
-    if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-      QTextStream stream(&file);
-      code = stream.readAll().toStdString();
-    } else {
-      throw std::runtime_error(std::string("Failed to open shader: ") +
-                               filepath);
-    }
+    std::string code = readShader(filepath);
 
     // Compile shader code.
     const char *codePtr = code.c_str();